@@ -2,67 +2,96 @@
 #include "./ui_algorithmvisualizermainwindow.h"
 
 #include <QPainter>
+#include <algorithm>
+#include <map>
 #include<unordered_map>
+#include <vector>
 
-#include "balancedbinarytree.h"
-#include "binaryheap.h"
-#include "redblacktree.h"
+#include "treefactory.h"
 
 AlgorithmVisualizerMainWindow::AlgorithmVisualizerMainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::AlgorithmVisualizerMainWindow())
+    , latencyRecorder(std::make_unique<LatencyRecorder>())
 {
     ui->setupUi(this);
 
-    binaryTree = createTree(ui->treeNameBox->currentText());
-    updateBinaryTreeProperties();
+    resetTree(ui->treeNameBox->currentText());
 }
 
 AlgorithmVisualizerMainWindow::~AlgorithmVisualizerMainWindow()
 {
+    mutationQueue.reset();
     delete ui;
 }
 
 void AlgorithmVisualizerMainWindow::on_addValueButton_clicked()
 {
     const auto value = ui->addValueText->text().toInt(nullptr, 0);
-    if (binaryTree->add(value))
-    {
-        //redrawBinaryTree();
-        updateBinaryTreeProperties();
-    }
+    mutationQueue->add(value);
 }
 
 void AlgorithmVisualizerMainWindow::on_removeValueButton_clicked()
 {
     const auto value = ui->removeValueText->text().toInt(nullptr, 0);
-    if (binaryTree->remove(value))
-    {
-        //redrawBinaryTree();
-        updateBinaryTreeProperties();
-    }
+    mutationQueue->remove(value);
 }
 
 void AlgorithmVisualizerMainWindow::on_clearButton_clicked()
 {
-    binaryTree = createTree(ui->treeNameBox->currentText());
-    //redrawBinaryTree();
-    updateBinaryTreeProperties();
+    resetTree(ui->treeNameBox->currentText());
 }
 
 void AlgorithmVisualizerMainWindow::on_randomFillButton_clicked()
 {
-    binaryTree = createTree(ui->treeNameBox->currentText());
-    binaryTree->randomFill();
-    //redrawBinaryTree();
-    updateBinaryTreeProperties();
+    resetTree(ui->treeNameBox->currentText());
+    mutationQueue->run([](BinaryTreeBase<int> &tree) { tree.randomFill(); });
 }
 
 void AlgorithmVisualizerMainWindow::on_treeNameBox_currentTextChanged(const QString &treeName)
 {
+    resetTree(treeName);
+}
+
+void AlgorithmVisualizerMainWindow::resetTree(const QString &treeName)
+{
+    stopAnimation();
+    // Lets the old queue finish with the old tree before the tree goes away
+    mutationQueue.reset();
     binaryTree = createTree(treeName);
-    //redrawBinaryTree();
-    updateBinaryTreeProperties();
+
+    std::unordered_map<std::string, int> binaryTreeProperties;
+    binaryTree->buildProperties(binaryTreeProperties);
+    updateBinaryTreeProperties(binaryTreeProperties);
+
+    const int generation = ++treeGeneration;
+    mutationQueue = std::make_unique<TreeMutationQueue<int>>(*binaryTree, [this, generation](const TreeMutationQueue<int>::BatchResult &result)
+    {
+        QMetaObject::invokeMethod(this, [this, generation, result]() { applyBatchResult(generation, result); }, Qt::QueuedConnection);
+    });
+    mutationQueue->setAnimateSingleMutations(true);
+}
+
+void AlgorithmVisualizerMainWindow::applyBatchResult(int generation, const TreeMutationQueue<int>::BatchResult &result)
+{
+    if(generation != treeGeneration)
+    {
+        return;
+    }
+
+    if(result.animation)
+    {
+        animation = std::move(*result.animation);
+        isAnimating = true;
+        stepEndPositions = layoutAnimationTree();
+        advanceAnimation();
+    }
+    else if(result.appliedCount > 0)
+    {
+        // A batch changes more than one step can show, the tree is drawn as it is
+        stopAnimation();
+    }
+    updateBinaryTreeProperties(result.properties);
 }
 
 void AlgorithmVisualizerMainWindow::redrawBinaryTree(QPainter& painter)
@@ -101,8 +130,7 @@ void AlgorithmVisualizerMainWindow::drawBinaryTreeNodeRec(const shared_ptr<Binar
         painter.drawLine(QPoint(location.x() + 15, location.y() + 15), QPoint(600 + 70 * node->getParent()->x + 15, location.y() - 45));
     }
 
-    painter.drawEllipse(location.x(), location.y(), 30, 30);
-    painter.drawText(location, QString::number(node->getValue()));
+    drawNodeCircle(location, node->getValue(), node->getColor(), painter);
 
     if(binaryTree->isNodeValid(node->getRight()))
     {
@@ -111,56 +139,168 @@ void AlgorithmVisualizerMainWindow::drawBinaryTreeNodeRec(const shared_ptr<Binar
     }
 }
 
-void AlgorithmVisualizerMainWindow::updateBinaryTreeProperties()
+void AlgorithmVisualizerMainWindow::drawNodeCircle(const QPointF &location, int value, const QColor &color, QPainter& painter) const
 {
-    // // clear layout
-    // while(auto* layoutItem = ui->propertiesVerticleBox->takeAt(0))
-    // {
-    //     if(auto* widget = layoutItem->widget())
-    //     {
-    //         widget->deleteLater();
-    //     }
-    // }
-
-    // ui->propertiesVerticleBox->setDirection(QBoxLayout::Direction::BottomToTop);
-    // ui->propertiesVerticleBox->addStretch(1);
-
-    // std::unordered_map<std::string, int> binaryTreeProperties;
-    // binaryTree->buildProperties(binaryTreeProperties);
-
-    // for(const auto& [propertyName, propertyValue] : binaryTreeProperties)
-    // {
-    //     QLabel* propertyLabel = new QLabel(QString(QString::fromStdString(propertyName) + "     :      %1").arg(propertyValue));
-    //     ui->propertiesVerticleBox->addWidget(propertyLabel);
-    //     ui->propertiesVerticleBox->setAlignment(propertyLabel, Qt::AlignmentFlag::AlignTop);
-    // }
-
-    // ui->binaryTreePropertiesBox->setLayout(ui->propertiesVerticleBox);
+    // Only red-black trees color their nodes red, every other node stays hollow
+    painter.setBrush(color == QColorConstants::Red ? QBrush(QColor(255, 170, 170)) : QBrush(Qt::NoBrush));
+    painter.drawEllipse(QRectF(location, QSizeF(30, 30)));
+    painter.drawText(location, QString::number(value));
 }
 
-std::unique_ptr<BinaryTreeBase<int>> AlgorithmVisualizerMainWindow::createTree(const QString &treeName)
+void AlgorithmVisualizerMainWindow::advanceAnimation()
+{
+    stepStartPositions = std::move(stepEndPositions);
+    if(!animation.hasNextStep() || !animation.applyNextStep())
+    {
+        stopAnimation();
+        return;
+    }
+
+    stepEndPositions = layoutAnimationTree();
+    animationStepTimer.start();
+}
+
+void AlgorithmVisualizerMainWindow::stopAnimation()
+{
+    isAnimating = false;
+    stepStartPositions.clear();
+    stepEndPositions.clear();
+}
+
+std::unordered_map<const void*, QPointF> AlgorithmVisualizerMainWindow::layoutAnimationTree()
+{
+    std::unordered_map<const void*, QPointF> positions;
+    const auto root = animation.getRoot();
+    if(!root)
+    {
+        return positions;
+    }
+
+    resetNodeLoc(root);
+    calculateInitialX(root);
+    calculateInitialXX(root);
+
+    // Same placement as drawBinaryTreeNode gives the tree itself
+    std::vector<std::pair<shared_ptr<TreeAnimation<int>::AnimationNode>, int>> pending = { { root, 0 } };
+    while(!pending.empty())
+    {
+        const auto [node, depth] = pending.back();
+        pending.pop_back();
+        positions[node->id] = QPointF(600 + 70 * node->x, 90 + 60 * depth);
+        for(const auto &child : { node->left, node->right })
+        {
+            if(child)
+            {
+                pending.emplace_back(child, depth + 1);
+            }
+        }
+    }
+    return positions;
+}
+
+void AlgorithmVisualizerMainWindow::drawAnimationFrame(QPainter& painter)
 {
-    if(treeName == "Binary Search Tree")
+    const double progress = std::min(1.0, animationStepTimer.elapsed() / static_cast<double>(animationStepMilliseconds));
+    const auto getLocation = [&](const void *id)
+    {
+        const QPointF end = stepEndPositions[id];
+        const auto startIt = stepStartPositions.find(id);
+        const QPointF start = startIt != stepStartPositions.end() ? startIt->second : end;
+        return start + (end - start) * progress;
+    };
+
+    // Edges first so that the nodes cover their ends
+    std::vector<shared_ptr<TreeAnimation<int>::AnimationNode>> nodes;
+    if(animation.getRoot())
+    {
+        nodes.push_back(animation.getRoot());
+    }
+    for(size_t i = 0; i < nodes.size(); i++)
+    {
+        for(const auto &child : { nodes[i]->left, nodes[i]->right })
+        {
+            if(child)
+            {
+                painter.drawLine(getLocation(child->id) + QPointF(15, 15), getLocation(nodes[i]->id) + QPointF(15, 15));
+                nodes.push_back(child);
+            }
+        }
+    }
+
+    for(const auto &node : nodes)
     {
-        return std::make_unique<BinarySearchTree<int>>();
+        drawNodeCircle(getLocation(node->id), node->getValue(), node->getColor(), painter);
     }
 
-    if(treeName == "AVL Tree")
+    if(progress >= 1.0)
     {
-        return std::make_unique<BalancedBinaryTree<int>>();
+        advanceAnimation();
     }
+}
 
-    if(treeName == "Red Black Tree")
+void AlgorithmVisualizerMainWindow::updateBinaryTreeProperties(const std::unordered_map<std::string, int> &binaryTreeProperties)
+{
+    // clear layout
+    while(auto* layoutItem = ui->propertiesVerticleBox->takeAt(0))
     {
-        return std::make_unique<RedBlackTree<int>>();
+        if(auto* widget = layoutItem->widget())
+        {
+            widget->deleteLater();
+        }
+        delete layoutItem;
     }
 
-    if(treeName == "Heap")
+    // keep a stable order between updates
+    const std::map<std::string, int> sortedProperties(binaryTreeProperties.begin(), binaryTreeProperties.end());
+    for(const auto& [propertyName, propertyValue] : sortedProperties)
     {
-        return std::make_unique<BinaryHeap<int>>();
+        QLabel* propertyLabel = new QLabel(QString(QString::fromStdString(propertyName) + "     :      %1").arg(propertyValue));
+        ui->propertiesVerticleBox->addWidget(propertyLabel);
     }
 
-    return nullptr;
+    ui->propertiesVerticleBox->addStretch(1);
+
+    updateLatencyProperties();
+}
+
+void AlgorithmVisualizerMainWindow::updateLatencyProperties()
+{
+    while(auto* layoutItem = ui->latencyVerticalBox->takeAt(0))
+    {
+        if(auto* widget = layoutItem->widget())
+        {
+            widget->deleteLater();
+        }
+        delete layoutItem;
+    }
+
+    for(int i = 0; i < static_cast<int>(LatencyOperation::Count); i++)
+    {
+        const auto operation = static_cast<LatencyOperation>(i);
+        const LatencySummary summary = latencyRecorder->getSummary(operation);
+        if(summary.count == 0)
+        {
+            continue;
+        }
+
+        QLabel* latencyLabel = new QLabel(QString("%1 (%2)\n  p50 %3 ns, p99 %4 ns\n  p99.9 %5 ns, max %6 ns")
+                                              .arg(QString::fromLatin1(getLatencyOperationName(operation))).arg(summary.count)
+                                              .arg(summary.p50).arg(summary.p99).arg(summary.p999).arg(summary.max));
+        ui->latencyVerticalBox->addWidget(latencyLabel);
+    }
+
+    ui->latencyVerticalBox->addStretch(1);
+}
+
+std::unique_ptr<BinaryTreeBase<int>> AlgorithmVisualizerMainWindow::createTree(const QString &treeName)
+{
+    auto tree = createBinaryTree<int>(treeName.toStdString());
+    if(tree)
+    {
+        latencyRecorder->reset();
+        tree->setLatencyRecorder(latencyRecorder.get());
+    }
+    return tree;
 }
 
 void AlgorithmVisualizerMainWindow::resetNodeLoc(shared_ptr<BinaryTreeBase<int>::BinaryTreeNode> node)
@@ -192,7 +332,8 @@ void AlgorithmVisualizerMainWindow::calculateInitialX(const shared_ptr<BinaryTre
     const auto left = binaryTree->isNodeValid(node->getParent()) ? node->getParent()->getLeft() : nullptr;
     const auto right = binaryTree->isNodeValid(node->getParent()) ? node->getParent()->getRight() : nullptr;
 
-    if(node == binaryTree->getRoot())
+    // Checked by parent rather than against the tree's root, so the animation copy lays out the same way
+    if(!binaryTree->isNodeValid(node->getParent()))
     {
         node->x = getMidpointOfChildren(node);
         return;
@@ -310,7 +451,20 @@ void AlgorithmVisualizerMainWindow::paintEvent(QPaintEvent *event)
     QPainter painter(this);
     painter.setPen(pen);
 
-    redrawBinaryTree(painter);
+    // The layout writes into the nodes, so the tree is only drawn between batches
+    const auto treeLock = mutationQueue->tryLockTree();
+    if(!treeLock.owns_lock())
+    {
+        painter.drawText(QPoint(20, 40), "Applying changes...");
+    }
+    else if(isAnimating)
+    {
+        drawAnimationFrame(painter);
+    }
+    else
+    {
+        redrawBinaryTree(painter);
+    }
     update();
 }
 
@@ -3,11 +3,15 @@
 #define ALGORITHMVISUALIZERMAINWINDOW_H
 
 #include "binarytreebase.h"
+#include "treeanimation.h"
+#include "treemutationqueue.h"
 
+#include <QElapsedTimer>
 #include <QLabel>
 #include <QMainWindow>
 #include <QPainter>
 #include <memory>
+#include <unordered_map>
 
 QT_BEGIN_NAMESPACE
 namespace Ui
@@ -35,13 +39,39 @@ private slots:
 private:
     Ui::AlgorithmVisualizerMainWindow *ui;
     std::unique_ptr<BinaryTreeBase<int>> binaryTree;
+    std::unique_ptr<LatencyRecorder> latencyRecorder;
+
+    // Every change to the tree goes through the queue, so the buttons never wait on a large tree.
+    // Declared after the tree so it is stopped first, results of a replaced tree are told apart by generation
+    std::unique_ptr<TreeMutationQueue<int>> mutationQueue;
+    int treeGeneration = 0;
+
+    // Step by step replay of the last add or remove, built from the deltas the tree recorded
+    TreeAnimation<int> animation;
+    bool isAnimating = false;
+    QElapsedTimer animationStepTimer;
+    std::unordered_map<const void*, QPointF> stepStartPositions;
+    std::unordered_map<const void*, QPointF> stepEndPositions;
+
+    static constexpr int animationStepMilliseconds = 400;
 
     void redrawBinaryTree(QPainter& painter);
     void drawBinaryTreeNode(const shared_ptr<BinaryTreeBase<int>::BinaryTreeNode> node, const QPoint &location, QPainter& painter);
 
     void drawBinaryTreeNodeRec(const shared_ptr<BinaryTreeBase<int>::BinaryTreeNode> node, const QPoint &location, QPainter& painter);
-
-    void updateBinaryTreeProperties();
+    void drawNodeCircle(const QPointF &location, int value, const QColor &color, QPainter& painter) const;
+
+    // Stops the queue of the current tree and starts an empty one named treeName
+    void resetTree(const QString &treeName);
+    // Runs on the GUI thread for every batch the queue applied
+    void applyBatchResult(int generation, const TreeMutationQueue<int>::BatchResult &result);
+    void advanceAnimation();
+    void stopAnimation();
+    std::unordered_map<const void*, QPointF> layoutAnimationTree();
+    void drawAnimationFrame(QPainter& painter);
+
+    void updateBinaryTreeProperties(const std::unordered_map<std::string, int> &binaryTreeProperties);
+    void updateLatencyProperties();
 
     std::unique_ptr<BinaryTreeBase<int>> createTree(const QString &treeName);
 
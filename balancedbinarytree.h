@@ -3,72 +3,236 @@
 
 #include "binarysearchtree.h"
 
-template <class ValueType>
-class BalancedBinaryTree : public BinarySearchTree<ValueType>
+template <class ValueType, class Compare = std::less<>, class Stats = DefaultTreeStatsCounter>
+class BalancedBinaryTree : public BinarySearchTree<ValueType, Compare, Stats>
 {
 public:
     BalancedBinaryTree() = default;
 
-    using BinaryTreeNode = typename BinaryTreeBase<ValueType>::BinaryTreeNode;
-    using BinarySearchTreeNode = typename BinarySearchTree<ValueType>::BinarySearchTreeNode;
+    using BinaryTreeNode = typename BinaryTreeBase<ValueType, Compare, Stats>::BinaryTreeNode;
+    using BinarySearchTreeNode = typename BinarySearchTree<ValueType, Compare, Stats>::BinarySearchTreeNode;
 
 protected:
+    virtual shared_ptr<BinaryTreeNode> removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, shared_ptr<BinaryTreeNode> &removedNode) override;
     virtual void postAddInternal(const shared_ptr<BinaryTreeNode> &newNode) override;
-    virtual void postRemoveInternal() override;
+    virtual void verifyNode(const shared_ptr<BinarySearchTreeNode> &node, const typename BinarySearchTree<ValueType, Compare, Stats>::SubtreeCheck &left
+                            , const typename BinarySearchTree<ValueType, Compare, Stats>::SubtreeCheck &right, typename BinarySearchTree<ValueType, Compare, Stats>::SubtreeCheck &outCheck) const override;
 
-    void fixRotations(const shared_ptr<BinaryTreeNode> &inRoot);
+    virtual void splitTree(const shared_ptr<BinarySearchTreeNode> &inRoot, const ValueType &key, shared_ptr<BinarySearchTreeNode> &outLeft, shared_ptr<BinarySearchTreeNode> &outRight) override;
+    virtual shared_ptr<BinarySearchTreeNode> joinTrees(const shared_ptr<BinarySearchTreeNode> &left, const shared_ptr<BinarySearchTreeNode> &right) override;
+
+    // Joins two trees and a key ordered between them, using the stored heights
+    shared_ptr<BinarySearchTreeNode> joinWithKey(const shared_ptr<BinarySearchTreeNode> &left, const shared_ptr<BinarySearchTreeNode> &key, const shared_ptr<BinarySearchTreeNode> &right);
+
+    // Retraces from node to the root, rotating wherever the stored heights differ by more than one
+    void rebalanceUpwards(shared_ptr<BinarySearchTreeNode> node);
+    void rebalanceNode(const shared_ptr<BinarySearchTreeNode> &node);
 };
 
-template <class ValueType>
-inline void BalancedBinaryTree<ValueType>::postAddInternal(const shared_ptr<BinaryTreeNode> &newNode)
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename BalancedBinaryTree<ValueType, Compare, Stats>::BinaryTreeNode> BalancedBinaryTree<ValueType, Compare, Stats>::removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, shared_ptr<BinaryTreeNode> &removedNode)
 {
-    this->fixRotations(this->template getNodeAs<BinarySearchTreeNode>(this->root));
+    // The lowest node whose subtree changes, the node spliced out for a two-child removal hangs deeper
+    shared_ptr<BinarySearchTreeNode> retraceNode;
+    const auto nodePtr = this->template getNodeAs<BinarySearchTreeNode>(this->getNodeForKey(value));
+    if (this->isNodeValid(nodePtr))
+    {
+        retraceNode = nodePtr->parent.lock();
+        if (this->isNodeValid(nodePtr->left) && this->isNodeValid(nodePtr->right))
+        {
+            const auto leftMax = this->template getNodeAs<BinarySearchTreeNode>(this->getMaxValuePtr(nodePtr->left));
+            retraceNode = leftMax == nodePtr->left ? leftMax : leftMax->parent.lock();
+        }
+    }
+
+    this->root = BinarySearchTree<ValueType, Compare, Stats>::removeInternal(value, inRoot, removedNode);
+    if (removedNode)
+    {
+        this->rebalanceUpwards(retraceNode);
+    }
+    return this->root;
 }
 
-template <class ValueType>
-inline void BalancedBinaryTree<ValueType>::postRemoveInternal()
+template <class ValueType, class Compare, class Stats>
+inline void BalancedBinaryTree<ValueType, Compare, Stats>::postAddInternal(const shared_ptr<BinaryTreeNode> &newNode)
 {
-    this->fixRotations(this->template getNodeAs<BinarySearchTreeNode>(this->root));
+    const auto binarySearchTreeNode = this->template getNodeAs<BinarySearchTreeNode>(newNode);
+    if (this->isNodeValid(binarySearchTreeNode))
+    {
+        this->rebalanceUpwards(binarySearchTreeNode->parent.lock());
+    }
 }
 
-template <class ValueType>
-inline void BalancedBinaryTree<ValueType>::fixRotations(const shared_ptr<BinaryTreeNode> &inRoot)
+// Every join costs the height difference of its inputs, the differences telescope to O(log n) for the whole split
+template <class ValueType, class Compare, class Stats>
+void BalancedBinaryTree<ValueType, Compare, Stats>::splitTree(const shared_ptr<BinarySearchTreeNode> &inRoot, const ValueType &key, shared_ptr<BinarySearchTreeNode> &outLeft, shared_ptr<BinarySearchTreeNode> &outRight)
 {
     if (!this->isNodeValid(inRoot))
     {
+        outLeft = this->getNilNode();
+        outRight = this->getNilNode();
         return;
     }
 
-    const auto binarySearchTreeNode = this->template getNodeAs<BinarySearchTreeNode>(inRoot);
-    this->fixRotations(binarySearchTreeNode->left);
+    const auto node = inRoot;
+    const auto left = node->left;
+    const auto right = node->right;
+    if (this->isNodeValid(left))
+    {
+        left->parent.reset();
+    }
+    if (this->isNodeValid(right))
+    {
+        right->parent.reset();
+    }
 
-    const int balanceFactor = this->getBalanceFactor(binarySearchTreeNode);
-    if (balanceFactor == 2)
+    shared_ptr<BinarySearchTreeNode> innerTree;
+    if (this->isLess(node->value, key))
+    {
+        this->splitTree(right, key, innerTree, outRight);
+        outLeft = this->joinWithKey(left, node, innerTree);
+    }
+    else
     {
-        if (this->getBalanceFactor(binarySearchTreeNode->right) >= -1)
+        this->splitTree(left, key, outLeft, innerTree);
+        outRight = this->joinWithKey(innerTree, node, right);
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename BalancedBinaryTree<ValueType, Compare, Stats>::BinarySearchTreeNode> BalancedBinaryTree<ValueType, Compare, Stats>::joinTrees(const shared_ptr<BinarySearchTreeNode> &left, const shared_ptr<BinarySearchTreeNode> &right)
+{
+    if (!this->isNodeValid(left))
+    {
+        return right;
+    }
+    if (!this->isNodeValid(right))
+    {
+        return left;
+    }
+
+    // The largest node of the left tree is spliced out and becomes the join key
+    auto key = left;
+    while (this->isNodeValid(key->right))
+    {
+        key = key->right;
+    }
+
+    this->root = left;
+    const auto keyParent = key->parent.lock();
+    this->replaceInParent(key, key->left);
+    this->rebalanceUpwards(keyParent);
+    const auto rest = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+
+    return this->joinWithKey(rest, key, right);
+}
+
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename BalancedBinaryTree<ValueType, Compare, Stats>::BinarySearchTreeNode> BalancedBinaryTree<ValueType, Compare, Stats>::joinWithKey(const shared_ptr<BinarySearchTreeNode> &left, const shared_ptr<BinarySearchTreeNode> &key, const shared_ptr<BinarySearchTreeNode> &right)
+{
+    key->parent.reset();
+    const int leftHeight = this->getSubtreeHeight(left);
+    const int rightHeight = this->getSubtreeHeight(right);
+    if (std::abs(leftHeight - rightHeight) <= 1)
+    {
+        key->left = left;
+        key->right = right;
+        if (this->isNodeValid(left))
         {
-            this->rightRotate(binarySearchTreeNode);
+            left->parent = key;
         }
-        else
+        if (this->isNodeValid(right))
         {
-            this->leftRotate(binarySearchTreeNode->left);
-            this->rightRotate(binarySearchTreeNode);
+            right->parent = key;
         }
+        this->updateSize(key);
+        return key;
+    }
+
+    // Hang the key over the first spine node of the taller tree at most one level above the shorter tree,
+    // the key is one level higher than that node, as after a plain add, and the retrace restores the balance
+    const bool isLeftTaller = leftHeight > rightHeight;
+    const int shorterHeight = isLeftTaller ? rightHeight : leftHeight;
+    auto node = isLeftTaller ? left : right;
+    shared_ptr<BinarySearchTreeNode> parent;
+    while (this->getSubtreeHeight(node) > shorterHeight + 1)
+    {
+        parent = node;
+        node = isLeftTaller ? node->right : node->left;
+    }
+
+    key->left = isLeftTaller ? node : left;
+    key->right = isLeftTaller ? right : node;
+    if (this->isNodeValid(key->left))
+    {
+        key->left->parent = key;
+    }
+    if (this->isNodeValid(key->right))
+    {
+        key->right->parent = key;
+    }
+    (isLeftTaller ? parent->right : parent->left) = key;
+    key->parent = parent;
+    this->updateSize(key);
+
+    this->root = isLeftTaller ? left : right;
+    this->rebalanceUpwards(parent);
+    return this->template getNodeAs<BinarySearchTreeNode>(this->root);
+}
+
+template <class ValueType, class Compare, class Stats>
+void BalancedBinaryTree<ValueType, Compare, Stats>::verifyNode(const shared_ptr<BinarySearchTreeNode> &node, const typename BinarySearchTree<ValueType, Compare, Stats>::SubtreeCheck &left
+                                                       , const typename BinarySearchTree<ValueType, Compare, Stats>::SubtreeCheck &right, typename BinarySearchTree<ValueType, Compare, Stats>::SubtreeCheck &outCheck) const
+{
+    BinarySearchTree<ValueType, Compare, Stats>::verifyNode(node, left, right, outCheck);
+    if (!outCheck.error.empty())
+    {
+        return;
     }
-    else if (balanceFactor == -2)
+
+    if (std::abs(left.height - right.height) > 1)
+    {
+        outCheck.error = "balance factor " + std::to_string(left.height - right.height);
+    }
+    else if (node->height != outCheck.height)
+    {
+        outCheck.error = "stored height " + std::to_string(node->height) + ", measured " + std::to_string(outCheck.height);
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+void BalancedBinaryTree<ValueType, Compare, Stats>::rebalanceUpwards(shared_ptr<BinarySearchTreeNode> node)
+{
+    while (this->isNodeValid(node))
     {
-        if (this->getBalanceFactor(binarySearchTreeNode->left) <= 0)
+        // Taken before rotating, a rotation moves node below its replacement
+        const auto parent = node->parent.lock();
+        this->updateSize(node);
+        this->rebalanceNode(node);
+        node = parent;
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void BalancedBinaryTree<ValueType, Compare, Stats>::rebalanceNode(const shared_ptr<BinarySearchTreeNode> &node)
+{
+    const int balanceFactor = this->getBalanceFactor(node);
+    if (balanceFactor > 1)
+    {
+        if (this->getBalanceFactor(node->left) < 0)
         {
-            this->leftRotate(binarySearchTreeNode);
+            this->leftRotate(node->left);
         }
-        else
+        this->rightRotate(node);
+    }
+    else if (balanceFactor < -1)
+    {
+        if (this->getBalanceFactor(node->right) > 0)
         {
-            this->rightRotate(binarySearchTreeNode->right);
-            this->leftRotate(binarySearchTreeNode);
+            this->rightRotate(node->right);
         }
+        this->leftRotate(node);
     }
-
-    this->fixRotations(binarySearchTreeNode->right);
 }
 
 #endif // BALANCEDBINARYTREE_H
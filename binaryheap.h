@@ -2,25 +2,27 @@
 #define HEAP_H
 
 #include "binarytreebase.h"
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
 #include <vector>
 
-// Min Heap
-template <class ValueType>
-class BinaryHeap : public BinaryTreeBase<ValueType>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Min Heap, ordered by Compare
+template <class ValueType, class Compare = std::less<>, class Stats = DefaultTreeStatsCounter>
+class BinaryHeap : public BinaryTreeBase<ValueType, Compare, Stats>
 {
 public:
     BinaryHeap() = default;
 
-    using BinaryTreeNode = typename BinaryTreeBase<ValueType>::BinaryTreeNode;
+    using BinaryTreeNode = typename BinaryTreeBase<ValueType, Compare, Stats>::BinaryTreeNode;
 
     struct BinaryHeapNode : public BinaryTreeNode
     {
-        BinaryHeapNode(const ValueType& value)
-            : BinaryTreeNode(value)
-        {
-            // temp !
-            priority = value;
-        }
+        using BinaryTreeNode::BinaryTreeNode;
 
         inline int getParentIndex() const { return index != 0 ? (index - 1) / 2 : -1; }
         inline int getLeftIndex() const { return 2 * index + 1; }
@@ -45,71 +47,177 @@ public:
         }
 
         int index = 0;
-        float priority = 0.f;
 
-        BinaryHeap* heap;
+        BinaryHeap* heap = nullptr;
     };
 
-    ValueType extractMin();
+    // Top-K streaming mode: a full heap keeps the capacity greatest values under Compare,
+    // a candidate not above the root is rejected in O(1) and an accepted one replaces the root in place
+    void setBoundedCapacity(size_t capacity);
+    size_t getBoundedCapacity() const { return boundedCapacity; }
+
+    // Return the number of accepted values
+    template <class InputIt>
+    size_t pushMany(InputIt first, InputIt last);
+    size_t pushMany(const ValueType *values, size_t count);
+
+    // Empties the heap, the values come out ordered by Compare
+    std::vector<ValueType> drain();
 
-    void updateValue(const ValueType& oldValue, const ValueType& newValue);
+    virtual bool allowsDuplicates() const override { return true; }
 
 protected:
     virtual shared_ptr<BinaryTreeNode> addInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, const shared_ptr<BinaryTreeNode> &removed, shared_ptr<BinaryTreeNode> &newNode) override;
-    virtual shared_ptr<BinaryTreeNode> removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, bool &removed) override;
-    virtual shared_ptr<BinaryTreeNode> createNode(const ValueType &value) const override;
+    virtual shared_ptr<BinaryTreeNode> removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, shared_ptr<BinaryTreeNode> &removedNode) override;
+    virtual shared_ptr<BinaryTreeNode> createNode(ValueType &&value) const override;
+    virtual void initNode(const shared_ptr<BinaryTreeNode> &node) const override;
+    virtual bool canAdoptNode(const shared_ptr<BinaryTreeNode> &node) const override;
     virtual shared_ptr<BinaryTreeNode> getMaxValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const override;
     virtual shared_ptr<BinaryTreeNode> getMinValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const override;
+    virtual int removeRangeInternal(const ValueType &low, const ValueType &high, std::vector<ValueType> *outValues) override;
+    virtual std::string verifyInternal(unsigned threadsCount) const override;
+    virtual void memoryUsageInternal(MemoryUsage &outUsage) const override;
 
     virtual void postAddInternal(const shared_ptr<BinaryTreeNode> &newNode) override;
+    virtual shared_ptr<BinaryTreeNode> getNodeForValue(const ValueType &value) const override;
+
+    virtual ValueType extractMinInternal() override;
+    virtual void updateValueInternal(const ValueType& oldValue, const ValueType& newValue) override;
 
     void shiftUp(const shared_ptr<BinaryHeapNode> &inRoot);
     void shiftDown(const shared_ptr<BinaryHeapNode> &inRoot);
 
     void swap(const shared_ptr<BinaryHeapNode> &x, const shared_ptr<BinaryHeapNode> &y);
 
+    bool hasHigherPriority(const shared_ptr<BinaryHeapNode> &x, const shared_ptr<BinaryHeapNode> &y) const;
+
+    bool isAtCapacity() const { return boundedCapacity != 0 && nodes.size() >= boundedCapacity; }
+
 protected:
     std::vector<shared_ptr<BinaryHeapNode>> nodes;
+
+    size_t boundedCapacity = 0;
 };
 
-template<class ValueType>
-ValueType BinaryHeap<ValueType>::extractMin()
+template <class ValueType, class Compare, class Stats>
+void BinaryHeap<ValueType, Compare, Stats>::setBoundedCapacity(size_t capacity)
 {
-    if(nodes.empty())
+    boundedCapacity = capacity;
+    while(boundedCapacity != 0 && nodes.size() > boundedCapacity)
     {
-        return ValueType{};
+        extractMinInternal();
     }
+}
 
-    if(nodes.size() == 1)
+template <class ValueType, class Compare, class Stats> template <class InputIt>
+size_t BinaryHeap<ValueType, Compare, Stats>::pushMany(InputIt first, InputIt last)
+{
+    size_t acceptedCount = 0;
+    for(; first != last; ++first)
     {
-        return nodes[0];
+        if(isAtCapacity() && !this->isLess(nodes[0]->value, *first))
+        {
+            continue;
+        }
+        acceptedCount += this->add(*first) ? 1 : 0;
     }
+    return acceptedCount;
+}
 
-    std::swap(nodes[0], nodes[nodes.size() - 1]);
-
-    const auto last = nodes.back();
-    nodes.pop_back();
+template <class ValueType, class Compare, class Stats>
+size_t BinaryHeap<ValueType, Compare, Stats>::pushMany(const ValueType *values, size_t count)
+{
+    size_t index = 0;
+    size_t acceptedCount = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    // Int streams are filtered four at a time against the root, most blocks never reach the heap
+    constexpr bool isAscending = std::is_same_v<Compare, std::less<>> || std::is_same_v<Compare, std::less<ValueType>>;
+    constexpr bool isDescending = std::is_same_v<Compare, std::greater<>> || std::is_same_v<Compare, std::greater<ValueType>>;
+    if constexpr (std::is_same_v<ValueType, int32_t> && (isAscending || isDescending))
+    {
+        for(; index < count && !isAtCapacity(); index++)
+        {
+            acceptedCount += this->add(values[index]) ? 1 : 0;
+        }
 
-    shiftDown(nodes[0]);
+        if(boundedCapacity != 0)
+        {
+            for(; index + 4 <= count; index += 4)
+            {
+                const __m128i candidates = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + index));
+                const __m128i threshold = _mm_set1_epi32(nodes[0]->value);
+                const __m128i accepted = isAscending ? _mm_cmpgt_epi32(candidates, threshold) : _mm_cmplt_epi32(candidates, threshold);
+                if(_mm_movemask_epi8(accepted) != 0)
+                {
+                    acceptedCount += pushMany(values + index, values + index + 4);
+                }
+            }
+        }
+    }
+#endif
 
-    return last;
+    return acceptedCount + pushMany(values + index, values + count);
 }
 
-template<class ValueType>
-void BinaryHeap<ValueType>::updateValue(const ValueType &oldValue, const ValueType &newValue)
+template <class ValueType, class Compare, class Stats>
+std::vector<ValueType> BinaryHeap<ValueType, Compare, Stats>::drain()
 {
-    const auto oldValueIt = std::find_if(nodes.begin(), nodes.end(), [&oldValue](const shared_ptr<BinaryHeapNode>& heapNode)
+    std::vector<ValueType> values;
+    values.reserve(nodes.size());
+    for(const auto &node : nodes)
+    {
+        values.push_back(std::move(node->value));
+    }
+
+    nodes.clear();
+    this->root = nullptr;
+
+    std::sort(values.begin(), values.end(), [this](const ValueType &left, const ValueType &right)
     {
-        return heapNode->value == oldValue;
+        return this->isLess(left, right);
     });
+    return values;
+}
 
-    if(oldValueIt != nodes.end())
+template <class ValueType, class Compare, class Stats>
+ValueType BinaryHeap<ValueType, Compare, Stats>::extractMinInternal()
+{
+    if(nodes.empty())
+    {
+        return ValueType{};
+    }
+
+    const auto minNode = nodes[0];
+    swap(nodes[0], nodes.back());
+    nodes.pop_back();
+    this->recordDelta(TreeDeltaType::Detach, minNode);
+
+    if(nodes.empty())
+    {
+        this->root = nullptr;
+    }
+    else
+    {
+        // Copy the pointer, sifting moves other nodes into slot 0
+        const auto newRoot = nodes[0];
+        shiftDown(newRoot);
+    }
+
+    return std::move(minNode->value);
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinaryHeap<ValueType, Compare, Stats>::updateValueInternal(const ValueType &oldValue, const ValueType &newValue)
+{
+    const auto oldValuePtr = this->template getNodeAs<BinaryHeapNode>(getNodeForValue(oldValue));
+    if(oldValuePtr)
     {
-        const auto oldValuePtr = *oldValueIt;
         oldValuePtr->value = newValue;
+        this->recordDelta(TreeDeltaType::SetValue, oldValuePtr);
 
-        const auto parentPtr = oldValuePtr->getParent();
-        if(parentPtr && newValue < parentPtr->value)
+        const auto parentPtr = this->template getNodeAs<BinaryHeapNode>(oldValuePtr->getParent());
+        if(parentPtr && hasHigherPriority(oldValuePtr, parentPtr))
         {
             shiftUp(oldValuePtr);
         }
@@ -120,43 +228,236 @@ void BinaryHeap<ValueType>::updateValue(const ValueType &oldValue, const ValueTy
     }
 }
 
-template <class ValueType>
-shared_ptr<typename BinaryHeap<ValueType>::BinaryTreeNode> BinaryHeap<ValueType>::addInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, const shared_ptr<BinaryTreeNode> &parent, shared_ptr<BinaryTreeNode> &newNode)
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename BinaryHeap<ValueType, Compare, Stats>::BinaryTreeNode> BinaryHeap<ValueType, Compare, Stats>::addInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, const shared_ptr<BinaryTreeNode> &parent, shared_ptr<BinaryTreeNode> &newNode)
 {
-    const auto heapNodePtr = this->template getNodeAs<BinaryHeapNode>(this->createNode(value));
+    if(isAtCapacity())
+    {
+        if(!this->isLess(nodes[0]->value, value))
+        {
+            newNode = nullptr;
+            return inRoot;
+        }
+
+        // Reuse the root node, a prepared node is dropped
+        const auto rootNode = nodes[0];
+        if(newNode)
+        {
+            rootNode->value = std::move(newNode->value);
+        }
+        else
+        {
+            rootNode->value = value;
+        }
+        this->recordDelta(TreeDeltaType::SetValue, rootNode);
+        shiftDown(rootNode);
+
+        newNode = rootNode;
+        return nodes[0];
+    }
+
+    if(!newNode)
+    {
+        newNode = this->createNodeFor(value);
+    }
+
+    const auto heapNodePtr = this->template getNodeAs<BinaryHeapNode>(newNode);
     heapNodePtr->index = nodes.size();
     heapNodePtr->heap = this;
     nodes.push_back(heapNodePtr);
-    newNode = heapNodePtr;
+    if(this->deltaBuffer)
+    {
+        this->recordDelta(TreeDeltaType::Attach, heapNodePtr, heapNodePtr->getParent(), heapNodePtr->index % 2 == 1);
+    }
     return nodes[0];
 }
 
-template <class ValueType>
-shared_ptr<typename BinaryHeap<ValueType>::BinaryTreeNode> BinaryHeap<ValueType>::removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, bool &removed)
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename BinaryHeap<ValueType, Compare, Stats>::BinaryTreeNode> BinaryHeap<ValueType, Compare, Stats>::removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, shared_ptr<BinaryTreeNode> &removedNode)
 {
+    const auto removedPtr = this->template getNodeAs<BinaryHeapNode>(getNodeForValue(value));
+    removedNode = removedPtr;
+    if(!removedPtr)
+    {
+        return inRoot;
+    }
+
+    // Move the last node into the hole and restore the heap around it
+    const auto lastPtr = nodes.back();
+    swap(removedPtr, lastPtr);
+    nodes.pop_back();
+    this->recordDelta(TreeDeltaType::Detach, removedPtr);
+
+    if(nodes.empty())
+    {
+        return nullptr;
+    }
+
+    if(lastPtr != removedPtr)
+    {
+        const auto parentPtr = this->template getNodeAs<BinaryHeapNode>(lastPtr->getParent());
+        if(parentPtr && hasHigherPriority(lastPtr, parentPtr))
+        {
+            shiftUp(lastPtr);
+        }
+        else
+        {
+            shiftDown(lastPtr);
+        }
+    }
+
     return nodes[0];
 }
 
-template<class ValueType>
-inline shared_ptr<typename BinaryHeap<ValueType>::BinaryTreeNode> BinaryHeap<ValueType>::createNode(const ValueType &value) const
+template <class ValueType, class Compare, class Stats>
+int BinaryHeap<ValueType, Compare, Stats>::removeRangeInternal(const ValueType &low, const ValueType &high, std::vector<ValueType> *outValues)
+{
+    const auto removedBegin = std::partition(nodes.begin(), nodes.end(), [this, &low, &high](const shared_ptr<BinaryHeapNode> &heapNode)
+    {
+        return this->isLess(heapNode->value, low) || !this->isLess(heapNode->value, high);
+    });
+
+    const int removedCount = static_cast<int>(nodes.end() - removedBegin);
+    if(removedCount == 0)
+    {
+        return 0;
+    }
+
+    if(outValues)
+    {
+        for(auto nodeIt = removedBegin; nodeIt != nodes.end(); ++nodeIt)
+        {
+            outValues->push_back(std::move((*nodeIt)->value));
+        }
+        std::sort(outValues->begin(), outValues->end(), [this](const ValueType &left, const ValueType &right)
+        {
+            return this->isLess(left, right);
+        });
+    }
+    nodes.erase(removedBegin, nodes.end());
+
+    // Rebuild the heap bottom up, linear in the nodes left
+    for(size_t i = 0; i < nodes.size(); i++)
+    {
+        nodes[i]->index = static_cast<int>(i);
+    }
+    for(size_t i = nodes.size() / 2; i-- > 0;)
+    {
+        const auto heapNode = nodes[i];
+        shiftDown(heapNode);
+    }
+
+    this->root = nodes.empty() ? nullptr : nodes[0];
+    return removedCount;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename BinaryHeap<ValueType, Compare, Stats>::BinaryTreeNode> BinaryHeap<ValueType, Compare, Stats>::createNode(ValueType &&value) const
 {
-    return std::make_shared<BinaryHeapNode>(value);
+    this->stats.addAllocation();
+    return std::make_shared<BinaryHeapNode>(std::move(value));
 }
 
-template<class ValueType>
-inline shared_ptr<typename BinaryHeap<ValueType>::BinaryTreeNode> BinaryHeap<ValueType>::getMaxValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const
+template <class ValueType, class Compare, class Stats>
+inline void BinaryHeap<ValueType, Compare, Stats>::initNode(const shared_ptr<BinaryTreeNode> &node) const
 {
-    return nodes[0];
+    const auto heapNode = this->template getNodeAs<BinaryHeapNode>(node);
+    heapNode->index = 0;
+    heapNode->heap = nullptr;
 }
 
-template<class ValueType>
-inline shared_ptr<typename BinaryHeap<ValueType>::BinaryTreeNode> BinaryHeap<ValueType>::getMinValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryHeap<ValueType, Compare, Stats>::canAdoptNode(const shared_ptr<BinaryTreeNode> &node) const
 {
-    return nodes[0];
+    return this->template getNodeAs<BinaryHeapNode>(node) != nullptr;
 }
 
-template<class ValueType>
-inline void BinaryHeap<ValueType>::postAddInternal(const shared_ptr<BinaryTreeNode> &newNode)
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename BinaryHeap<ValueType, Compare, Stats>::BinaryTreeNode> BinaryHeap<ValueType, Compare, Stats>::getMaxValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const
+{
+    if(nodes.empty())
+    {
+        return nullptr;
+    }
+
+    // The maximum of a min heap is one of the leaves
+    auto maxNode = nodes[nodes.size() / 2];
+    for(size_t i = nodes.size() / 2 + 1; i < nodes.size(); i++)
+    {
+        if(hasHigherPriority(maxNode, nodes[i]))
+        {
+            maxNode = nodes[i];
+        }
+    }
+    return maxNode;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename BinaryHeap<ValueType, Compare, Stats>::BinaryTreeNode> BinaryHeap<ValueType, Compare, Stats>::getMinValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const
+{
+    return nodes.empty() ? nullptr : nodes[0];
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinaryHeap<ValueType, Compare, Stats>::memoryUsageInternal(MemoryUsage &outUsage) const
+{
+    outUsage.keysCount += nodes.size();
+    outUsage.addSharedNodes<BinaryHeapNode>(nodes.size());
+    outUsage.addArray(nodes.size() * sizeof(nodes[0]), nodes.capacity() * sizeof(nodes[0]));
+}
+
+template <class ValueType, class Compare, class Stats>
+std::string BinaryHeap<ValueType, Compare, Stats>::verifyInternal(unsigned threadsCount) const
+{
+    if (this->root != (nodes.empty() ? nullptr : nodes[0]))
+    {
+        return "root is not the first node";
+    }
+    if (boundedCapacity != 0 && nodes.size() > boundedCapacity)
+    {
+        return "size " + std::to_string(nodes.size()) + " over the bounded capacity";
+    }
+
+    // Every chunk checks its nodes against their parents, only the lowest failing index is reported
+    std::mutex errorMutex;
+    size_t errorIndex = nodes.size();
+    std::string error;
+    parallelFor(nodes.size(), threadsCount, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            const auto &node = nodes[i];
+            std::string nodeError;
+            if (!node)
+            {
+                nodeError = "missing node";
+            }
+            else if (node->index != static_cast<int>(i) || node->heap != this)
+            {
+                nodeError = "node index " + std::to_string(node->index) + " or owner broken";
+            }
+            else if (i != 0 && nodes[node->getParentIndex()] && this->compare(node->value, nodes[node->getParentIndex()]->value))
+            {
+                nodeError = "heap order broken";
+            }
+
+            if (!nodeError.empty())
+            {
+                const std::lock_guard<std::mutex> lock(errorMutex);
+                if (i < errorIndex)
+                {
+                    errorIndex = i;
+                    error = nodeError + " at index " + std::to_string(i);
+                }
+                return;
+            }
+        }
+    });
+    return error;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void BinaryHeap<ValueType, Compare, Stats>::postAddInternal(const shared_ptr<BinaryTreeNode> &newNode)
 {
     if(newNode)
     {
@@ -164,11 +465,21 @@ inline void BinaryHeap<ValueType>::postAddInternal(const shared_ptr<BinaryTreeNo
     }
 }
 
-template<class ValueType>
-inline void BinaryHeap<ValueType>::shiftUp(const shared_ptr<BinaryHeapNode> &inRoot)
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename BinaryHeap<ValueType, Compare, Stats>::BinaryTreeNode> BinaryHeap<ValueType, Compare, Stats>::getNodeForValue(const ValueType &value) const
+{
+    const auto valueIt = std::find_if(nodes.begin(), nodes.end(), [this, &value](const shared_ptr<BinaryHeapNode>& heapNode)
+    {
+        return this->isEquivalent(heapNode->value, value);
+    });
+    return valueIt != nodes.end() ? *valueIt : nullptr;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void BinaryHeap<ValueType, Compare, Stats>::shiftUp(const shared_ptr<BinaryHeapNode> &inRoot)
 {
     auto parent = this->template getNodeAs<BinaryHeapNode>(inRoot->getParent());
-    while(parent && parent->priority > inRoot->priority)
+    while(parent && hasHigherPriority(inRoot, parent))
     {
         swap(inRoot, parent);
         parent = this->template getNodeAs<BinaryHeapNode>(inRoot->getParent());
@@ -177,13 +488,13 @@ inline void BinaryHeap<ValueType>::shiftUp(const shared_ptr<BinaryHeapNode> &inR
     this->root = nodes[0];
 }
 
-template<class ValueType>
-inline void BinaryHeap<ValueType>::shiftDown(const shared_ptr<BinaryHeapNode> &inRoot)
+template <class ValueType, class Compare, class Stats>
+inline void BinaryHeap<ValueType, Compare, Stats>::shiftDown(const shared_ptr<BinaryHeapNode> &inRoot)
 {
     auto leftChild = this->template getNodeAs<BinaryHeapNode>(inRoot->getLeft());
     auto rightChild = this->template getNodeAs<BinaryHeapNode>(inRoot->getRight());
-    while((leftChild && leftChild->priority < inRoot->priority)
-           || (rightChild && rightChild->priority < inRoot->priority))
+    while((leftChild && hasHigherPriority(leftChild, inRoot))
+           || (rightChild && hasHigherPriority(rightChild, inRoot)))
     {
         if(leftChild && !rightChild)
         {
@@ -195,7 +506,7 @@ inline void BinaryHeap<ValueType>::shiftDown(const shared_ptr<BinaryHeapNode> &i
         }
         else
         {
-            const auto smallest = leftChild->priority > rightChild->priority ? rightChild : leftChild;
+            const auto smallest = hasHigherPriority(rightChild, leftChild) ? rightChild : leftChild;
             swap(inRoot, smallest);
         }
 
@@ -206,11 +517,19 @@ inline void BinaryHeap<ValueType>::shiftDown(const shared_ptr<BinaryHeapNode> &i
     this->root = nodes[0];
 }
 
-template<class ValueType>
-inline void BinaryHeap<ValueType>::swap(const shared_ptr<BinaryHeapNode> &x, const shared_ptr<BinaryHeapNode> &y)
+template <class ValueType, class Compare, class Stats>
+inline void BinaryHeap<ValueType, Compare, Stats>::swap(const shared_ptr<BinaryHeapNode> &x, const shared_ptr<BinaryHeapNode> &y)
 {
+    this->stats.addSwap();
+    this->recordDelta(TreeDeltaType::Swap, x, y);
     std::swap(nodes[x->index], nodes[y->index]);
     std::swap(x->index, y->index);
 }
 
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryHeap<ValueType, Compare, Stats>::hasHigherPriority(const shared_ptr<BinaryHeapNode> &x, const shared_ptr<BinaryHeapNode> &y) const
+{
+    return this->isLess(x->value, y->value);
+}
+
 #endif // HEAP_H
@@ -1,19 +1,21 @@
 #ifndef BINARYSEARCHTREE_H
 #define BINARYSEARCHTREE_H
 
+#include <vector>
+
 #include "binarytreebase.h"
+#include "bloomfilter.h"
+#include "parallelutils.h"
 
-template <class ValueType>
-class BinarySearchTree : public BinaryTreeBase<ValueType>
+template <class ValueType, class Compare = std::less<>, class Stats = DefaultTreeStatsCounter>
+class BinarySearchTree : public BinaryTreeBase<ValueType, Compare, Stats>
 {
 public:
-    using BinaryTreeNode = typename BinaryTreeBase<ValueType>::BinaryTreeNode;
+    using BinaryTreeNode = typename BinaryTreeBase<ValueType, Compare, Stats>::BinaryTreeNode;
 
     struct BinarySearchTreeNode : public BinaryTreeNode
     {
-        BinarySearchTreeNode(const ValueType &value)
-            : BinaryTreeNode(value)
-        {}
+        using BinaryTreeNode::BinaryTreeNode;
 
         virtual shared_ptr<BinaryTreeNode> getParent() const override { return parent.lock(); }
         virtual shared_ptr<BinaryTreeNode> getLeft() const override { return left; }
@@ -22,152 +24,714 @@ public:
         weak_ptr<BinarySearchTreeNode> parent;
         shared_ptr<BinarySearchTreeNode> left;
         shared_ptr<BinarySearchTreeNode> right;
+
+        // Occurrences of the value in multiset mode (0 marks a lazily deleted node), and the occurrences in the whole subtree
+        int count = 1;
+        int size = 1;
+        // Nodes on the longest path down from this one, itself included. Rotations leave the ancestors stale,
+        // only the AVL tree retraces up to the root and relies on it
+        int height = 1;
     };
 
+    using BinaryTreeBase<ValueType, Compare, Stats>::contains;
+
+    // Heterogeneous lookup, e.g. std::string keys by std::string_view, with a transparent Compare
+    template <class KeyType, class KeyCompare = Compare, class = typename KeyCompare::is_transparent>
+    bool contains(const KeyType &key) const;
+    // Keeps a mutable lookup by another key type off the mutable contains, it searches without adjusting the tree
+    template <class KeyType, class KeyCompare = Compare, class = typename KeyCompare::is_transparent>
+    bool contains(const KeyType &key) { return std::as_const(*this).contains(key); }
+
+    // Equal values bump the count of the existing node instead of being rejected, remove drops one occurrence
+    void setMultiset(bool enabled) { multiset = enabled; }
+    bool isMultiset() const { return multiset; }
+    virtual bool allowsDuplicates() const override { return multiset; }
+
+    int count(const ValueType &value) const;
+    // Number of stored occurrences ordered before value
+    int rank(const ValueType &value) const;
+    int getSize() const;
+
+    // Calls visit with every stored occurrence in [low, high) in order, without changing the tree. A null bound is open
+    template <class Function>
+    void forEachInRange(const ValueType *low, const ValueType *high, Function visit) const;
+
+    // Remove only marks the node as a tombstone, tombstones are dropped together by one linear rebuild
+    // once they make up more than the compaction fraction of the stored values
+    void setLazyDelete(bool enabled);
+    bool isLazyDelete() const { return lazyDelete; }
+    void setCompactionFraction(double fraction) { compactionFraction = fraction; }
+    int getTombstonesCount() const { return tombstonesCount; }
+    void compact();
+
+    // Optional filter in front of lookups, a miss it rules out never walks the tree. Values the comparator treats
+    // as equal must hash equal. About ten bits per stored value keep the false positive rate near one percent
+    void setBloomFilter(std::size_t bitsCount);
+    bool hasBloomFilter() const { return bloomFilter.isEnabled(); }
+
+    // Adds start from the last added node and climb only as far as the new value needs,
+    // so nearly sorted input pays for the distance to the previous value instead of the whole depth
+    void setFingerInsertion(bool enabled);
+    bool isFingerInsertion() const { return fingerInsertion; }
+
+    // Adds every value at once: a parallel stable sort, then the nodes are created and linked into a balanced
+    // shape on up to threadsCount threads. Ends with the same contents as adding the values one by one
+    void bulkAdd(std::vector<ValueType> values, unsigned threadsCount = getDefaultThreadsCount());
+
 protected:
     virtual shared_ptr<BinaryTreeNode> addInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, const shared_ptr<BinaryTreeNode> &removed, shared_ptr<BinaryTreeNode> &newNode) override;
-    virtual shared_ptr<BinaryTreeNode> removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, bool &removed) override;
-    virtual shared_ptr<BinaryTreeNode> createNode(const ValueType &value) const override;
+    virtual shared_ptr<BinaryTreeNode> removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, shared_ptr<BinaryTreeNode> &removedNode) override;
+    virtual shared_ptr<BinaryTreeNode> createNode(ValueType &&value) const override;
+    virtual void initNode(const shared_ptr<BinaryTreeNode> &node) const override;
+    virtual void postRemoveInternal() override;
+    virtual bool canAdoptNode(const shared_ptr<BinaryTreeNode> &node) const override;
     virtual shared_ptr<BinaryTreeNode> getMaxValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const override;
     virtual shared_ptr<BinaryTreeNode> getMinValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const override;
+    virtual int removeRangeInternal(const ValueType &low, const ValueType &high, std::vector<ValueType> *outValues) override;
+    virtual std::string verifyInternal(unsigned threadsCount) const override;
+    virtual void memoryUsageInternal(MemoryUsage &outUsage) const override;
 
     virtual shared_ptr<BinaryTreeNode> getNodeForValue(const ValueType &value) const override;
-    shared_ptr<BinaryTreeNode> getNodeForValueInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot) const;
+    virtual bool removeOccurrence(const ValueType &value) override;
+    virtual ValueType extractMinInternal() override;
+    virtual void addValuesInternal(std::vector<ValueType> &&values) override;
+    template <class KeyType>
+    shared_ptr<BinaryTreeNode> getNodeForKey(const KeyType &key) const;
+
+    shared_ptr<BinaryTreeNode> addFromFinger(const ValueType &value, const shared_ptr<BinarySearchTreeNode> &fingerNode, shared_ptr<BinaryTreeNode> &newNode);
+    void mergeOccurrence(const shared_ptr<BinarySearchTreeNode> &node, const ValueType &value, shared_ptr<BinaryTreeNode> &newNode);
 
     void rightRotate(const shared_ptr<BinarySearchTreeNode> &inRoot);
     void leftRotate(const shared_ptr<BinarySearchTreeNode> &inRoot);
 
     int getBalanceFactor(const shared_ptr<BinarySearchTreeNode> &inRoot);
     void transplant(const shared_ptr<BinarySearchTreeNode> &u, const shared_ptr<BinarySearchTreeNode> &v);
+    // transplant without a delta, for the rotations that record themselves
+    void replaceInParent(const shared_ptr<BinarySearchTreeNode> &u, const shared_ptr<BinarySearchTreeNode> &v);
+
+    int getSubtreeSize(const shared_ptr<BinarySearchTreeNode> &inRoot) const;
+    int getSubtreeHeight(const shared_ptr<BinarySearchTreeNode> &inRoot) const;
+    // Refreshes the size and height of a node from its children
+    void updateSize(const shared_ptr<BinarySearchTreeNode> &inRoot) const;
+    void updateSizesUpwards(shared_ptr<BinarySearchTreeNode> node) const;
+
+    // The empty child and empty root of this tree type
+    virtual shared_ptr<BinarySearchTreeNode> getNilNode() const { return nullptr; }
+
+    shared_ptr<BinarySearchTreeNode> getFirstLiveNode() const;
+    void collectLiveNodes(shared_ptr<BinarySearchTreeNode> inRoot, std::vector<shared_ptr<BinarySearchTreeNode>> &outLiveNodes, const shared_ptr<BinarySearchTreeNode> &nilNode);
+
+    // Replaces the tree with sorted, detached nodes linked into a perfectly balanced shape
+    void buildBalanced(const std::vector<shared_ptr<BinarySearchTreeNode>> &sortedNodes, unsigned threadsCount = 1);
+    // Subtrees above forkDepth link their left half on another thread
+    const shared_ptr<BinarySearchTreeNode>& linkBalanced(const std::vector<shared_ptr<BinarySearchTreeNode>> &sortedNodes, size_t begin, size_t end, int depth, int height
+                                                         , const shared_ptr<BinarySearchTreeNode> &nilNode, int forkDepth = 0);
+    void collectLiveValues(const shared_ptr<BinarySearchTreeNode> &inRoot, std::vector<ValueType> &outValues) const;
+    template <class Function>
+    void visitSubtree(const shared_ptr<BinarySearchTreeNode> &inRoot, const ValueType *low, const ValueType *high, Function &visit) const;
+
+    // What a verified subtree reports to its parent, error holds the first violation below it
+    struct SubtreeCheck
+    {
+        int size = 0;
+        int height = 0;
+        int blackHeight = 0;
+        int tombstonesCount = 0;
+        std::string error;
+    };
+
+    // Values must lie strictly between low and high, a null bound is open. Comparisons skip the stats counters,
+    // which are not safe to share between threads
+    SubtreeCheck verifySubtree(const shared_ptr<BinarySearchTreeNode> &inRoot, const shared_ptr<BinarySearchTreeNode> &parent
+                               , const ValueType *low, const ValueType *high, int depth, int forkDepth) const;
+    // Checks one node against its verified children and fills in its own check
+    virtual void verifyNode(const shared_ptr<BinarySearchTreeNode> &node, const SubtreeCheck &left, const SubtreeCheck &right, SubtreeCheck &outCheck) const;
+    virtual void colorBuiltNode(const shared_ptr<BinarySearchTreeNode> &node, int depth, int height) { node->color = QColorConstants::Black; }
+
+    // Moves everything ordered before key into outLeft and the rest into outRight, both detached trees
+    virtual void splitTree(const shared_ptr<BinarySearchTreeNode> &inRoot, const ValueType &key, shared_ptr<BinarySearchTreeNode> &outLeft, shared_ptr<BinarySearchTreeNode> &outRight);
+    // Joins two detached trees, every value of left ordered before right
+    virtual shared_ptr<BinarySearchTreeNode> joinTrees(const shared_ptr<BinarySearchTreeNode> &left, const shared_ptr<BinarySearchTreeNode> &right);
+    int releaseSubtree(shared_ptr<BinarySearchTreeNode> inRoot, std::vector<ValueType> *outValues, const shared_ptr<BinarySearchTreeNode> &nilNode);
+
+    std::uint64_t getBloomHash(const ValueType &value) const;
+    void addToBloomFilter(const ValueType &value);
+    bool isRuledOutByBloomFilter(const ValueType &value) const;
+    // Removed values keep their bits, the filter is refilled once they outnumber the stored ones
+    void refreshBloomFilter();
+    void rebuildBloomFilter();
+    void fillBloomFilter(const shared_ptr<BinarySearchTreeNode> &inRoot);
+
+protected:
+    bool multiset = false;
+
+    bool lazyDelete = false;
+    double compactionFraction = 0.5;
+    int tombstonesCount = 0;
+
+    BlockedBloomFilter bloomFilter;
+    int bloomInsertedCount = 0;
+
+    bool fingerInsertion = false;
+    weak_ptr<BinarySearchTreeNode> finger;
 };
 
-template <class ValueType>
-shared_ptr<typename BinarySearchTree<ValueType>::BinaryTreeNode> BinarySearchTree<ValueType>::addInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename BinarySearchTree<ValueType, Compare, Stats>::BinaryTreeNode> BinarySearchTree<ValueType, Compare, Stats>::addInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot
                                                                                                           , const shared_ptr<BinaryTreeNode> &parent, shared_ptr<BinaryTreeNode> &newNode)
 {
+    // Only the outermost call, made with the whole tree, may start from the finger
+    if(fingerInsertion && !parent && this->isNodeValid(inRoot))
+    {
+        if(const auto fingerNode = finger.lock())
+        {
+            const auto result = this->addFromFinger(value, fingerNode, newNode);
+            if(newNode)
+            {
+                finger = this->template getNodeAs<BinarySearchTreeNode>(newNode);
+            }
+            return result;
+        }
+    }
+
     if(!this->isNodeValid(inRoot))
     {
-        const auto newNodePtr = this->template getNodeAs<BinarySearchTreeNode>(this->createNode(value));
+        if(!newNode)
+        {
+            newNode = this->createNodeFor(value);
+        }
+        // The value may have been moved into the node, only the node's copy is read from here on
+        const auto newNodePtr = this->template getNodeAs<BinarySearchTreeNode>(newNode);
         newNodePtr->parent = this->template getNodeAs<BinarySearchTreeNode>(parent);
-        newNode = newNodePtr;
+        this->addToBloomFilter(newNodePtr->value);
+        if (this->deltaBuffer)
+        {
+            // The side costs a comparison, left out of the stats like the rest of the recording
+            this->recordDelta(TreeDeltaType::Attach, newNode, parent, parent && this->compare(newNodePtr->value, parent->value));
+        }
         return newNode;
     }
 
     const auto binarySearchTreeRoot = this->template getNodeAs<BinarySearchTreeNode>(inRoot);
-    if(binarySearchTreeRoot->value < value)
+    if(this->isLess(binarySearchTreeRoot->value, value))
     {
         binarySearchTreeRoot->right = this->template getNodeAs<BinarySearchTreeNode>(addInternal(value, binarySearchTreeRoot->right, inRoot, newNode));
     }
-    else if (binarySearchTreeRoot->value > value)
+    else if (this->isLess(value, binarySearchTreeRoot->value))
     {
         binarySearchTreeRoot->left = this->template getNodeAs<BinarySearchTreeNode>(addInternal(value, binarySearchTreeRoot->left, inRoot, newNode));
     }
     else
     {
-        newNode = nullptr;
+        this->mergeOccurrence(binarySearchTreeRoot, value, newNode);
     }
 
+    this->updateSize(binarySearchTreeRoot);
+    if(fingerInsertion && !parent && newNode)
+    {
+        finger = this->template getNodeAs<BinarySearchTreeNode>(newNode);
+    }
     return binarySearchTreeRoot;
 }
 
-template <class ValueType>
-shared_ptr<typename BinarySearchTree<ValueType>::BinaryTreeNode> BinarySearchTree<ValueType>::removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, bool &removed)
+template <class ValueType, class Compare, class Stats>
+void BinarySearchTree<ValueType, Compare, Stats>::mergeOccurrence(const shared_ptr<BinarySearchTreeNode> &node, const ValueType &value, shared_ptr<BinaryTreeNode> &newNode)
+{
+    if (!multiset && node->count > 0)
+    {
+        newNode = nullptr;
+        return;
+    }
+
+    // A tombstone comes back to life with the new value
+    if (node->count == 0)
+    {
+        node->value = value;
+        tombstonesCount--;
+        this->recordDelta(TreeDeltaType::SetValue, node);
+    }
+
+    // A prepared node is dropped, its occurrence is merged into the existing one
+    node->count++;
+    newNode = node;
+    this->addToBloomFilter(value);
+}
+
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename BinarySearchTree<ValueType, Compare, Stats>::BinaryTreeNode> BinarySearchTree<ValueType, Compare, Stats>::addFromFinger(const ValueType &value, const shared_ptr<BinarySearchTreeNode> &fingerNode
+                                                                                                              , shared_ptr<BinaryTreeNode> &newNode)
+{
+    // Climb while the value lies beyond the subtree holding the finger. Only ancestors entered from the far side
+    // bound that subtree, so they are the only ones compared, and the descent starts below the first one past the value
+    const bool goesRight = this->isLess(fingerNode->value, value);
+    const bool goesLeft = !goesRight && this->isLess(value, fingerNode->value);
+    auto start = fingerNode;
+    auto node = fingerNode;
+    auto parent = node->parent.lock();
+    while ((goesRight || goesLeft) && parent)
+    {
+        if (goesRight && parent->left == node)
+        {
+            if (this->isLess(value, parent->value))
+            {
+                break;
+            }
+            start = parent;
+            if (!this->isLess(parent->value, value))
+            {
+                break;
+            }
+        }
+        else if (goesLeft && parent->right == node)
+        {
+            if (this->isLess(parent->value, value))
+            {
+                break;
+            }
+            start = parent;
+            if (!this->isLess(value, parent->value))
+            {
+                break;
+            }
+        }
+
+        node = parent;
+        parent = node->parent.lock();
+    }
+
+    node = start;
+    while (true)
+    {
+        const bool isRight = this->isLess(node->value, value);
+        if (!isRight && !this->isLess(value, node->value))
+        {
+            this->mergeOccurrence(node, value, newNode);
+            break;
+        }
+
+        auto &child = isRight ? node->right : node->left;
+        if (this->isNodeValid(child))
+        {
+            node = child;
+            continue;
+        }
+
+        if (!newNode)
+        {
+            newNode = this->createNodeFor(value);
+        }
+        child = this->template getNodeAs<BinarySearchTreeNode>(newNode);
+        child->parent = node;
+        this->addToBloomFilter(child->value);
+        this->recordDelta(TreeDeltaType::Attach, child, node, !isRight);
+        break;
+    }
+
+    // Sizes still change on every level up to the root, but that walk follows parent links without comparisons
+    this->updateSizesUpwards(node);
+    return this->root;
+}
+
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename BinarySearchTree<ValueType, Compare, Stats>::BinaryTreeNode> BinarySearchTree<ValueType, Compare, Stats>::removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, shared_ptr<BinaryTreeNode> &removedNode)
 {
     if (!this->isNodeValid(inRoot))
     {
-        removed = false;
+        removedNode = nullptr;
         return inRoot;
     }
 
     const auto binarySearchTreeRoot = this->template getNodeAs<BinarySearchTreeNode>(inRoot);
-    if (binarySearchTreeRoot->value < value)
+    if (this->isLess(binarySearchTreeRoot->value, value))
     {
-        binarySearchTreeRoot->right = this->template getNodeAs<BinarySearchTreeNode>(removeInternal(value, binarySearchTreeRoot->right, removed));
+        binarySearchTreeRoot->right = this->template getNodeAs<BinarySearchTreeNode>(BinarySearchTree::removeInternal(value, binarySearchTreeRoot->right, removedNode));
+        this->updateSize(binarySearchTreeRoot);
+        return binarySearchTreeRoot;
     }
-    else if (binarySearchTreeRoot->value > value)
+
+    if (this->isLess(value, binarySearchTreeRoot->value))
     {
-        binarySearchTreeRoot->left = this->template getNodeAs<BinarySearchTreeNode>(removeInternal(value, binarySearchTreeRoot->left, removed));
+        binarySearchTreeRoot->left = this->template getNodeAs<BinarySearchTreeNode>(BinarySearchTree::removeInternal(value, binarySearchTreeRoot->left, removedNode));
+        this->updateSize(binarySearchTreeRoot);
+        return binarySearchTreeRoot;
     }
-    else
+
+    // Tombstones only leave the tree through compaction
+    if (binarySearchTreeRoot->count == 0)
     {
-        removed = true;
+        removedNode = nullptr;
+        return binarySearchTreeRoot;
     }
 
+    removedNode = binarySearchTreeRoot;
+
+    // The caller links the returned subtree, the deltas describe that as a transplant
     // Node with only right child or no child
     if (!this->isNodeValid(binarySearchTreeRoot->left))
     {
+        if (this->isNodeValid(binarySearchTreeRoot->right))
+        {
+            binarySearchTreeRoot->right->parent = binarySearchTreeRoot->parent;
+        }
+        this->recordDelta(TreeDeltaType::Transplant, binarySearchTreeRoot, binarySearchTreeRoot->right);
         return binarySearchTreeRoot->right;
     }
 
     // Node with only left child
     if (!this->isNodeValid(binarySearchTreeRoot->right))
     {
+        binarySearchTreeRoot->left->parent = binarySearchTreeRoot->parent;
+        this->recordDelta(TreeDeltaType::Transplant, binarySearchTreeRoot, binarySearchTreeRoot->left);
         return binarySearchTreeRoot->left;
     }
 
-    // Node with 2 children
+    // Node with 2 children, relink the left subtree maximum in its place
     const auto leftMax = this->template getNodeAs<BinarySearchTreeNode>(this->getMaxValuePtr(binarySearchTreeRoot->left));
-    binarySearchTreeRoot->value = leftMax->value;
-    this->transplant(leftMax, nullptr);
+    if (leftMax != binarySearchTreeRoot->left)
+    {
+        const auto leftMaxParent = leftMax->parent.lock();
+        this->transplant(leftMax, leftMax->left);
+        leftMax->left = binarySearchTreeRoot->left;
+        leftMax->left->parent = leftMax;
+        this->recordDelta(TreeDeltaType::Link, leftMax, leftMax->left, true);
 
-    return binarySearchTreeRoot;
+        // The path leftMax was taken from now hangs below it
+        for (auto node = leftMaxParent; node != leftMax; node = node->parent.lock())
+        {
+            this->updateSize(node);
+        }
+    }
+
+    leftMax->right = binarySearchTreeRoot->right;
+    leftMax->right->parent = leftMax;
+    leftMax->parent = binarySearchTreeRoot->parent;
+    this->updateSize(leftMax);
+    this->recordDelta(TreeDeltaType::Link, leftMax, leftMax->right, false);
+    this->recordDelta(TreeDeltaType::Transplant, binarySearchTreeRoot, leftMax);
+
+    return leftMax;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename BinaryTreeBase<ValueType, Compare, Stats>::BinaryTreeNode> BinarySearchTree<ValueType, Compare, Stats>::createNode(ValueType &&value) const
+{
+    this->stats.addAllocation();
+    const auto newNode = std::make_shared<BinarySearchTreeNode>(std::move(value));
+    initNode(newNode);
+    return newNode;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void BinarySearchTree<ValueType, Compare, Stats>::initNode(const shared_ptr<BinaryTreeNode> &node) const
+{
+    const auto binarySearchTreeNode = this->template getNodeAs<BinarySearchTreeNode>(node);
+    binarySearchTreeNode->parent.reset();
+    binarySearchTreeNode->left = nullptr;
+    binarySearchTreeNode->right = nullptr;
+    binarySearchTreeNode->count = 1;
+    binarySearchTreeNode->size = 1;
+    binarySearchTreeNode->height = 1;
+    binarySearchTreeNode->color = QColorConstants::Black;
 }
 
-template<class ValueType>
-inline shared_ptr<typename BinaryTreeBase<ValueType>::BinaryTreeNode> BinarySearchTree<ValueType>::createNode(const ValueType &value) const
+template <class ValueType, class Compare, class Stats>
+inline void BinarySearchTree<ValueType, Compare, Stats>::postRemoveInternal()
 {
-    return std::make_shared<BinarySearchTreeNode>(value);
+    finger.reset();
+    this->refreshBloomFilter();
 }
 
-template<class ValueType>
-inline shared_ptr<typename BinaryTreeBase<ValueType>::BinaryTreeNode> BinarySearchTree<ValueType>::getMaxValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const
+template <class ValueType, class Compare, class Stats>
+inline void BinarySearchTree<ValueType, Compare, Stats>::setFingerInsertion(bool enabled)
+{
+    fingerInsertion = enabled;
+    finger.reset();
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool BinarySearchTree<ValueType, Compare, Stats>::canAdoptNode(const shared_ptr<BinaryTreeNode> &node) const
+{
+    return this->template getNodeAs<BinarySearchTreeNode>(node) != nullptr;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename BinaryTreeBase<ValueType, Compare, Stats>::BinaryTreeNode> BinarySearchTree<ValueType, Compare, Stats>::getMaxValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const
 {
     const auto binarySearchTreeRoot = this->template getNodeAs<BinarySearchTreeNode>(inRoot);
     return this->isNodeValid(binarySearchTreeRoot) && this->isNodeValid(binarySearchTreeRoot->right) ? getMaxValuePtr(binarySearchTreeRoot->right) : binarySearchTreeRoot;
 }
 
-template<class ValueType>
-inline shared_ptr<typename BinaryTreeBase<ValueType>::BinaryTreeNode> BinarySearchTree<ValueType>::getMinValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename BinaryTreeBase<ValueType, Compare, Stats>::BinaryTreeNode> BinarySearchTree<ValueType, Compare, Stats>::getMinValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const
 {
     const auto binarySearchTreeRoot = this->template getNodeAs<BinarySearchTreeNode>(inRoot);
     return this->isNodeValid(binarySearchTreeRoot) && this->isNodeValid(binarySearchTreeRoot->left) ? getMinValuePtr(binarySearchTreeRoot->left) : binarySearchTreeRoot;
 }
 
-template <class ValueType>
-inline shared_ptr<typename BinaryTreeBase<ValueType>::BinaryTreeNode> BinarySearchTree<ValueType>::getNodeForValue(const ValueType &value) const
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename BinaryTreeBase<ValueType, Compare, Stats>::BinaryTreeNode> BinarySearchTree<ValueType, Compare, Stats>::getNodeForValue(const ValueType &value) const
+{
+    if (this->isRuledOutByBloomFilter(value))
+    {
+        return nullptr;
+    }
+
+    const auto node = getNodeForKey(value);
+    if (!node && bloomFilter.isEnabled())
+    {
+        this->stats.addBloomFalsePositive();
+    }
+    return node;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool BinarySearchTree<ValueType, Compare, Stats>::removeOccurrence(const ValueType &value)
+{
+    if (!multiset && !lazyDelete)
+    {
+        return false;
+    }
+
+    const auto node = this->template getNodeAs<BinarySearchTreeNode>(getNodeForKey(value));
+    if (!this->isNodeValid(node) || (node->count < 2 && !lazyDelete))
+    {
+        return false;
+    }
+
+    node->count--;
+
+    // Every subtree on the search path holds the occurrence, fixing them top down avoids locking parent links
+    const auto rootNode = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+    const shared_ptr<BinarySearchTreeNode> *pathNode = &rootNode;
+    while (*pathNode != node)
+    {
+        (*pathNode)->size--;
+        pathNode = this->isLess((*pathNode)->value, value) ? &(*pathNode)->right : &(*pathNode)->left;
+    }
+    node->size--;
+
+    if (node->count == 0)
+    {
+        tombstonesCount++;
+        if (tombstonesCount > compactionFraction * (this->getSize() + tombstonesCount))
+        {
+            this->compact();
+        }
+    }
+
+    this->refreshBloomFilter();
+    return true;
+}
+
+template <class ValueType, class Compare, class Stats>
+ValueType BinarySearchTree<ValueType, Compare, Stats>::extractMinInternal()
+{
+    if (tombstonesCount == 0)
+    {
+        return BinaryTreeBase<ValueType, Compare, Stats>::extractMinInternal();
+    }
+
+    const auto minNode = this->getFirstLiveNode();
+    if (!this->isNodeValid(minNode))
+    {
+        return ValueType{};
+    }
+
+    // The node stays linked as a tombstone and keeps its key, so the value is copied out
+    ValueType minValue = minNode->value;
+    this->removeOccurrence(minValue);
+    return minValue;
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinarySearchTree<ValueType, Compare, Stats>::setLazyDelete(bool enabled)
+{
+    lazyDelete = enabled;
+    if (!lazyDelete && tombstonesCount > 0)
+    {
+        this->compact();
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinarySearchTree<ValueType, Compare, Stats>::compact()
+{
+    std::vector<shared_ptr<BinarySearchTreeNode>> liveNodes;
+    liveNodes.reserve(this->getSize());
+
+    auto rootNode = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+    this->root = this->getNilNode();
+    this->collectLiveNodes(std::move(rootNode), liveNodes, this->getNilNode());
+
+    tombstonesCount = 0;
+    finger.reset();
+    this->buildBalanced(liveNodes);
+    this->rebuildBloomFilter();
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinarySearchTree<ValueType, Compare, Stats>::setBloomFilter(std::size_t bitsCount)
+{
+    static_assert(std::is_default_constructible_v<std::hash<ValueType>>, "the Bloom filter needs a std::hash specialization for the value type");
+    bloomFilter.reset(bitsCount);
+    this->rebuildBloomFilter();
+}
+
+template <class ValueType, class Compare, class Stats>
+inline std::uint64_t BinarySearchTree<ValueType, Compare, Stats>::getBloomHash(const ValueType &value) const
+{
+    // Value types without std::hash compile, setBloomFilter refuses to enable the filter for them
+    if constexpr (std::is_default_constructible_v<std::hash<ValueType>>)
+    {
+        return std::hash<ValueType>{}(value);
+    }
+    return 0;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void BinarySearchTree<ValueType, Compare, Stats>::addToBloomFilter(const ValueType &value)
+{
+    if (bloomFilter.isEnabled())
+    {
+        bloomFilter.insert(this->getBloomHash(value));
+        bloomInsertedCount++;
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool BinarySearchTree<ValueType, Compare, Stats>::isRuledOutByBloomFilter(const ValueType &value) const
 {
-    return getNodeForValueInternal(value, this->root);
+    if (!bloomFilter.isEnabled() || bloomFilter.mayContain(this->getBloomHash(value)))
+    {
+        return false;
+    }
+
+    this->stats.addBloomNegative();
+    return true;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void BinarySearchTree<ValueType, Compare, Stats>::refreshBloomFilter()
+{
+    if (bloomFilter.isEnabled() && bloomInsertedCount > 2 * this->getSize())
+    {
+        this->rebuildBloomFilter();
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinarySearchTree<ValueType, Compare, Stats>::rebuildBloomFilter()
+{
+    bloomInsertedCount = 0;
+    if (bloomFilter.isEnabled())
+    {
+        bloomFilter.clear();
+        this->fillBloomFilter(this->template getNodeAs<BinarySearchTreeNode>(this->root));
+    }
 }
 
-template <class ValueType>
-inline shared_ptr<typename BinaryTreeBase<ValueType>::BinaryTreeNode> BinarySearchTree<ValueType>::getNodeForValueInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot) const
+template <class ValueType, class Compare, class Stats>
+void BinarySearchTree<ValueType, Compare, Stats>::fillBloomFilter(const shared_ptr<BinarySearchTreeNode> &inRoot)
 {
     if (!this->isNodeValid(inRoot))
     {
-        return inRoot;
+        return;
     }
 
-    if (inRoot->value < value)
+    this->fillBloomFilter(inRoot->left);
+    if (inRoot->count > 0)
+    {
+        bloomFilter.insert(this->getBloomHash(inRoot->value));
+        bloomInsertedCount += inRoot->count;
+    }
+    this->fillBloomFilter(inRoot->right);
+}
+
+template <class ValueType, class Compare, class Stats>
+inline int BinarySearchTree<ValueType, Compare, Stats>::count(const ValueType &value) const
+{
+    const ScopedLatency latency(this->latencyRecorder, LatencyOperation::Lookup);
+    const auto node = this->template getNodeAs<BinarySearchTreeNode>(getNodeForKey(value));
+    return this->isNodeValid(node) ? node->count : 0;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline int BinarySearchTree<ValueType, Compare, Stats>::rank(const ValueType &value) const
+{
+    const ScopedLatency latency(this->latencyRecorder, LatencyOperation::Lookup);
+    int rank = 0;
+    auto node = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+    while (this->isNodeValid(node))
     {
-        return getNodeForValueInternal(value, this->template getNodeAs<BinarySearchTreeNode>(inRoot)->right);
+        if (this->isLess(node->value, value))
+        {
+            rank += this->getSubtreeSize(node->left) + node->count;
+            node = node->right;
+        }
+        else
+        {
+            node = node->left;
+        }
     }
 
-    if (inRoot->value > value)
+    return rank;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline int BinarySearchTree<ValueType, Compare, Stats>::getSize() const
+{
+    return this->getSubtreeSize(this->template getNodeAs<BinarySearchTreeNode>(this->root));
+}
+
+template <class ValueType, class Compare, class Stats> template <class Function>
+inline void BinarySearchTree<ValueType, Compare, Stats>::forEachInRange(const ValueType *low, const ValueType *high, Function visit) const
+{
+    this->visitSubtree(this->template getNodeAs<BinarySearchTreeNode>(this->root), low, high, visit);
+}
+
+template <class ValueType, class Compare, class Stats> template <class KeyType, class KeyCompare, class>
+inline bool BinarySearchTree<ValueType, Compare, Stats>::contains(const KeyType &key) const
+{
+    const ScopedLatency latency(this->latencyRecorder, LatencyOperation::Lookup);
+    return this->isNodeValid(getNodeForKey(key));
+}
+
+template <class ValueType, class Compare, class Stats> template <class KeyType>
+inline shared_ptr<typename BinaryTreeBase<ValueType, Compare, Stats>::BinaryTreeNode> BinarySearchTree<ValueType, Compare, Stats>::getNodeForKey(const KeyType &key) const
+{
+    // Walks the links by reference, copying a shared_ptr per level would cost two atomic operations
+    const auto rootNode = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+    const auto nilNode = this->getNilNode();
+    const shared_ptr<BinarySearchTreeNode> *node = &rootNode;
+    while (*node && *node != nilNode)
     {
-        return getNodeForValueInternal(value, this->template getNodeAs<BinarySearchTreeNode>(inRoot)->left);
+        if (this->isLess((*node)->value, key))
+        {
+            node = &(*node)->right;
+        }
+        else if (this->isLess(key, (*node)->value))
+        {
+            node = &(*node)->left;
+        }
+        else
+        {
+            return (*node)->count > 0 ? *node : nullptr;
+        }
     }
 
-    return inRoot;
+    return nullptr;
 }
 
-template <class ValueType>
-inline void BinarySearchTree<ValueType>::rightRotate(const shared_ptr<BinarySearchTreeNode> &inRoot)
+template <class ValueType, class Compare, class Stats>
+inline void BinarySearchTree<ValueType, Compare, Stats>::rightRotate(const shared_ptr<BinarySearchTreeNode> &inRoot)
 {
-    const auto oldRoot = this->template getNodeAs<BinarySearchTreeNode>(inRoot);
+    const auto oldRoot = inRoot;
     const auto newRoot = oldRoot->left;
+    this->stats.addRotation();
+    this->recordDelta(TreeDeltaType::RightRotate, oldRoot);
     oldRoot->left = newRoot->right;
     newRoot->right = oldRoot;
-    this->transplant(oldRoot, newRoot);
+    this->replaceInParent(oldRoot, newRoot);
 
     // update parent
     oldRoot->parent = newRoot;
@@ -175,16 +739,21 @@ inline void BinarySearchTree<ValueType>::rightRotate(const shared_ptr<BinarySear
     {
         oldRoot->left->parent = oldRoot;
     }
+
+    this->updateSize(oldRoot);
+    this->updateSize(newRoot);
 }
 
-template <class ValueType>
-inline void BinarySearchTree<ValueType>::leftRotate(const shared_ptr<BinarySearchTreeNode> &inRoot)
+template <class ValueType, class Compare, class Stats>
+inline void BinarySearchTree<ValueType, Compare, Stats>::leftRotate(const shared_ptr<BinarySearchTreeNode> &inRoot)
 {
-    const auto oldRoot = this->template getNodeAs<BinarySearchTreeNode>(inRoot);
+    const auto oldRoot = inRoot;
     const auto newRoot = oldRoot->right;
+    this->stats.addRotation();
+    this->recordDelta(TreeDeltaType::LeftRotate, oldRoot);
     oldRoot->right = newRoot->left;
     newRoot->left = oldRoot;
-    this->transplant(oldRoot, newRoot);
+    this->replaceInParent(oldRoot, newRoot);
 
     // update parent
     oldRoot->parent = newRoot;
@@ -192,19 +761,28 @@ inline void BinarySearchTree<ValueType>::leftRotate(const shared_ptr<BinarySearc
     {
         oldRoot->right->parent = oldRoot;
     }
+
+    this->updateSize(oldRoot);
+    this->updateSize(newRoot);
 }
 
-template <class ValueType>
-inline int BinarySearchTree<ValueType>::getBalanceFactor(const shared_ptr<BinarySearchTreeNode> &inRoot)
+template <class ValueType, class Compare, class Stats>
+inline int BinarySearchTree<ValueType, Compare, Stats>::getBalanceFactor(const shared_ptr<BinarySearchTreeNode> &inRoot)
 {
-    const auto binarySearchTreeRoot = this->template getNodeAs<BinarySearchTreeNode>(inRoot);
-    return this->isNodeValid(binarySearchTreeRoot) ? this->getHeight(binarySearchTreeRoot->left) - this->getHeight(binarySearchTreeRoot->right) : -1;
+    return this->isNodeValid(inRoot) ? this->getSubtreeHeight(inRoot->left) - this->getSubtreeHeight(inRoot->right) : -1;
 }
 
-template<class ValueType>
-inline void BinarySearchTree<ValueType>::transplant(const shared_ptr<BinarySearchTreeNode> &u, const shared_ptr<BinarySearchTreeNode> &v)
+template <class ValueType, class Compare, class Stats>
+inline void BinarySearchTree<ValueType, Compare, Stats>::transplant(const shared_ptr<BinarySearchTreeNode> &u, const shared_ptr<BinarySearchTreeNode> &v)
 {
-    const auto parent = this->template getNodeAs<BinarySearchTreeNode>(u->getParent());
+    this->recordDelta(TreeDeltaType::Transplant, u, v);
+    this->replaceInParent(u, v);
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void BinarySearchTree<ValueType, Compare, Stats>::replaceInParent(const shared_ptr<BinarySearchTreeNode> &u, const shared_ptr<BinarySearchTreeNode> &v)
+{
+    const auto parent = u->parent.lock();
     if (!parent)
     {
         this->root = v;
@@ -224,4 +802,464 @@ inline void BinarySearchTree<ValueType>::transplant(const shared_ptr<BinarySearc
     }
 }
 
+template <class ValueType, class Compare, class Stats>
+inline int BinarySearchTree<ValueType, Compare, Stats>::getSubtreeSize(const shared_ptr<BinarySearchTreeNode> &inRoot) const
+{
+    return this->isNodeValid(inRoot) ? inRoot->size : 0;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline int BinarySearchTree<ValueType, Compare, Stats>::getSubtreeHeight(const shared_ptr<BinarySearchTreeNode> &inRoot) const
+{
+    return this->isNodeValid(inRoot) ? inRoot->height : 0;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void BinarySearchTree<ValueType, Compare, Stats>::updateSize(const shared_ptr<BinarySearchTreeNode> &inRoot) const
+{
+    inRoot->size = inRoot->count + this->getSubtreeSize(inRoot->left) + this->getSubtreeSize(inRoot->right);
+    inRoot->height = 1 + std::max(this->getSubtreeHeight(inRoot->left), this->getSubtreeHeight(inRoot->right));
+}
+
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename BinarySearchTree<ValueType, Compare, Stats>::BinarySearchTreeNode> BinarySearchTree<ValueType, Compare, Stats>::getFirstLiveNode() const
+{
+    // Subtree sizes leave tombstones out, so an empty left subtree holds no live node
+    auto node = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+    while (this->isNodeValid(node))
+    {
+        if (this->getSubtreeSize(node->left) > 0)
+        {
+            node = node->left;
+        }
+        else if (node->count > 0)
+        {
+            return node;
+        }
+        else
+        {
+            node = node->right;
+        }
+    }
+
+    return nullptr;
+}
+
+template <class ValueType, class Compare, class Stats>
+int BinarySearchTree<ValueType, Compare, Stats>::removeRangeInternal(const ValueType &low, const ValueType &high, std::vector<ValueType> *outValues)
+{
+    if (!this->isLess(low, high))
+    {
+        return 0;
+    }
+
+    // Cut the range out with two splits and glue the outer parts back together
+    const auto rootNode = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+    this->root = this->getNilNode();
+
+    shared_ptr<BinarySearchTreeNode> left, rest, range, right;
+    this->splitTree(rootNode, low, left, rest);
+    this->splitTree(rest, high, range, right);
+    this->root = this->joinTrees(left, right);
+
+    const int removedCount = this->releaseSubtree(std::move(range), outValues, this->getNilNode());
+    this->postRemoveInternal();
+    return removedCount;
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinarySearchTree<ValueType, Compare, Stats>::splitTree(const shared_ptr<BinarySearchTreeNode> &inRoot, const ValueType &key, shared_ptr<BinarySearchTreeNode> &outLeft, shared_ptr<BinarySearchTreeNode> &outRight)
+{
+    if (!this->isNodeValid(inRoot))
+    {
+        outLeft = this->getNilNode();
+        outRight = this->getNilNode();
+        return;
+    }
+
+    const auto node = inRoot;
+    node->parent.reset();
+
+    shared_ptr<BinarySearchTreeNode> innerLeft, innerRight;
+    if (this->isLess(node->value, key))
+    {
+        this->splitTree(node->right, key, innerLeft, innerRight);
+        node->right = innerLeft;
+        if (this->isNodeValid(innerLeft))
+        {
+            innerLeft->parent = node;
+        }
+        outLeft = node;
+        outRight = innerRight;
+    }
+    else
+    {
+        this->splitTree(node->left, key, innerLeft, innerRight);
+        node->left = innerRight;
+        if (this->isNodeValid(innerRight))
+        {
+            innerRight->parent = node;
+        }
+        outLeft = innerLeft;
+        outRight = node;
+    }
+
+    this->updateSize(node);
+}
+
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename BinarySearchTree<ValueType, Compare, Stats>::BinarySearchTreeNode> BinarySearchTree<ValueType, Compare, Stats>::joinTrees(const shared_ptr<BinarySearchTreeNode> &left, const shared_ptr<BinarySearchTreeNode> &right)
+{
+    if (!this->isNodeValid(left))
+    {
+        return right;
+    }
+    if (!this->isNodeValid(right))
+    {
+        return left;
+    }
+
+    // The largest node of the left tree becomes the root
+    auto maxNode = left;
+    while (this->isNodeValid(maxNode->right))
+    {
+        maxNode = maxNode->right;
+    }
+
+    if (maxNode != left)
+    {
+        const auto maxParent = maxNode->parent.lock();
+        maxParent->right = maxNode->left;
+        if (this->isNodeValid(maxNode->left))
+        {
+            maxNode->left->parent = maxParent;
+        }
+        this->updateSizesUpwards(maxParent);
+
+        maxNode->left = left;
+        left->parent = maxNode;
+    }
+
+    maxNode->right = right;
+    right->parent = maxNode;
+    maxNode->parent.reset();
+    this->updateSize(maxNode);
+    return maxNode;
+}
+
+template <class ValueType, class Compare, class Stats>
+int BinarySearchTree<ValueType, Compare, Stats>::releaseSubtree(shared_ptr<BinarySearchTreeNode> inRoot, std::vector<ValueType> *outValues, const shared_ptr<BinarySearchTreeNode> &nilNode)
+{
+    if (!inRoot || inRoot == nilNode)
+    {
+        return 0;
+    }
+
+    // Detached in order, so every node is freed as soon as it is visited
+    int releasedCount = this->releaseSubtree(std::move(inRoot->left), outValues, nilNode);
+    auto right = std::move(inRoot->right);
+
+    if (inRoot->count == 0)
+    {
+        tombstonesCount--;
+    }
+    else if (outValues)
+    {
+        for (int i = 1; i < inRoot->count; i++)
+        {
+            outValues->push_back(inRoot->value);
+        }
+        outValues->push_back(std::move(inRoot->value));
+    }
+    releasedCount += inRoot->count;
+    inRoot = nullptr;
+
+    return releasedCount + this->releaseSubtree(std::move(right), outValues, nilNode);
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinarySearchTree<ValueType, Compare, Stats>::collectLiveNodes(shared_ptr<BinarySearchTreeNode> inRoot, std::vector<shared_ptr<BinarySearchTreeNode>> &outLiveNodes, const shared_ptr<BinarySearchTreeNode> &nilNode)
+{
+    if (!inRoot || inRoot == nilNode)
+    {
+        return;
+    }
+
+    // Moving the links out detaches every node on the way, so a dropped tombstone frees only itself
+    this->collectLiveNodes(std::move(inRoot->left), outLiveNodes, nilNode);
+    auto right = std::move(inRoot->right);
+    if (inRoot->count > 0)
+    {
+        outLiveNodes.push_back(std::move(inRoot));
+    }
+    this->collectLiveNodes(std::move(right), outLiveNodes, nilNode);
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinarySearchTree<ValueType, Compare, Stats>::bulkAdd(std::vector<ValueType> values, unsigned threadsCount)
+{
+    for (const ValueType &value : values)
+    {
+        this->recordOperation(OperationType::Add, value);
+    }
+
+    // Stored values go first, so with the stable sort they win over equal new ones like they would against add
+    if (this->isNodeValid(this->root))
+    {
+        std::vector<ValueType> storedValues;
+        storedValues.reserve(this->getSize() + values.size());
+        this->collectLiveValues(this->template getNodeAs<BinarySearchTreeNode>(this->root), storedValues);
+        storedValues.insert(storedValues.end(), std::make_move_iterator(values.begin()), std::make_move_iterator(values.end()));
+        values = std::move(storedValues);
+    }
+
+    // Comparisons go straight to compare, the stats counters are not safe to share between threads
+    const Compare &valueCompare = this->compare;
+    parallelStableSort(values.begin(), values.end(), [&valueCompare](const ValueType &left, const ValueType &right)
+    {
+        return valueCompare(left, right);
+    }, threadsCount);
+
+    // Every run of equal values becomes one node, counted in multiset mode
+    std::vector<size_t> runStarts;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        if (i == 0 || valueCompare(values[i - 1], values[i]))
+        {
+            runStarts.push_back(i);
+        }
+    }
+    runStarts.push_back(values.size());
+
+    std::vector<shared_ptr<BinarySearchTreeNode>> sortedNodes(runStarts.size() - 1);
+    parallelFor(sortedNodes.size(), threadsCount, [&](size_t begin, size_t end)
+    {
+        for (size_t run = begin; run < end; run++)
+        {
+            sortedNodes[run] = std::make_shared<BinarySearchTreeNode>(std::move(values[runStarts[run]]));
+            sortedNodes[run]->count = multiset ? static_cast<int>(runStarts[run + 1] - runStarts[run]) : 1;
+        }
+    });
+    this->stats.addAllocation(sortedNodes.size());
+
+    this->root = this->getNilNode();
+    tombstonesCount = 0;
+    finger.reset();
+    this->buildBalanced(sortedNodes, threadsCount);
+    this->rebuildBloomFilter();
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void BinarySearchTree<ValueType, Compare, Stats>::addValuesInternal(std::vector<ValueType> &&values)
+{
+    // A bulk build relinks every stored node too, so a batch small next to the tree goes in one add at a time
+    if (values.size() * 4 < static_cast<size_t>(getSize()))
+    {
+        BinaryTreeBase<ValueType, Compare, Stats>::addValuesInternal(std::move(values));
+        return;
+    }
+    bulkAdd(std::move(values));
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinarySearchTree<ValueType, Compare, Stats>::memoryUsageInternal(MemoryUsage &outUsage) const
+{
+    // Tombstones and the nil sentinel hold memory like any other node
+    outUsage.keysCount += this->getSize();
+    outUsage.addSharedNodes<BinarySearchTreeNode>(this->getNodesCount(this->root) + (this->getNilNode() ? 1 : 0));
+
+    const std::size_t bloomBytes = bloomFilter.getBitsCount() / 8;
+    outUsage.addArray(bloomBytes, bloomBytes);
+}
+
+template <class ValueType, class Compare, class Stats>
+std::string BinarySearchTree<ValueType, Compare, Stats>::verifyInternal(unsigned threadsCount) const
+{
+    const auto rootNode = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+    SubtreeCheck check = this->verifySubtree(rootNode, nullptr, nullptr, nullptr, 0, getForkDepth(threadsCount));
+    if (check.error.empty() && check.tombstonesCount != tombstonesCount)
+    {
+        check.error = "tombstones count is " + std::to_string(tombstonesCount) + ", the tree holds " + std::to_string(check.tombstonesCount);
+    }
+    return check.error;
+}
+
+template <class ValueType, class Compare, class Stats>
+typename BinarySearchTree<ValueType, Compare, Stats>::SubtreeCheck BinarySearchTree<ValueType, Compare, Stats>::verifySubtree(const shared_ptr<BinarySearchTreeNode> &inRoot, const shared_ptr<BinarySearchTreeNode> &parent
+                                                                                                            , const ValueType *low, const ValueType *high, int depth, int forkDepth) const
+{
+    SubtreeCheck check;
+    if (!this->isNodeValid(inRoot))
+    {
+        return check;
+    }
+
+    const std::string location = " at depth " + std::to_string(depth);
+    if (inRoot->parent.lock() != parent)
+    {
+        check.error = "parent link broken" + location;
+        return check;
+    }
+    if ((low && !this->compare(*low, inRoot->value)) || (high && !this->compare(inRoot->value, *high)))
+    {
+        check.error = "search order broken" + location;
+        return check;
+    }
+
+    SubtreeCheck left, right;
+    parallelInvoke(depth < forkDepth, [&]()
+    {
+        left = this->verifySubtree(inRoot->left, inRoot, low, &inRoot->value, depth + 1, forkDepth);
+    }, [&]()
+    {
+        right = this->verifySubtree(inRoot->right, inRoot, &inRoot->value, high, depth + 1, forkDepth);
+    });
+
+    if (!left.error.empty())
+    {
+        return left;
+    }
+    if (!right.error.empty())
+    {
+        return right;
+    }
+
+    check.tombstonesCount = left.tombstonesCount + right.tombstonesCount + (inRoot->count == 0 ? 1 : 0);
+    this->verifyNode(inRoot, left, right, check);
+    if (!check.error.empty())
+    {
+        check.error += location;
+    }
+    return check;
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinarySearchTree<ValueType, Compare, Stats>::verifyNode(const shared_ptr<BinarySearchTreeNode> &node, const SubtreeCheck &left, const SubtreeCheck &right, SubtreeCheck &outCheck) const
+{
+    outCheck.size = node->count + left.size + right.size;
+    outCheck.height = 1 + std::max(left.height, right.height);
+    if (node->count < 0 || (node->count > 1 && !multiset))
+    {
+        outCheck.error = "occurrence count " + std::to_string(node->count) + " out of range";
+    }
+    else if (node->size != outCheck.size)
+    {
+        outCheck.error = "subtree size " + std::to_string(node->size) + ", counted " + std::to_string(outCheck.size);
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinarySearchTree<ValueType, Compare, Stats>::collectLiveValues(const shared_ptr<BinarySearchTreeNode> &inRoot, std::vector<ValueType> &outValues) const
+{
+    if (!this->isNodeValid(inRoot))
+    {
+        return;
+    }
+
+    this->collectLiveValues(inRoot->left, outValues);
+    for (int i = 0; i < inRoot->count; i++)
+    {
+        outValues.push_back(inRoot->value);
+    }
+    this->collectLiveValues(inRoot->right, outValues);
+}
+
+template <class ValueType, class Compare, class Stats> template <class Function>
+void BinarySearchTree<ValueType, Compare, Stats>::visitSubtree(const shared_ptr<BinarySearchTreeNode> &inRoot, const ValueType *low, const ValueType *high, Function &visit) const
+{
+    if (!this->isNodeValid(inRoot))
+    {
+        return;
+    }
+
+    // Only the sides that can still hold values of the range are walked
+    const bool isAboveLow = !low || !this->isLess(inRoot->value, *low);
+    const bool isBelowHigh = !high || this->isLess(inRoot->value, *high);
+    if (isAboveLow)
+    {
+        this->visitSubtree(inRoot->left, low, high, visit);
+    }
+    if (isAboveLow && isBelowHigh)
+    {
+        for (int i = 0; i < inRoot->count; i++)
+        {
+            visit(inRoot->value);
+        }
+    }
+    if (isBelowHigh)
+    {
+        this->visitSubtree(inRoot->right, low, high, visit);
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinarySearchTree<ValueType, Compare, Stats>::buildBalanced(const std::vector<shared_ptr<BinarySearchTreeNode>> &sortedNodes, unsigned threadsCount)
+{
+    int height = 0;
+    while ((static_cast<size_t>(2) << height) <= sortedNodes.size())
+    {
+        height++;
+    }
+
+    const auto nilNode = this->getNilNode();
+    const auto newRoot = this->linkBalanced(sortedNodes, 0, sortedNodes.size(), 0, height, nilNode, getForkDepth(threadsCount));
+    if (newRoot != nilNode)
+    {
+        newRoot->parent.reset();
+    }
+    this->root = newRoot;
+}
+
+template <class ValueType, class Compare, class Stats>
+const shared_ptr<typename BinarySearchTree<ValueType, Compare, Stats>::BinarySearchTreeNode>& BinarySearchTree<ValueType, Compare, Stats>::linkBalanced(const std::vector<shared_ptr<BinarySearchTreeNode>> &sortedNodes
+                                                                                                                                           , size_t begin, size_t end, int depth, int height
+                                                                                                                                           , const shared_ptr<BinarySearchTreeNode> &nilNode, int forkDepth)
+{
+    if (begin >= end)
+    {
+        return nilNode;
+    }
+
+    // Halves differ by at most one node, so every leaf ends up on the last two levels
+    const size_t middle = begin + (end - begin) / 2;
+    const auto &node = sortedNodes[middle];
+    parallelInvoke(depth < forkDepth, [&]()
+    {
+        node->left = this->linkBalanced(sortedNodes, begin, middle, depth + 1, height, nilNode, forkDepth);
+    }, [&]()
+    {
+        node->right = this->linkBalanced(sortedNodes, middle + 1, end, depth + 1, height, nilNode, forkDepth);
+    });
+
+    int size = node->count;
+    int childHeight = 0;
+    if (begin < middle)
+    {
+        node->left->parent = node;
+        size += node->left->size;
+        childHeight = node->left->height;
+    }
+    if (middle + 1 < end)
+    {
+        node->right->parent = node;
+        size += node->right->size;
+        childHeight = std::max(childHeight, node->right->height);
+    }
+    node->size = size;
+    node->height = childHeight + 1;
+
+    this->colorBuiltNode(node, depth, height);
+    return node;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void BinarySearchTree<ValueType, Compare, Stats>::updateSizesUpwards(shared_ptr<BinarySearchTreeNode> node) const
+{
+    while (this->isNodeValid(node))
+    {
+        this->updateSize(node);
+        node = node->parent.lock();
+    }
+}
+
 #endif // BINARYSEARCHTREE_H
@@ -1,29 +1,62 @@
 #ifndef BINARYTREEBASE_H
 #define BINARYTREEBASE_H
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <functional>
 #include <memory>
+#include <random>
+#include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
-#include <QColor.h>
-#include <QRandomGenerator>
+#include <QColor>
+
+#include "latencyhistogram.h"
+#include "memoryusage.h"
+#include "operationlog.h"
+#include "parallelutils.h"
+#include "treedelta.h"
+#include "treestats.h"
+#include "workloadgenerator.h"
 
 using std::shared_ptr;
 using std::weak_ptr;
 
-template <class ValueType>
+template <class ValueType, class Compare = std::less<>, class Stats = DefaultTreeStatsCounter>
 class BinaryTreeBase
 {
 public:
     BinaryTreeBase() = default;
     virtual ~BinaryTreeBase() = default;
 
+    // Selects the node constructor that leaves the value unconstructed, for sentinels
+    struct SentinelTag {};
+
     struct BinaryTreeNode
     {
         BinaryTreeNode(const ValueType &value)
             : value(value)
         {}
 
-        virtual ~BinaryTreeNode() = default;
+        BinaryTreeNode(ValueType &&value)
+            : value(std::move(value))
+        {}
+
+        explicit BinaryTreeNode(SentinelTag)
+            : isSentinel(true)
+        {}
+
+        virtual ~BinaryTreeNode()
+        {
+            if(!isSentinel)
+            {
+                value.~ValueType();
+            }
+        }
 
         virtual shared_ptr<BinaryTreeNode> getParent() const = 0;
         virtual shared_ptr<BinaryTreeNode> getLeft() const = 0;
@@ -32,33 +65,131 @@ public:
         const ValueType& getValue() const { return value; }
         const QColor& getColor() const { return color; }
 
-        ValueType value;
+        union
+        {
+            ValueType value;
+        };
         QColor color = QColorConstants::Black;
+        bool isSentinel = false;
 
         // For vizualization
         float x, mod, shift = 0;
     };
 
+    // Owns a node taken out of a tree; inserting it into a tree of the same node family reuses the allocation
+    class NodeHandle
+    {
+    public:
+        NodeHandle() = default;
+
+        bool empty() const { return node == nullptr; }
+        explicit operator bool() const { return !empty(); }
+
+        ValueType& value() const { return node->value; }
+
+    private:
+        friend class BinaryTreeBase;
+
+        explicit NodeHandle(shared_ptr<BinaryTreeNode> node)
+            : node(std::move(node))
+        {}
+
+        shared_ptr<BinaryTreeNode> node;
+    };
+
     bool add(const ValueType &value);
+    bool add(ValueType &&value);
+    template <class... Args>
+    bool emplace(Args&&... args);
     bool remove(const ValueType &value);
+
+    // A rejected handle (duplicate key or foreign node type) keeps its node
+    NodeHandle extract(const ValueType &value);
+    bool insert(NodeHandle &&handle);
+
+    // Both take every value in [low, high), extractRange hands them out in order
+    int eraseRange(const ValueType &low, const ValueType &high);
+    std::vector<ValueType> extractRange(const ValueType &low, const ValueType &high);
+
+    ValueType extractMin();
+    void updateValue(const ValueType &oldValue, const ValueType &newValue);
+    bool contains(const ValueType &value) const;
+    // Lookup through a mutable tree, a self-adjusting tree may restructure itself on the way
+    bool contains(const ValueType &value);
     void randomFill();
+    // Adds the values as one batch, trees with a bulk build may relink themselves instead of adding one by one
+    void addValues(std::vector<ValueType> values);
+    // Adds count keys drawn from generator in one batch
+    void fill(WorkloadGenerator &generator, std::size_t count);
+
+    // Every public mutation is appended to the log while one is set
+    void setOperationLog(OperationLog<ValueType> *log) { operationLog = log; }
+
+    // Opt-in latency histograms for add, remove, lookup and extract
+    void setLatencyRecorder(LatencyRecorder *recorder) { latencyRecorder = recorder; }
+
+    // Rotations, relinks, recolorings and swaps are pushed as deltas while a buffer is set, for step by step animation
+    void setDeltaBuffer(TreeDeltaBuffer<ValueType> *buffer) { deltaBuffer = buffer; }
 
     void buildProperties(std::unordered_map<std::string, int>& outProperites) const;
 
+    // Checks the structural invariants of the tree type, with subtrees forked over threadsCount threads.
+    // outError gets the first violation found
+    bool verify(std::string *outError = nullptr, unsigned threadsCount = getDefaultThreadsCount()) const;
+
+    // Estimated bytes held by nodes, shared_ptr control blocks, auxiliary arrays and allocator rounding
+    MemoryUsage memoryUsage() const;
+
+    TreeStats getStats() const { return stats.get(); }
+    void resetStats() { stats.reset(); }
+
     const shared_ptr<BinaryTreeNode>& getRoot() const { return root; }
     bool isLeafNode(const shared_ptr<BinaryTreeNode> &node) const;
     virtual bool isNodeValid(const shared_ptr<BinaryTreeNode> &node) const;
 
+    // Whether adding a value the tree already holds stores it again
+    virtual bool allowsDuplicates() const { return false; }
+
 protected:   
+    // newNode may carry a prepared node to link, otherwise one is created where the value belongs
     virtual shared_ptr<BinaryTreeNode> addInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, const shared_ptr<BinaryTreeNode> &parent, shared_ptr<BinaryTreeNode> &newNode) = 0;
-    virtual shared_ptr<BinaryTreeNode> removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, bool &removed) = 0;
-    virtual shared_ptr<BinaryTreeNode> createNode(const ValueType &value) const = 0;
+    virtual shared_ptr<BinaryTreeNode> removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, shared_ptr<BinaryTreeNode> &removedNode) = 0;
+    virtual shared_ptr<BinaryTreeNode> createNode(ValueType &&value) const = 0;
+    virtual void initNode(const shared_ptr<BinaryTreeNode> &node) const = 0;
+    virtual bool canAdoptNode(const shared_ptr<BinaryTreeNode> &node) const = 0;
     virtual shared_ptr<BinaryTreeNode> getMaxValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const = 0;
     virtual shared_ptr<BinaryTreeNode> getMinValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const = 0;
+    virtual int removeRangeInternal(const ValueType &low, const ValueType &high, std::vector<ValueType> *outValues) = 0;
+    // Empty when every invariant holds
+    virtual std::string verifyInternal(unsigned threadsCount) const = 0;
+    virtual void memoryUsageInternal(MemoryUsage &outUsage) const = 0;
 
     virtual void postAddInternal(const shared_ptr<BinaryTreeNode> &newNode) {};
     virtual void postRemoveInternal() {};
     virtual shared_ptr<BinaryTreeNode> getNodeForValue(const ValueType &value) const { return nullptr; }
+    // Lookup for the mutable contains, trees that adjust themselves on access override it
+    virtual shared_ptr<BinaryTreeNode> accessNodeForValue(const ValueType &value) { return getNodeForValue(value); }
+    // Drops one occurrence of a value while leaving its node linked, for duplicates and lazily deleted nodes
+    virtual bool removeOccurrence(const ValueType &value) { return false; }
+
+    virtual ValueType extractMinInternal();
+    virtual void updateValueInternal(const ValueType &oldValue, const ValueType &newValue);
+    virtual void addValuesInternal(std::vector<ValueType> &&values);
+
+    bool addValue(const ValueType &value);
+    // Builds the node for a value addInternal found missing, moving in the value add was given as an rvalue
+    shared_ptr<BinaryTreeNode> createNodeFor(const ValueType &value);
+    bool removeValue(const ValueType &value);
+    bool insertNode(const shared_ptr<BinaryTreeNode> &node);
+    shared_ptr<BinaryTreeNode> extractNode(const ValueType &value);
+    void recordOperation(OperationType type, const ValueType &value, const ValueType &newValue = ValueType{});
+
+    // Take any node type so that nothing is converted or copied while no buffer is set
+    template <class Node>
+    void recordDelta(TreeDeltaType type, const shared_ptr<Node> &node) const;
+    template <class Node, class OtherNode>
+    void recordDelta(TreeDeltaType type, const shared_ptr<Node> &node, const shared_ptr<OtherNode> &other, bool isLeft = false) const;
+    void pushDelta(TreeDeltaType type, const shared_ptr<BinaryTreeNode> &node, const shared_ptr<BinaryTreeNode> &other, bool isLeft) const;
 
     int getHeight(const shared_ptr<BinaryTreeNode> &inRoot) const;
     ValueType getSumOfLeafNodes(const shared_ptr<BinaryTreeNode> &inRoot) const;
@@ -72,12 +203,228 @@ protected:
     template <class NodeClass>
     shared_ptr<NodeClass> getNodeAs(const shared_ptr<BinaryTreeNode> &inRoot) const;
 
+    template <class Left, class Right>
+    bool isLess(const Left &left, const Right &right) const;
+
+    template <class Left, class Right>
+    bool isEquivalent(const Left &left, const Right &right) const;
+
 protected:
     shared_ptr<BinaryTreeNode> root;
+
+    Compare compare;
+
+    mutable Stats stats;
+
+    OperationLog<ValueType> *operationLog = nullptr;
+    LatencyRecorder *latencyRecorder = nullptr;
+    TreeDeltaBuffer<ValueType> *deltaBuffer = nullptr;
+
+    // Set only while add(ValueType&&) runs, taken by the first createNodeFor
+    ValueType *movableValue = nullptr;
 };
 
-template<class ValueType>
-inline bool BinaryTreeBase<ValueType>::add(const ValueType &value)
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::add(const ValueType &value)
+{
+    const ScopedLatency latency(latencyRecorder, LatencyOperation::Add);
+    recordOperation(OperationType::Add, value);
+    return addValue(value);
+}
+
+// The node is only built once the search found no equal key, the value is then moved into it
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::add(ValueType &&value)
+{
+    const ScopedLatency latency(latencyRecorder, LatencyOperation::Add);
+    recordOperation(OperationType::Add, value);
+
+    movableValue = &value;
+    const bool isAdded = addValue(value);
+    movableValue = nullptr;
+    return isAdded;
+}
+
+// The key is needed for the search, so the value is built once from args and moved into the node, if any
+template <class ValueType, class Compare, class Stats> template <class... Args>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::emplace(Args&&... args)
+{
+    return add(ValueType(std::forward<Args>(args)...));
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::remove(const ValueType &value)
+{
+    const ScopedLatency latency(latencyRecorder, LatencyOperation::Remove);
+    recordOperation(OperationType::Remove, value);
+    return removeValue(value);
+}
+
+template <class ValueType, class Compare, class Stats>
+inline typename BinaryTreeBase<ValueType, Compare, Stats>::NodeHandle BinaryTreeBase<ValueType, Compare, Stats>::extract(const ValueType &value)
+{
+    const ScopedLatency latency(latencyRecorder, LatencyOperation::Remove);
+    recordOperation(OperationType::Remove, value);
+
+    // A value stored more than once keeps its node, the handle gets a node of its own
+    if(removeOccurrence(value))
+    {
+        return NodeHandle(createNode(ValueType(value)));
+    }
+    return NodeHandle(extractNode(value));
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::insert(NodeHandle &&handle)
+{
+    if(handle.empty() || !canAdoptNode(handle.node))
+    {
+        return false;
+    }
+
+    const ScopedLatency latency(latencyRecorder, LatencyOperation::Add);
+    recordOperation(OperationType::Add, handle.node->value);
+
+    initNode(handle.node);
+    if(!insertNode(handle.node))
+    {
+        return false;
+    }
+
+    handle.node = nullptr;
+    return true;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline int BinaryTreeBase<ValueType, Compare, Stats>::eraseRange(const ValueType &low, const ValueType &high)
+{
+    const ScopedLatency latency(latencyRecorder, LatencyOperation::Remove);
+    recordOperation(OperationType::RemoveRange, low, high);
+    return removeRangeInternal(low, high, nullptr);
+}
+
+template <class ValueType, class Compare, class Stats>
+inline std::vector<ValueType> BinaryTreeBase<ValueType, Compare, Stats>::extractRange(const ValueType &low, const ValueType &high)
+{
+    const ScopedLatency latency(latencyRecorder, LatencyOperation::Remove);
+    recordOperation(OperationType::RemoveRange, low, high);
+
+    std::vector<ValueType> values;
+    removeRangeInternal(low, high, &values);
+    return values;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline ValueType BinaryTreeBase<ValueType, Compare, Stats>::extractMin()
+{
+    const ScopedLatency latency(latencyRecorder, LatencyOperation::ExtractMin);
+    recordOperation(OperationType::ExtractMin, ValueType{});
+    return extractMinInternal();
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void BinaryTreeBase<ValueType, Compare, Stats>::updateValue(const ValueType &oldValue, const ValueType &newValue)
+{
+    const ScopedLatency latency(latencyRecorder, LatencyOperation::UpdateValue);
+    recordOperation(OperationType::UpdateValue, oldValue, newValue);
+    updateValueInternal(oldValue, newValue);
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::contains(const ValueType &value) const
+{
+    const ScopedLatency latency(latencyRecorder, LatencyOperation::Lookup);
+    return isNodeValid(getNodeForValue(value));
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::contains(const ValueType &value)
+{
+    const ScopedLatency latency(latencyRecorder, LatencyOperation::Lookup);
+    return isNodeValid(accessNodeForValue(value));
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void BinaryTreeBase<ValueType, Compare, Stats>::randomFill()
+{
+    if constexpr (std::is_constructible_v<ValueType, int>)
+    {
+        // One generator per thread, no lock shared with other fills
+        thread_local Xoshiro256 random(std::random_device{}());
+        // Added one by one, a bulk build would hide the shape the insertion order gives
+        WorkloadGenerator generator(KeyDistribution::Uniform, -10, 100, random());
+        const std::uint64_t numberOfNumbers = 1 + random.bounded(10);
+        for(std::uint64_t i = 0; i < numberOfNumbers; i++)
+        {
+            add(ValueType(static_cast<int>(generator.next())));
+        }
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void BinaryTreeBase<ValueType, Compare, Stats>::addValues(std::vector<ValueType> values)
+{
+    addValuesInternal(std::move(values));
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinaryTreeBase<ValueType, Compare, Stats>::fill(WorkloadGenerator &generator, std::size_t count)
+{
+    if constexpr (std::is_constructible_v<ValueType, std::int64_t>)
+    {
+        std::vector<ValueType> values;
+        generator.generate(count, values);
+        addValues(std::move(values));
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinaryTreeBase<ValueType, Compare, Stats>::addValuesInternal(std::vector<ValueType> &&values)
+{
+    for(ValueType &value : values)
+    {
+        add(std::move(value));
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+ValueType BinaryTreeBase<ValueType, Compare, Stats>::extractMinInternal()
+{
+    const auto minValuePtr = getMinValuePtr(root);
+    if(!isNodeValid(minValuePtr))
+    {
+        return ValueType{};
+    }
+
+    if(removeOccurrence(minValuePtr->value))
+    {
+        return minValuePtr->value;
+    }
+
+    // The extracted node is not shared with the tree anymore, so its value can be moved out
+    extractNode(minValuePtr->value);
+    return std::move(minValuePtr->value);
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinaryTreeBase<ValueType, Compare, Stats>::updateValueInternal(const ValueType &oldValue, const ValueType &newValue)
+{
+    if(removeOccurrence(oldValue))
+    {
+        addValue(newValue);
+        return;
+    }
+
+    const auto node = extractNode(oldValue);
+    if(node)
+    {
+        node->value = newValue;
+        insertNode(node);
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::addValue(const ValueType &value)
 {
     shared_ptr<BinaryTreeNode> newNode;
     root = addInternal(value, root, nullptr, newNode);
@@ -85,38 +432,127 @@ inline bool BinaryTreeBase<ValueType>::add(const ValueType &value)
     return newNode != nullptr;
 }
 
-template<class ValueType>
-inline bool BinaryTreeBase<ValueType>::remove(const ValueType &value)
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename BinaryTreeBase<ValueType, Compare, Stats>::BinaryTreeNode> BinaryTreeBase<ValueType, Compare, Stats>::createNodeFor(const ValueType &value)
+{
+    if(movableValue)
+    {
+        return createNode(std::move(*std::exchange(movableValue, nullptr)));
+    }
+    return createNode(ValueType(value));
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::removeValue(const ValueType &value)
 {
-    bool removed = false;
-    root = removeInternal(value, root, removed);
+    return removeOccurrence(value) || extractNode(value) != nullptr;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::insertNode(const shared_ptr<BinaryTreeNode> &node)
+{
+    shared_ptr<BinaryTreeNode> newNode = node;
+    root = addInternal(node->value, root, nullptr, newNode);
+    postAddInternal(newNode);
+    return newNode != nullptr;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename BinaryTreeBase<ValueType, Compare, Stats>::BinaryTreeNode> BinaryTreeBase<ValueType, Compare, Stats>::extractNode(const ValueType &value)
+{
+    shared_ptr<BinaryTreeNode> removedNode;
+    root = removeInternal(value, root, removedNode);
     postRemoveInternal();
-    return removed;
+
+    // Drop the links into this tree so the node can be held or reinserted elsewhere
+    if(removedNode)
+    {
+        initNode(removedNode);
+    }
+    return removedNode;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void BinaryTreeBase<ValueType, Compare, Stats>::recordOperation(OperationType type, const ValueType &value, const ValueType &newValue)
+{
+    if(operationLog)
+    {
+        operationLog->record(type, value, newValue);
+    }
+}
+
+template <class ValueType, class Compare, class Stats> template <class Node>
+inline void BinaryTreeBase<ValueType, Compare, Stats>::recordDelta(TreeDeltaType type, const shared_ptr<Node> &node) const
+{
+    if(deltaBuffer)
+    {
+        pushDelta(type, node, nullptr, false);
+    }
 }
 
-template<class ValueType>
-inline void BinaryTreeBase<ValueType>::randomFill()
+template <class ValueType, class Compare, class Stats> template <class Node, class OtherNode>
+inline void BinaryTreeBase<ValueType, Compare, Stats>::recordDelta(TreeDeltaType type, const shared_ptr<Node> &node, const shared_ptr<OtherNode> &other, bool isLeft) const
 {
-    const int numberOfNumbers = QRandomGenerator::global()->bounded(1, 11);
-    for(int i=0; i < numberOfNumbers; i++)
+    if(deltaBuffer)
     {
-        const int randomInt = QRandomGenerator::global()->bounded(-10, 101);
-        add(randomInt);
+        pushDelta(type, node, other, isLeft);
     }
 }
 
-template<class ValueType>
-void BinaryTreeBase<ValueType>::buildProperties(std::unordered_map<std::string, int>& outProperites) const
+template <class ValueType, class Compare, class Stats>
+void BinaryTreeBase<ValueType, Compare, Stats>::pushDelta(TreeDeltaType type, const shared_ptr<BinaryTreeNode> &node, const shared_ptr<BinaryTreeNode> &other, bool isLeft) const
+{
+    TreeDelta<ValueType> delta;
+    delta.type = type;
+    delta.isLeft = isLeft;
+    delta.node = isNodeValid(node) ? node.get() : nullptr;
+    delta.other = isNodeValid(other) ? other.get() : nullptr;
+    if(delta.node)
+    {
+        delta.color = node->color;
+        if(type == TreeDeltaType::Attach || type == TreeDeltaType::SetValue)
+        {
+            delta.value = node->value;
+        }
+    }
+    deltaBuffer->push(std::move(delta));
+}
+
+template <class ValueType, class Compare, class Stats>
+bool BinaryTreeBase<ValueType, Compare, Stats>::verify(std::string *outError, unsigned threadsCount) const
+{
+    const std::string error = verifyInternal(threadsCount);
+    if(outError)
+    {
+        *outError = error;
+    }
+    return error.empty();
+}
+
+template <class ValueType, class Compare, class Stats>
+MemoryUsage BinaryTreeBase<ValueType, Compare, Stats>::memoryUsage() const
+{
+    MemoryUsage usage;
+    memoryUsageInternal(usage);
+    return usage;
+}
+
+template <class ValueType, class Compare, class Stats>
+void BinaryTreeBase<ValueType, Compare, Stats>::buildProperties(std::unordered_map<std::string, int>& outProperites) const
 {
     outProperites["Tree Height"] = this->getHeight(root);
 
-    const auto minValuePtr = this->getMinValuePtr(root);
-    outProperites["Min Value"] = isNodeValid(minValuePtr) ? minValuePtr->value : -1;
+    // Only numeric keys fit the int property map
+    if constexpr (std::is_arithmetic_v<ValueType>)
+    {
+        const auto minValuePtr = this->getMinValuePtr(root);
+        outProperites["Min Value"] = isNodeValid(minValuePtr) ? static_cast<int>(minValuePtr->value) : -1;
 
-    const auto maxValuePtr = this->getMaxValuePtr(root);
-    outProperites["Max Value"] = isNodeValid(maxValuePtr) ? maxValuePtr->value : -1;
+        const auto maxValuePtr = this->getMaxValuePtr(root);
+        outProperites["Max Value"] = isNodeValid(maxValuePtr) ? static_cast<int>(maxValuePtr->value) : -1;
 
-    outProperites["Sum of Leaf Nodes"] = getSumOfLeafNodes(root);
+        outProperites["Sum of Leaf Nodes"] = static_cast<int>(getSumOfLeafNodes(root));
+    }
 
     outProperites["Is Full"] = static_cast<bool>(isFull(root));
 
@@ -124,29 +560,46 @@ void BinaryTreeBase<ValueType>::buildProperties(std::unordered_map<std::string,
 
     outProperites["Nodes Count"] = getNodesCount(root);
 
-    outProperites["Leaves Count"] = getNodesCount(root);
+    outProperites["Leaves Count"] = getLeavesCount(root);
+
+    const MemoryUsage usage = memoryUsage();
+    // Reported in KiB, whole bytes overflow the int property above 2 GiB
+    const std::size_t memoryKiB = (usage.getTotalBytes() + 1023) / 1024;
+    outProperites["Memory KiB"] = static_cast<int>(std::min<std::size_t>(memoryKiB, INT_MAX));
+    outProperites["Memory Bytes Per Key"] = static_cast<int>(std::lround(usage.getBytesPerKey()));
+
+    if constexpr (decltype(stats)::enabled)
+    {
+        const TreeStats treeStats = stats.get();
+        outProperites["Comparisons"] = static_cast<int>(treeStats.comparisons);
+        outProperites["Rotations"] = static_cast<int>(treeStats.rotations);
+        outProperites["Recolorings"] = static_cast<int>(treeStats.recolorings);
+        outProperites["Swaps"] = static_cast<int>(treeStats.swaps);
+        outProperites["Allocations"] = static_cast<int>(treeStats.allocations);
+        outProperites["Bloom False Positives"] = static_cast<int>(treeStats.bloomFalsePositives);
+    }
 }
 
-template<class ValueType>
-inline bool BinaryTreeBase<ValueType>::isLeafNode(const shared_ptr<BinaryTreeNode> &node) const
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::isLeafNode(const shared_ptr<BinaryTreeNode> &node) const
 {
     return isNodeValid(node) && !isNodeValid(node->getLeft()) && !isNodeValid(node->getRight());
 }
 
-template<class ValueType>
-inline bool BinaryTreeBase<ValueType>::isNodeValid(const shared_ptr<BinaryTreeNode> &node) const
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::isNodeValid(const shared_ptr<BinaryTreeNode> &node) const
 {
     return node != nullptr;
 }
 
-template<class ValueType>
-inline int BinaryTreeBase<ValueType>::getHeight(const shared_ptr<BinaryTreeNode> &inRoot) const
+template <class ValueType, class Compare, class Stats>
+inline int BinaryTreeBase<ValueType, Compare, Stats>::getHeight(const shared_ptr<BinaryTreeNode> &inRoot) const
 {
     return this->isNodeValid(inRoot) ? 1 + std::max(getHeight(inRoot->getLeft()), getHeight(inRoot->getRight())) : -1;
 }
 
-template<class ValueType>
-inline ValueType BinaryTreeBase<ValueType>::getSumOfLeafNodes(const shared_ptr<BinaryTreeNode> &inRoot) const
+template <class ValueType, class Compare, class Stats>
+inline ValueType BinaryTreeBase<ValueType, Compare, Stats>::getSumOfLeafNodes(const shared_ptr<BinaryTreeNode> &inRoot) const
 {
     if(isNodeValid(inRoot))
     {
@@ -155,8 +608,8 @@ inline ValueType BinaryTreeBase<ValueType>::getSumOfLeafNodes(const shared_ptr<B
     return 0;
 }
 
-template<class ValueType>
-inline bool BinaryTreeBase<ValueType>::isFull(const shared_ptr<BinaryTreeNode> &inRoot) const
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::isFull(const shared_ptr<BinaryTreeNode> &inRoot) const
 {
     if(isNodeValid(inRoot))
     {
@@ -171,8 +624,8 @@ inline bool BinaryTreeBase<ValueType>::isFull(const shared_ptr<BinaryTreeNode> &
     return false;
 }
 
-template<class ValueType>
-inline bool BinaryTreeBase<ValueType>::isDegenerated(const shared_ptr<BinaryTreeNode> &inRoot) const
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::isDegenerated(const shared_ptr<BinaryTreeNode> &inRoot) const
 {
     if(isNodeValid(inRoot))
     {
@@ -187,36 +640,53 @@ inline bool BinaryTreeBase<ValueType>::isDegenerated(const shared_ptr<BinaryTree
     return false;
 }
 
-template<class ValueType>
-inline bool BinaryTreeBase<ValueType>::isComplete(const shared_ptr<BinaryTreeNode> &inRoot) const
+template <class ValueType, class Compare, class Stats>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::isComplete(const shared_ptr<BinaryTreeNode> &inRoot) const
 {
     return false;
 }
 
-template<class ValueType>
-inline int BinaryTreeBase<ValueType>::getNodesCount(const shared_ptr<BinaryTreeNode> &inRoot) const
+template <class ValueType, class Compare, class Stats>
+inline int BinaryTreeBase<ValueType, Compare, Stats>::getNodesCount(const shared_ptr<BinaryTreeNode> &inRoot) const
 {
     return isNodeValid(inRoot) ? 1 + getNodesCount(inRoot->getLeft()) + getNodesCount(inRoot->getRight()) : 0;
 }
 
-template<class ValueType>
-inline int BinaryTreeBase<ValueType>::getLeavesCount(const shared_ptr<BinaryTreeNode> &inRoot) const
+template <class ValueType, class Compare, class Stats>
+inline int BinaryTreeBase<ValueType, Compare, Stats>::getLeavesCount(const shared_ptr<BinaryTreeNode> &inRoot) const
 {
+    if(!isNodeValid(inRoot))
+    {
+        return 0;
+    }
     return isLeafNode(inRoot) ? 1 : getLeavesCount(inRoot->getLeft()) + getLeavesCount(inRoot->getRight());
 }
 
-template<class ValueType>
-inline int BinaryTreeBase<ValueType>::getInternalNodesCount(const shared_ptr<BinaryTreeNode> &inRoot) const
+template <class ValueType, class Compare, class Stats>
+inline int BinaryTreeBase<ValueType, Compare, Stats>::getInternalNodesCount(const shared_ptr<BinaryTreeNode> &inRoot) const
 {
     return getNodesCount(inRoot) - getLeavesCount(inRoot);
 }
 
-template<class ValueType> template<class NodeClass>
-inline shared_ptr<NodeClass> BinaryTreeBase<ValueType>::getNodeAs(const shared_ptr<BinaryTreeNode> &inRoot) const
+template <class ValueType, class Compare, class Stats> template <class NodeClass>
+inline shared_ptr<NodeClass> BinaryTreeBase<ValueType, Compare, Stats>::getNodeAs(const shared_ptr<BinaryTreeNode> &inRoot) const
 {
     return std::dynamic_pointer_cast<NodeClass>(inRoot);
 }
 
+template <class ValueType, class Compare, class Stats> template <class Left, class Right>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::isLess(const Left &left, const Right &right) const
+{
+    stats.addComparison();
+    return compare(left, right);
+}
+
+template <class ValueType, class Compare, class Stats> template <class Left, class Right>
+inline bool BinaryTreeBase<ValueType, Compare, Stats>::isEquivalent(const Left &left, const Right &right) const
+{
+    return !isLess(left, right) && !isLess(right, left);
+}
+
 #endif // BINARYTREEBASE_H
 
 
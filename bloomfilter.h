@@ -0,0 +1,98 @@
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Split block Bloom filter. Every hash selects one 64 byte block and sets one bit in each of its
+// eight words, so both insert and lookup touch a single cache line. Bits are never cleared,
+// removed values are only dropped by clearing and refilling the whole filter.
+class BlockedBloomFilter
+{
+public:
+    static constexpr std::size_t blockBits = 512;
+
+    // Rounds up to whole blocks, 0 disables the filter
+    void reset(std::size_t bitsCount);
+    void clear();
+
+    bool isEnabled() const { return !blocks.empty(); }
+    std::size_t getBitsCount() const { return blocks.size() * blockBits; }
+
+    void insert(std::uint64_t hash);
+    bool mayContain(std::uint64_t hash) const;
+
+private:
+    struct alignas(64) Block
+    {
+        std::uint64_t words[8];
+    };
+
+    static std::uint64_t mix(std::uint64_t hash);
+    std::size_t getBlockIndex(std::uint64_t mixedHash) const;
+    static std::uint64_t getWordMask(std::uint64_t mixedHash, int word);
+
+    std::vector<Block> blocks;
+};
+
+inline void BlockedBloomFilter::reset(std::size_t bitsCount)
+{
+    blocks.assign((bitsCount + blockBits - 1) / blockBits, Block{});
+}
+
+inline void BlockedBloomFilter::clear()
+{
+    blocks.assign(blocks.size(), Block{});
+}
+
+inline void BlockedBloomFilter::insert(std::uint64_t hash)
+{
+    const std::uint64_t mixedHash = mix(hash);
+    Block &block = blocks[getBlockIndex(mixedHash)];
+    for(int word = 0; word < 8; word++)
+    {
+        block.words[word] |= getWordMask(mixedHash, word);
+    }
+}
+
+inline bool BlockedBloomFilter::mayContain(std::uint64_t hash) const
+{
+    const std::uint64_t mixedHash = mix(hash);
+    const Block &block = blocks[getBlockIndex(mixedHash)];
+
+    // No early exit, the eight tests compile to straight-line code on one cache line
+    std::uint64_t missing = 0;
+    for(int word = 0; word < 8; word++)
+    {
+        const std::uint64_t mask = getWordMask(mixedHash, word);
+        missing |= mask & ~block.words[word];
+    }
+    return missing == 0;
+}
+
+inline std::uint64_t BlockedBloomFilter::mix(std::uint64_t hash)
+{
+    // splitmix64 finalizer, std::hash of integers is the identity on the common standard libraries
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+inline std::size_t BlockedBloomFilter::getBlockIndex(std::uint64_t mixedHash) const
+{
+    // Multiply-shift maps the high half onto the blocks without a division
+    return static_cast<std::size_t>(((mixedHash >> 32) * blocks.size()) >> 32);
+}
+
+inline std::uint64_t BlockedBloomFilter::getWordMask(std::uint64_t mixedHash, int word)
+{
+    static constexpr std::uint32_t salts[8] = { 0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU
+                                              , 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U };
+    const std::uint32_t bit = (static_cast<std::uint32_t>(mixedHash) * salts[word]) >> 26;
+    return std::uint64_t(1) << bit;
+}
+
+#endif // BLOOMFILTER_H
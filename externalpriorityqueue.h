@@ -0,0 +1,390 @@
+#ifndef EXTERNALPRIORITYQUEUE_H
+#define EXTERNALPRIORITYQUEUE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#endif
+
+#include "binaryheap.h"
+
+// Min priority queue for more values than fit in memory, ordered by Compare. New values go into a BinaryHeap of
+// at most bufferCapacity values; a full heap is drained as one sorted run into a temporary file. extractMin takes the
+// smaller of the heap's root and the first unread value of the runs, and every run is read one block at a time,
+// front to back, so the disk only ever sees long sequential reads and writes. Memory stays at the heap plus one
+// block per run: past maxRunsCount runs, the smaller half is merged into one longer run.
+// Values are written byte for byte, so ValueType must be trivially copyable
+template <class ValueType, class Compare = std::less<>, class Stats = DefaultTreeStatsCounter>
+class ExternalPriorityQueue
+{
+    static_assert(std::is_trivially_copyable_v<ValueType>, "runs store the values byte for byte");
+
+public:
+    // An empty directory puts the runs in std::tmpfile files
+    explicit ExternalPriorityQueue(std::size_t bufferCapacity = 1 << 16, std::size_t blockSize = 1 << 13
+                                   , std::size_t maxRunsCount = 64, std::string temporaryDirectory = std::string());
+    ~ExternalPriorityQueue();
+
+    ExternalPriorityQueue(const ExternalPriorityQueue&) = delete;
+    ExternalPriorityQueue& operator=(const ExternalPriorityQueue&) = delete;
+
+    void push(const ValueType &value);
+
+    // Neither may be called on an empty queue
+    const ValueType& getMin() const;
+    ValueType extractMin();
+
+    bool isEmpty() const { return size == 0; }
+    std::uint64_t getSize() const { return size; }
+    std::size_t getRunsCount() const { return runs.size(); }
+    // Values written to disk so far, merges included
+    std::uint64_t getWrittenCount() const { return writtenCount; }
+
+    // Set once a temporary file could not be created, written or read. A failed spill keeps its values in memory,
+    // a failed read loses the rest of that run
+    bool hasFailed() const { return failed; }
+
+    // The heap and the read blocks, the files are not counted
+    MemoryUsage memoryUsage() const;
+
+private:
+    struct Run
+    {
+        std::FILE *file = nullptr;
+        // Empty for std::tmpfile, which removes itself
+        std::string path;
+        std::uint64_t unreadCount = 0;
+        std::vector<ValueType> block;
+        std::size_t blockPosition = 0;
+
+        const ValueType& getFront() const { return block[blockPosition]; }
+    };
+
+    std::unique_ptr<Run> createRun();
+    void closeRun(Run &run);
+    bool writeValues(Run &run, const ValueType *values, std::size_t count);
+    // Rewinds a written run and reads its first block
+    bool startReading(Run &run);
+    // False once the run has nothing left
+    bool advance(Run &run);
+    bool readBlock(Run &run);
+
+    void spill();
+    void mergeSmallestRuns();
+
+    // The run heap keeps the run with the smallest front first
+    bool isRunAfter(const std::unique_ptr<Run> &left, const std::unique_ptr<Run> &right) const { return compare(right->getFront(), left->getFront()); }
+    void rebuildRunHeap();
+
+    BinaryHeap<ValueType, Compare, Stats> buffer;
+    std::size_t bufferedCount = 0;
+    std::size_t bufferCapacity;
+    std::size_t blockSize;
+    std::size_t maxRunsCount;
+    std::string temporaryDirectory;
+
+    std::vector<std::unique_ptr<Run>> runs;
+    std::uint64_t size = 0;
+    std::uint64_t writtenCount = 0;
+    std::uint64_t createdRunsCount = 0;
+    bool failed = false;
+    Compare compare;
+};
+
+template <class ValueType, class Compare, class Stats>
+ExternalPriorityQueue<ValueType, Compare, Stats>::ExternalPriorityQueue(std::size_t bufferCapacity, std::size_t blockSize, std::size_t maxRunsCount, std::string temporaryDirectory)
+    : bufferCapacity(std::max<std::size_t>(bufferCapacity, 1))
+    , blockSize(std::max<std::size_t>(blockSize, 1))
+    , maxRunsCount(std::max<std::size_t>(maxRunsCount, 2))
+    , temporaryDirectory(std::move(temporaryDirectory))
+{
+}
+
+template <class ValueType, class Compare, class Stats>
+ExternalPriorityQueue<ValueType, Compare, Stats>::~ExternalPriorityQueue()
+{
+    for(const auto &run : runs)
+    {
+        closeRun(*run);
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void ExternalPriorityQueue<ValueType, Compare, Stats>::push(const ValueType &value)
+{
+    if(bufferedCount >= bufferCapacity)
+    {
+        spill();
+    }
+
+    buffer.add(value);
+    bufferedCount++;
+    size++;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline const ValueType& ExternalPriorityQueue<ValueType, Compare, Stats>::getMin() const
+{
+    const auto &bufferRoot = buffer.getRoot();
+    if(runs.empty() || (buffer.isNodeValid(bufferRoot) && !compare(runs.front()->getFront(), bufferRoot->getValue())))
+    {
+        return bufferRoot->getValue();
+    }
+    return runs.front()->getFront();
+}
+
+template <class ValueType, class Compare, class Stats>
+ValueType ExternalPriorityQueue<ValueType, Compare, Stats>::extractMin()
+{
+    const auto &bufferRoot = buffer.getRoot();
+    size--;
+    if(runs.empty() || (buffer.isNodeValid(bufferRoot) && !compare(runs.front()->getFront(), bufferRoot->getValue())))
+    {
+        bufferedCount--;
+        return buffer.extractMin();
+    }
+
+    std::pop_heap(runs.begin(), runs.end(), [this](const auto &left, const auto &right) { return isRunAfter(left, right); });
+    Run &run = *runs.back();
+    const ValueType value = run.getFront();
+    if(advance(run))
+    {
+        std::push_heap(runs.begin(), runs.end(), [this](const auto &left, const auto &right) { return isRunAfter(left, right); });
+    }
+    else
+    {
+        size -= run.unreadCount;
+        closeRun(run);
+        runs.pop_back();
+    }
+    return value;
+}
+
+template <class ValueType, class Compare, class Stats>
+MemoryUsage ExternalPriorityQueue<ValueType, Compare, Stats>::memoryUsage() const
+{
+    MemoryUsage usage = buffer.memoryUsage();
+    usage.addArray(runs.size() * sizeof(runs[0]), runs.capacity() * sizeof(runs[0]));
+    usage.addAllocations(runs.size(), sizeof(Run));
+    for(const auto &run : runs)
+    {
+        usage.addArray(run->block.size() * sizeof(ValueType), run->block.capacity() * sizeof(ValueType));
+    }
+    return usage;
+}
+
+template <class ValueType, class Compare, class Stats>
+std::unique_ptr<typename ExternalPriorityQueue<ValueType, Compare, Stats>::Run> ExternalPriorityQueue<ValueType, Compare, Stats>::createRun()
+{
+    auto run = std::make_unique<Run>();
+    if(temporaryDirectory.empty())
+    {
+        run->file = std::tmpfile();
+    }
+    else
+    {
+        // Unique within the process by the counter, and across processes by the queue address and start time
+        const auto startTime = std::chrono::steady_clock::now().time_since_epoch().count();
+        run->path = temporaryDirectory + "/priorityqueue-" + std::to_string(reinterpret_cast<std::uintptr_t>(this)) + "-"
+                    + std::to_string(startTime) + "-" + std::to_string(createdRunsCount) + ".run";
+        run->file = std::fopen(run->path.c_str(), "w+b");
+    }
+    createdRunsCount++;
+
+    if(!run->file)
+    {
+        failed = true;
+        return nullptr;
+    }
+
+    // The blocks are read and written whole, a stdio buffer would only copy them once more
+    std::setvbuf(run->file, nullptr, _IONBF, 0);
+    return run;
+}
+
+template <class ValueType, class Compare, class Stats>
+void ExternalPriorityQueue<ValueType, Compare, Stats>::closeRun(Run &run)
+{
+    if(run.file)
+    {
+        std::fclose(run.file);
+        run.file = nullptr;
+    }
+    if(!run.path.empty())
+    {
+        std::remove(run.path.c_str());
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool ExternalPriorityQueue<ValueType, Compare, Stats>::writeValues(Run &run, const ValueType *values, std::size_t count)
+{
+    if(std::fwrite(values, sizeof(ValueType), count, run.file) != count)
+    {
+        failed = true;
+        return false;
+    }
+    run.unreadCount += count;
+    writtenCount += count;
+    return true;
+}
+
+template <class ValueType, class Compare, class Stats>
+bool ExternalPriorityQueue<ValueType, Compare, Stats>::startReading(Run &run)
+{
+    if(std::fflush(run.file) != 0 || std::fseek(run.file, 0, SEEK_SET) != 0)
+    {
+        failed = true;
+        return false;
+    }
+
+#if (defined(__unix__) || defined(__APPLE__)) && defined(POSIX_FADV_SEQUENTIAL)
+    // Lets the kernel read ahead further than it does for files of unknown access
+    posix_fadvise(fileno(run.file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    return readBlock(run);
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool ExternalPriorityQueue<ValueType, Compare, Stats>::advance(Run &run)
+{
+    if(++run.blockPosition < run.block.size())
+    {
+        return true;
+    }
+    return run.unreadCount > 0 && readBlock(run);
+}
+
+template <class ValueType, class Compare, class Stats>
+bool ExternalPriorityQueue<ValueType, Compare, Stats>::readBlock(Run &run)
+{
+    const std::size_t count = static_cast<std::size_t>(std::min<std::uint64_t>(run.unreadCount, blockSize));
+    run.block.resize(count);
+    run.blockPosition = 0;
+    if(count == 0 || std::fread(run.block.data(), sizeof(ValueType), count, run.file) != count)
+    {
+        failed = failed || count > 0;
+        run.block.clear();
+        return false;
+    }
+    run.unreadCount -= count;
+    return true;
+}
+
+template <class ValueType, class Compare, class Stats>
+void ExternalPriorityQueue<ValueType, Compare, Stats>::spill()
+{
+    if(runs.size() >= maxRunsCount)
+    {
+        mergeSmallestRuns();
+    }
+
+    auto run = createRun();
+    if(!run)
+    {
+        // Nowhere to spill to, the heap grows past its capacity instead
+        bufferCapacity *= 2;
+        return;
+    }
+
+    const std::vector<ValueType> values = buffer.drain();
+    if(!writeValues(*run, values.data(), values.size()) || !startReading(*run))
+    {
+        closeRun(*run);
+        for(const ValueType &value : values)
+        {
+            buffer.add(value);
+        }
+        bufferCapacity *= 2;
+        return;
+    }
+
+    bufferedCount = 0;
+    runs.push_back(std::move(run));
+    std::push_heap(runs.begin(), runs.end(), [this](const auto &left, const auto &right) { return isRunAfter(left, right); });
+}
+
+template <class ValueType, class Compare, class Stats>
+void ExternalPriorityQueue<ValueType, Compare, Stats>::mergeSmallestRuns()
+{
+    // Merging the shorter half keeps the run lengths growing geometrically, so every value is rewritten
+    // a logarithmic number of times however many spills there are
+    const auto getRemainingCount = [](const Run &run) { return run.unreadCount + run.block.size() - run.blockPosition; };
+    std::sort(runs.begin(), runs.end(), [&getRemainingCount](const auto &left, const auto &right)
+    {
+        return getRemainingCount(*left) < getRemainingCount(*right);
+    });
+    const std::size_t mergedCount = std::max<std::size_t>(runs.size() / 2, 2);
+
+    auto mergedRun = createRun();
+    if(!mergedRun)
+    {
+        rebuildRunHeap();
+        return;
+    }
+
+    std::vector<std::unique_ptr<Run>> inputs(std::make_move_iterator(runs.begin()), std::make_move_iterator(runs.begin() + mergedCount));
+    runs.erase(runs.begin(), runs.begin() + mergedCount);
+    const auto isInputAfter = [this](const auto &left, const auto &right) { return isRunAfter(left, right); };
+    std::make_heap(inputs.begin(), inputs.end(), isInputAfter);
+
+    std::vector<ValueType> output;
+    output.reserve(blockSize);
+    bool isWriting = true;
+    std::uint64_t mergedValuesCount = 0;
+    while(!inputs.empty())
+    {
+        std::pop_heap(inputs.begin(), inputs.end(), isInputAfter);
+        Run &input = *inputs.back();
+        output.push_back(input.getFront());
+        mergedValuesCount++;
+        if(output.size() == blockSize)
+        {
+            isWriting = isWriting && writeValues(*mergedRun, output.data(), output.size());
+            output.clear();
+        }
+
+        if(advance(input))
+        {
+            std::push_heap(inputs.begin(), inputs.end(), isInputAfter);
+        }
+        else
+        {
+            // Left unread only when a read failed
+            size -= input.unreadCount;
+            closeRun(input);
+            inputs.pop_back();
+        }
+    }
+    isWriting = isWriting && writeValues(*mergedRun, output.data(), output.size()) && startReading(*mergedRun);
+
+    if(isWriting)
+    {
+        runs.push_back(std::move(mergedRun));
+    }
+    else
+    {
+        // The inputs are gone by now, so are their values
+        size -= mergedValuesCount;
+        closeRun(*mergedRun);
+    }
+    rebuildRunHeap();
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void ExternalPriorityQueue<ValueType, Compare, Stats>::rebuildRunHeap()
+{
+    std::make_heap(runs.begin(), runs.end(), [this](const auto &left, const auto &right) { return isRunAfter(left, right); });
+}
+
+#endif // EXTERNALPRIORITYQUEUE_H
@@ -0,0 +1,274 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// HDR-style log-linear histogram of nanosecond latencies. Every power of two is split
+// into 64 sub-buckets (under 1.6% error) up to 2^40 ns; larger values land in the last bucket.
+// Memory is fixed and recording is a single relaxed atomic increment.
+class LatencyHistogram
+{
+public:
+    static constexpr int subBucketBits = 7;
+    static constexpr int subBucketCount = 1 << subBucketBits;
+    static constexpr int subBucketHalfCount = subBucketCount / 2;
+    static constexpr int maxValueBits = 40;
+    static constexpr int bucketCount = subBucketCount + (maxValueBits - subBucketBits + 1) * subBucketHalfCount;
+
+    void record(std::uint64_t nanoseconds);
+    void merge(const LatencyHistogram &other);
+    void reset();
+
+    std::uint64_t getCount() const;
+    std::uint64_t getMax() const { return maxValue.load(std::memory_order_relaxed); }
+    std::uint64_t getPercentile(double percentile) const;
+
+private:
+    static int getBucketIndex(std::uint64_t value);
+    static std::uint64_t getBucketUpperBound(int index);
+
+    std::array<std::atomic<std::uint64_t>, bucketCount> counts{};
+    std::atomic<std::uint64_t> maxValue{0};
+};
+
+inline void LatencyHistogram::record(std::uint64_t nanoseconds)
+{
+    counts[getBucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+
+    std::uint64_t currentMax = maxValue.load(std::memory_order_relaxed);
+    while(nanoseconds > currentMax && !maxValue.compare_exchange_weak(currentMax, nanoseconds, std::memory_order_relaxed))
+    {
+    }
+}
+
+inline void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for(int i = 0; i < bucketCount; i++)
+    {
+        counts[i].fetch_add(other.counts[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    maxValue.store(std::max(getMax(), other.getMax()), std::memory_order_relaxed);
+}
+
+inline void LatencyHistogram::reset()
+{
+    for(auto &count : counts)
+    {
+        count.store(0, std::memory_order_relaxed);
+    }
+    maxValue.store(0, std::memory_order_relaxed);
+}
+
+inline std::uint64_t LatencyHistogram::getCount() const
+{
+    std::uint64_t total = 0;
+    for(const auto &count : counts)
+    {
+        total += count.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+inline std::uint64_t LatencyHistogram::getPercentile(double percentile) const
+{
+    const std::uint64_t total = getCount();
+    if(total == 0)
+    {
+        return 0;
+    }
+
+    const std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(percentile / 100.0 * total + 0.5));
+    std::uint64_t seen = 0;
+    for(int i = 0; i < bucketCount; i++)
+    {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if(seen >= rank)
+        {
+            return std::min(getBucketUpperBound(i), getMax());
+        }
+    }
+    return getMax();
+}
+
+inline int LatencyHistogram::getBucketIndex(std::uint64_t value)
+{
+    if(value < static_cast<std::uint64_t>(subBucketCount))
+    {
+        return static_cast<int>(value);
+    }
+
+    int magnitude = 0;
+    for(std::uint64_t shifted = value; shifted > 1; shifted >>= 1)
+    {
+        magnitude++;
+    }
+
+    const int shift = magnitude - (subBucketBits - 1);
+    const int index = subBucketCount + (shift - 1) * subBucketHalfCount + static_cast<int>(value >> shift) - subBucketHalfCount;
+    return std::min(index, bucketCount - 1);
+}
+
+inline std::uint64_t LatencyHistogram::getBucketUpperBound(int index)
+{
+    if(index < subBucketCount)
+    {
+        return static_cast<std::uint64_t>(index);
+    }
+
+    const int shift = (index - subBucketCount) / subBucketHalfCount + 1;
+    const std::uint64_t subBucket = (index - subBucketCount) % subBucketHalfCount + subBucketHalfCount;
+    return ((subBucket + 1) << shift) - 1;
+}
+
+enum class LatencyOperation
+{
+    Add,
+    Remove,
+    Lookup,
+    ExtractMin,
+    UpdateValue,
+    Count
+};
+
+inline const char* getLatencyOperationName(LatencyOperation operation)
+{
+    switch(operation)
+    {
+    case LatencyOperation::Add:
+        return "add";
+    case LatencyOperation::Remove:
+        return "remove";
+    case LatencyOperation::Lookup:
+        return "lookup";
+    case LatencyOperation::ExtractMin:
+        return "extractMin";
+    case LatencyOperation::UpdateValue:
+        return "updateValue";
+    case LatencyOperation::Count:
+        break;
+    }
+    return "unknown";
+}
+
+struct LatencySummary
+{
+    std::uint64_t count = 0;
+    std::uint64_t p50 = 0;
+    std::uint64_t p99 = 0;
+    std::uint64_t p999 = 0;
+    std::uint64_t max = 0;
+};
+
+// One histogram per operation type and thread shard. Threads record into their own
+// shard, so recording never takes a lock and rarely shares a cache line.
+class LatencyRecorder
+{
+public:
+    static constexpr int shardCount = 8;
+
+    void record(LatencyOperation operation, std::uint64_t nanoseconds);
+    void reset();
+
+    LatencySummary getSummary(LatencyOperation operation) const;
+    void dump(std::ostream &stream) const;
+
+private:
+    static int getThreadShard();
+
+    std::array<std::array<LatencyHistogram, static_cast<int>(LatencyOperation::Count)>, shardCount> shards;
+};
+
+inline void LatencyRecorder::record(LatencyOperation operation, std::uint64_t nanoseconds)
+{
+    shards[getThreadShard()][static_cast<int>(operation)].record(nanoseconds);
+}
+
+inline void LatencyRecorder::reset()
+{
+    for(auto &shard : shards)
+    {
+        for(auto &histogram : shard)
+        {
+            histogram.reset();
+        }
+    }
+}
+
+inline LatencySummary LatencyRecorder::getSummary(LatencyOperation operation) const
+{
+    LatencyHistogram merged;
+    for(const auto &shard : shards)
+    {
+        merged.merge(shard[static_cast<int>(operation)]);
+    }
+
+    LatencySummary summary;
+    summary.count = merged.getCount();
+    summary.p50 = merged.getPercentile(50.0);
+    summary.p99 = merged.getPercentile(99.0);
+    summary.p999 = merged.getPercentile(99.9);
+    summary.max = merged.getMax();
+    return summary;
+}
+
+inline void LatencyRecorder::dump(std::ostream &stream) const
+{
+    for(int i = 0; i < static_cast<int>(LatencyOperation::Count); i++)
+    {
+        const auto operation = static_cast<LatencyOperation>(i);
+        const LatencySummary summary = getSummary(operation);
+        if(summary.count == 0)
+        {
+            continue;
+        }
+
+        stream << getLatencyOperationName(operation) << ": count " << summary.count << ", p50 " << summary.p50
+               << " ns, p99 " << summary.p99 << " ns, p99.9 " << summary.p999 << " ns, max " << summary.max << " ns\n";
+    }
+}
+
+inline int LatencyRecorder::getThreadShard()
+{
+    static std::atomic<int> nextShard{0};
+    thread_local const int shard = nextShard.fetch_add(1, std::memory_order_relaxed) % shardCount;
+    return shard;
+}
+
+// Times its own lifetime into the recorder, or does nothing when there is no recorder
+class ScopedLatency
+{
+public:
+    ScopedLatency(LatencyRecorder *recorder, LatencyOperation operation)
+        : recorder(recorder)
+        , operation(operation)
+    {
+        if(recorder)
+        {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedLatency()
+    {
+        if(recorder)
+        {
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            recorder->record(operation, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    }
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+private:
+    LatencyRecorder *recorder;
+    LatencyOperation operation;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -0,0 +1,82 @@
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+#include <algorithm>
+#include <cstddef>
+
+// Bytes a glibc style malloc hands out for a request: an 8 byte chunk header, 16 byte granularity
+// and 32 byte chunks at least. Everything above the request is counted as slack.
+inline std::size_t getAllocatedChunkSize(std::size_t requestedBytes)
+{
+    if(requestedBytes == 0)
+    {
+        return 0;
+    }
+    return std::max<std::size_t>((requestedBytes + sizeof(void*) + 15) & ~std::size_t(15), 32);
+}
+
+// Estimated heap footprint of a structure. Only the inline bytes of the values are counted,
+// memory a value owns itself (a string's buffer) is not.
+struct MemoryUsage
+{
+    std::size_t keysCount = 0;
+    std::size_t nodesCount = 0;
+
+    std::size_t nodeBytes = 0;
+    std::size_t controlBlockBytes = 0;
+    std::size_t auxiliaryBytes = 0;
+    std::size_t slackBytes = 0;
+
+    std::size_t getTotalBytes() const { return nodeBytes + controlBlockBytes + auxiliaryBytes + slackBytes; }
+    double getBytesPerKey() const { return keysCount > 0 ? static_cast<double>(getTotalBytes()) / keysCount : 0.0; }
+
+    // Nodes made by std::make_shared, each one allocation holding the control block and the node
+    template <class Node>
+    void addSharedNodes(std::size_t count);
+
+    // A buffer of capacityBytes holding usedBytes, the unused capacity is slack
+    void addArray(std::size_t usedBytes, std::size_t capacityBytes);
+
+    // Separate allocations of bytes each, like the values a map keeps out of its nodes
+    void addAllocations(std::size_t count, std::size_t bytes);
+
+    MemoryUsage& operator+=(const MemoryUsage &other);
+};
+
+template <class Node>
+void MemoryUsage::addSharedNodes(std::size_t count)
+{
+    // libstdc++ and libc++ both put a vtable pointer and two int counters in front of the node
+    const std::size_t controlBytes = (sizeof(void*) + 2 * sizeof(int) + alignof(Node) - 1) / alignof(Node) * alignof(Node);
+    const std::size_t requestedBytes = controlBytes + sizeof(Node);
+
+    nodesCount += count;
+    nodeBytes += count * sizeof(Node);
+    controlBlockBytes += count * controlBytes;
+    slackBytes += count * (getAllocatedChunkSize(requestedBytes) - requestedBytes);
+}
+
+inline void MemoryUsage::addArray(std::size_t usedBytes, std::size_t capacityBytes)
+{
+    auxiliaryBytes += usedBytes;
+    slackBytes += getAllocatedChunkSize(capacityBytes) - usedBytes;
+}
+
+inline void MemoryUsage::addAllocations(std::size_t count, std::size_t bytes)
+{
+    auxiliaryBytes += count * bytes;
+    slackBytes += count * (getAllocatedChunkSize(bytes) - bytes);
+}
+
+inline MemoryUsage& MemoryUsage::operator+=(const MemoryUsage &other)
+{
+    keysCount += other.keysCount;
+    nodesCount += other.nodesCount;
+    nodeBytes += other.nodeBytes;
+    controlBlockBytes += other.controlBlockBytes;
+    auxiliaryBytes += other.auxiliaryBytes;
+    slackBytes += other.slackBytes;
+    return *this;
+}
+
+#endif // MEMORYUSAGE_H
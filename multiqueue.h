@@ -0,0 +1,197 @@
+#ifndef MULTIQUEUE_H
+#define MULTIQUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "binaryheap.h"
+
+// Relaxed concurrent priority queue: the values are spread over many BinaryHeap shards, each behind its own lock.
+// A push goes to one random shard, a pop locks two random shards and takes the better of their tops.
+// Pops are not exact. With q shards a popped value ranks O(q) among the stored values in expectation
+// and O(q log q) with high probability (Alistarh et al., "The Power of Choice in Priority Scheduling", 2017),
+// so q = 2 per thread keeps the rank error small while two threads rarely contend for a shard.
+template <class ValueType, class Compare = std::less<>, class Stats = DefaultTreeStatsCounter>
+class MultiQueue
+{
+public:
+    explicit MultiQueue(std::size_t shardsCount = 2 * std::max(1u, std::thread::hardware_concurrency()));
+
+    MultiQueue(const MultiQueue&) = delete;
+    MultiQueue& operator=(const MultiQueue&) = delete;
+
+    void push(const ValueType &value);
+    void push(ValueType &&value);
+
+    // False only once a sweep over every shard found them all empty
+    bool tryPop(ValueType &outValue);
+
+    std::size_t getShardsCount() const { return shardsCount; }
+    // Exact only while no push or pop is running
+    std::size_t getApproximateSize() const { return approximateSize.load(std::memory_order_relaxed); }
+
+    // Sums the shard heaps one lock at a time, so it is a snapshot only while no push or pop is running
+    MemoryUsage memoryUsage() const;
+
+private:
+    struct alignas(64) Shard
+    {
+        std::mutex mutex;
+        BinaryHeap<ValueType, Compare, Stats> heap;
+    };
+
+    template <class Value>
+    void pushValue(Value &&value);
+    bool popFromShard(Shard &shard, ValueType &outValue);
+    bool isShardBetter(const Shard &shard, const Shard &other) const;
+
+    std::size_t getRandomShardIndex();
+
+    std::size_t shardsCount;
+    std::unique_ptr<Shard[]> shards;
+    std::atomic<std::size_t> approximateSize{0};
+    Compare compare;
+};
+
+template <class ValueType, class Compare, class Stats>
+MultiQueue<ValueType, Compare, Stats>::MultiQueue(std::size_t shardsCount)
+    : shardsCount(std::max<std::size_t>(shardsCount, 2))
+    , shards(new Shard[this->shardsCount])
+{
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void MultiQueue<ValueType, Compare, Stats>::push(const ValueType &value)
+{
+    pushValue(value);
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void MultiQueue<ValueType, Compare, Stats>::push(ValueType &&value)
+{
+    pushValue(std::move(value));
+}
+
+template <class ValueType, class Compare, class Stats> template <class Value>
+void MultiQueue<ValueType, Compare, Stats>::pushValue(Value &&value)
+{
+    // A busy shard is skipped instead of waited for, any shard is as good as another for a push
+    while(true)
+    {
+        Shard &shard = shards[getRandomShardIndex()];
+        if(shard.mutex.try_lock())
+        {
+            shard.heap.add(std::forward<Value>(value));
+            shard.mutex.unlock();
+            approximateSize.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+MemoryUsage MultiQueue<ValueType, Compare, Stats>::memoryUsage() const
+{
+    MemoryUsage usage;
+    usage.addArray(shardsCount * sizeof(Shard), shardsCount * sizeof(Shard));
+    for(std::size_t i = 0; i < shardsCount; i++)
+    {
+        const std::lock_guard<std::mutex> lock(shards[i].mutex);
+        usage += shards[i].heap.memoryUsage();
+    }
+    return usage;
+}
+
+template <class ValueType, class Compare, class Stats>
+bool MultiQueue<ValueType, Compare, Stats>::tryPop(ValueType &outValue)
+{
+    // A few two-choice attempts first, an empty or busy pair is retried with new shards
+    for(int attempt = 0; attempt < 4; attempt++)
+    {
+        const std::size_t firstIndex = getRandomShardIndex();
+        std::size_t secondIndex = getRandomShardIndex();
+        if(secondIndex == firstIndex)
+        {
+            secondIndex = (secondIndex + 1) % shardsCount;
+        }
+
+        Shard &first = shards[firstIndex];
+        if(!first.mutex.try_lock())
+        {
+            continue;
+        }
+        const std::lock_guard<std::mutex> firstLock(first.mutex, std::adopt_lock);
+
+        Shard &second = shards[secondIndex];
+        if(!second.mutex.try_lock())
+        {
+            if(popFromShard(first, outValue))
+            {
+                return true;
+            }
+            continue;
+        }
+        const std::lock_guard<std::mutex> secondLock(second.mutex, std::adopt_lock);
+
+        if(popFromShard(isShardBetter(first, second) ? first : second, outValue))
+        {
+            return true;
+        }
+    }
+
+    // Nearly empty queue, every shard is checked once before giving up
+    const std::size_t startIndex = getRandomShardIndex();
+    for(std::size_t i = 0; i < shardsCount; i++)
+    {
+        Shard &shard = shards[(startIndex + i) % shardsCount];
+        const std::lock_guard<std::mutex> lock(shard.mutex);
+        if(popFromShard(shard, outValue))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool MultiQueue<ValueType, Compare, Stats>::popFromShard(Shard &shard, ValueType &outValue)
+{
+    if(!shard.heap.isNodeValid(shard.heap.getRoot()))
+    {
+        return false;
+    }
+
+    outValue = shard.heap.extractMin();
+    approximateSize.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool MultiQueue<ValueType, Compare, Stats>::isShardBetter(const Shard &shard, const Shard &other) const
+{
+    const auto &root = shard.heap.getRoot();
+    const auto &otherRoot = other.heap.getRoot();
+    if(!shard.heap.isNodeValid(otherRoot))
+    {
+        return true;
+    }
+    return shard.heap.isNodeValid(root) && !compare(otherRoot->value, root->value);
+}
+
+template <class ValueType, class Compare, class Stats>
+inline std::size_t MultiQueue<ValueType, Compare, Stats>::getRandomShardIndex()
+{
+    // xorshift64 per thread, seeded from the thread's own state address so threads draw different shards
+    thread_local std::uint64_t state = reinterpret_cast<std::uintptr_t>(&state) * 0x9e3779b97f4a7c15ULL | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return static_cast<std::size_t>(((state >> 32) * shardsCount) >> 32);
+}
+
+#endif // MULTIQUEUE_H
@@ -0,0 +1,215 @@
+#ifndef OPERATIONLOG_H
+#define OPERATIONLOG_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+enum class OperationType : std::uint8_t
+{
+    Add,
+    Remove,
+    ExtractMin,
+    UpdateValue,
+    RemoveRange
+};
+
+// Compact binary log of tree mutations. Layout: "BTOL", format version, value size,
+// then one type byte per operation followed by its operand(s) in native byte order.
+// Trivially copyable values are stored raw; std::string values (value size 0) are
+// stored as a 32-bit length followed by the characters.
+template <class ValueType>
+class OperationLog
+{
+public:
+
+    struct Operation
+    {
+        OperationType type;
+        ValueType value;
+        ValueType newValue;
+    };
+
+    void record(OperationType type, const ValueType &value, const ValueType &newValue = ValueType{});
+    void clear() { operations.clear(); }
+
+    const std::vector<Operation>& getOperations() const { return operations; }
+
+    bool save(std::ostream &stream) const;
+    bool load(std::istream &stream);
+    bool saveToFile(const std::string &path) const;
+    bool loadFromFile(const std::string &path);
+
+    template <class TreeType>
+    static void apply(TreeType &tree, const Operation &operation);
+
+private:
+    static constexpr char magic[4] = { 'B', 'T', 'O', 'L' };
+    static constexpr std::uint8_t formatVersion = 1;
+
+    static bool hasNewValue(OperationType type) { return type == OperationType::UpdateValue || type == OperationType::RemoveRange; }
+    static bool hasValue(OperationType type) { return type != OperationType::ExtractMin; }
+
+    static constexpr std::uint8_t getValueSize();
+    static void writeValue(std::ostream &stream, const ValueType &value);
+    static bool readValue(std::istream &stream, ValueType &value);
+
+    std::vector<Operation> operations;
+};
+
+template<class ValueType>
+inline void OperationLog<ValueType>::record(OperationType type, const ValueType &value, const ValueType &newValue)
+{
+    operations.push_back({ type, value, newValue });
+}
+
+template<class ValueType>
+bool OperationLog<ValueType>::save(std::ostream &stream) const
+{
+    const std::uint8_t valueSize = getValueSize();
+    stream.write(magic, sizeof(magic));
+    stream.write(reinterpret_cast<const char*>(&formatVersion), sizeof(formatVersion));
+    stream.write(reinterpret_cast<const char*>(&valueSize), sizeof(valueSize));
+
+    for(const Operation &operation : operations)
+    {
+        stream.write(reinterpret_cast<const char*>(&operation.type), sizeof(operation.type));
+        if(hasValue(operation.type))
+        {
+            writeValue(stream, operation.value);
+        }
+        if(hasNewValue(operation.type))
+        {
+            writeValue(stream, operation.newValue);
+        }
+    }
+
+    return static_cast<bool>(stream);
+}
+
+template<class ValueType>
+bool OperationLog<ValueType>::load(std::istream &stream)
+{
+    char header[sizeof(magic)];
+    std::uint8_t version = 0;
+    std::uint8_t valueSize = 0;
+    stream.read(header, sizeof(header));
+    stream.read(reinterpret_cast<char*>(&version), sizeof(version));
+    stream.read(reinterpret_cast<char*>(&valueSize), sizeof(valueSize));
+    if(!stream || std::memcmp(header, magic, sizeof(magic)) != 0 || version != formatVersion || valueSize != getValueSize())
+    {
+        return false;
+    }
+
+    operations.clear();
+
+    Operation operation{};
+    while(stream.read(reinterpret_cast<char*>(&operation.type), sizeof(operation.type)))
+    {
+        if(static_cast<std::uint8_t>(operation.type) > static_cast<std::uint8_t>(OperationType::RemoveRange))
+        {
+            return false;
+        }
+        if(hasValue(operation.type) && !readValue(stream, operation.value))
+        {
+            return false;
+        }
+        if(hasNewValue(operation.type) && !readValue(stream, operation.newValue))
+        {
+            return false;
+        }
+        operations.push_back(operation);
+    }
+
+    return stream.eof();
+}
+
+template<class ValueType>
+constexpr std::uint8_t OperationLog<ValueType>::getValueSize()
+{
+    if constexpr (std::is_same_v<ValueType, std::string>)
+    {
+        return 0;
+    }
+    else
+    {
+        static_assert(std::is_trivially_copyable_v<ValueType>, "OperationLog stores raw value bytes");
+        return sizeof(ValueType);
+    }
+}
+
+template<class ValueType>
+inline void OperationLog<ValueType>::writeValue(std::ostream &stream, const ValueType &value)
+{
+    if constexpr (std::is_same_v<ValueType, std::string>)
+    {
+        const std::uint32_t length = static_cast<std::uint32_t>(value.size());
+        stream.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        stream.write(value.data(), length);
+    }
+    else
+    {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(ValueType));
+    }
+}
+
+template<class ValueType>
+inline bool OperationLog<ValueType>::readValue(std::istream &stream, ValueType &value)
+{
+    if constexpr (std::is_same_v<ValueType, std::string>)
+    {
+        std::uint32_t length = 0;
+        if(!stream.read(reinterpret_cast<char*>(&length), sizeof(length)))
+        {
+            return false;
+        }
+        value.resize(length);
+        return static_cast<bool>(stream.read(value.data(), length));
+    }
+    else
+    {
+        return static_cast<bool>(stream.read(reinterpret_cast<char*>(&value), sizeof(ValueType)));
+    }
+}
+
+template<class ValueType>
+inline bool OperationLog<ValueType>::saveToFile(const std::string &path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    return file && save(file);
+}
+
+template<class ValueType>
+inline bool OperationLog<ValueType>::loadFromFile(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return file && load(file);
+}
+
+template<class ValueType> template<class TreeType>
+inline void OperationLog<ValueType>::apply(TreeType &tree, const Operation &operation)
+{
+    switch(operation.type)
+    {
+    case OperationType::Add:
+        tree.add(operation.value);
+        break;
+    case OperationType::Remove:
+        tree.remove(operation.value);
+        break;
+    case OperationType::ExtractMin:
+        tree.extractMin();
+        break;
+    case OperationType::UpdateValue:
+        tree.updateValue(operation.value, operation.newValue);
+        break;
+    case OperationType::RemoveRange:
+        tree.eraseRange(operation.value, operation.newValue);
+        break;
+    }
+}
+
+#endif // OPERATIONLOG_H
@@ -0,0 +1,86 @@
+#ifndef PARALLELUTILS_H
+#define PARALLELUTILS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <future>
+#include <thread>
+#include <vector>
+
+// Fork-join helpers for the bulk tree operations. Every fork is a std::async task that the caller joins,
+// so nothing outlives the call and exceptions reach the caller.
+
+inline unsigned getDefaultThreadsCount()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Number of binary fork levels that keep threadsCount threads busy
+inline int getForkDepth(unsigned threadsCount)
+{
+    int depth = 0;
+    while((2u << depth) <= threadsCount)
+    {
+        depth++;
+    }
+    return depth;
+}
+
+// Runs both functions, the first one on another thread when fork is set
+template <class First, class Second>
+void parallelInvoke(bool fork, First &&first, Second &&second)
+{
+    if(!fork)
+    {
+        first();
+        second();
+        return;
+    }
+
+    auto firstResult = std::async(std::launch::async, std::forward<First>(first));
+    second();
+    firstResult.get();
+}
+
+// Calls function(begin, end) on contiguous chunks of [0, count), one chunk per thread
+template <class Function>
+void parallelFor(std::size_t count, unsigned threadsCount, Function function)
+{
+    const std::size_t chunksCount = std::max<std::size_t>(1, std::min<std::size_t>(threadsCount, count));
+    std::vector<std::future<void>> results;
+    results.reserve(chunksCount - 1);
+    for(std::size_t chunk = 1; chunk < chunksCount; chunk++)
+    {
+        results.push_back(std::async(std::launch::async, function, count * chunk / chunksCount, count * (chunk + 1) / chunksCount));
+    }
+
+    function(std::size_t(0), count / chunksCount);
+    for(auto &result : results)
+    {
+        result.get();
+    }
+}
+
+// Stable merge sort over threadsCount threads, the last merge runs on one thread
+template <class Iterator, class Less>
+void parallelStableSort(Iterator begin, Iterator end, Less less, unsigned threadsCount)
+{
+    constexpr std::ptrdiff_t sequentialCutoff = 1 << 14;
+    if(threadsCount <= 1 || end - begin < sequentialCutoff)
+    {
+        std::stable_sort(begin, end, less);
+        return;
+    }
+
+    const Iterator middle = begin + (end - begin) / 2;
+    parallelInvoke(true, [&]()
+    {
+        parallelStableSort(begin, middle, less, threadsCount / 2);
+    }, [&]()
+    {
+        parallelStableSort(middle, end, less, threadsCount - threadsCount / 2);
+    });
+    std::inplace_merge(begin, middle, end, less);
+}
+
+#endif // PARALLELUTILS_H
@@ -3,235 +3,427 @@
 
 #include "binarysearchtree.h"
 
-template <class ValueType>
-class RedBlackTree : public BinarySearchTree<ValueType>
+template <class ValueType, class Compare = std::less<>, class Stats = DefaultTreeStatsCounter>
+class RedBlackTree : public BinarySearchTree<ValueType, Compare, Stats>
 {
 public:
     RedBlackTree();
 
-    using Super = BinarySearchTree<ValueType>;
-    using BinaryTreeNode = typename BinaryTreeBase<ValueType>::BinaryTreeNode;
-    using BinarySearchTreeNode = typename BinarySearchTree<ValueType>::BinarySearchTreeNode;
+    using Super = BinarySearchTree<ValueType, Compare, Stats>;
+    using BinaryTreeNode = typename BinaryTreeBase<ValueType, Compare, Stats>::BinaryTreeNode;
+    using BinarySearchTreeNode = typename BinarySearchTree<ValueType, Compare, Stats>::BinarySearchTreeNode;
 
     virtual bool isNodeValid(const shared_ptr<BinaryTreeNode> &node) const override;
 
 protected:
-    virtual shared_ptr<BinaryTreeNode> removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, bool &removed) override;
-    virtual shared_ptr<BinaryTreeNode> createNode(const ValueType &value) const override;
+    virtual shared_ptr<BinaryTreeNode> removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, shared_ptr<BinaryTreeNode> &removedNode) override;
+    virtual void initNode(const shared_ptr<BinaryTreeNode> &node) const override;
 
     virtual void postAddInternal(const shared_ptr<BinaryTreeNode> &newNode) override;
-
-    void fixAdd(shared_ptr<BinarySearchTreeNode> node);
+    virtual shared_ptr<BinarySearchTreeNode> getNilNode() const override { return nillNode; }
+    virtual void colorBuiltNode(const shared_ptr<BinarySearchTreeNode> &node, int depth, int height) override;
+    virtual std::string verifyInternal(unsigned threadsCount) const override;
+    virtual void verifyNode(const shared_ptr<BinarySearchTreeNode> &node, const typename Super::SubtreeCheck &left, const typename Super::SubtreeCheck &right
+                            , typename Super::SubtreeCheck &outCheck) const override;
+
+    virtual void splitTree(const shared_ptr<BinarySearchTreeNode> &inRoot, const ValueType &key, shared_ptr<BinarySearchTreeNode> &outLeft, shared_ptr<BinarySearchTreeNode> &outRight) override;
+    virtual shared_ptr<BinarySearchTreeNode> joinTrees(const shared_ptr<BinarySearchTreeNode> &left, const shared_ptr<BinarySearchTreeNode> &right) override;
+
+    // Black heights count the black nodes from a node down to nil, the node included
+    int getBlackHeight(const shared_ptr<BinarySearchTreeNode> &inRoot) const;
+    void splitWithBlackHeight(const shared_ptr<BinarySearchTreeNode> &inRoot, int blackHeight, const ValueType &key
+                              , shared_ptr<BinarySearchTreeNode> &outLeft, int &outLeftHeight, shared_ptr<BinarySearchTreeNode> &outRight, int &outRightHeight);
+    shared_ptr<BinarySearchTreeNode> joinWithKey(const shared_ptr<BinarySearchTreeNode> &left, int leftHeight, const shared_ptr<BinarySearchTreeNode> &key
+                                                 , const shared_ptr<BinarySearchTreeNode> &right, int rightHeight, int &outHeight);
+    int detachSubtree(const shared_ptr<BinarySearchTreeNode> &inRoot, int blackHeight);
+
+    void removeNode(const shared_ptr<BinarySearchTreeNode> &nodePtr);
+
+    // Returns whether a red root was blackened, which grows the black height
+    bool fixAdd(shared_ptr<BinarySearchTreeNode> node);
     void fixDelete(shared_ptr<BinarySearchTreeNode> node);
 
+    void setColor(const shared_ptr<BinarySearchTreeNode> &node, const QColor &color);
+
 protected:
     shared_ptr<BinarySearchTreeNode> nillNode;
 };
 
-template <class ValueType>
-inline RedBlackTree<ValueType>::RedBlackTree()
+template <class ValueType, class Compare, class Stats>
+inline RedBlackTree<ValueType, Compare, Stats>::RedBlackTree()
 {
-    nillNode = this->template getNodeAs<BinarySearchTreeNode>(this->createNode(0));
+    nillNode = std::make_shared<BinarySearchTreeNode>(typename Super::SentinelTag());
     nillNode->color = QColorConstants::Black;
     this->root = nillNode;
 }
 
-template<class ValueType>
-inline bool RedBlackTree<ValueType>::isNodeValid(const shared_ptr<BinaryTreeNode> &node) const
+template <class ValueType, class Compare, class Stats>
+inline bool RedBlackTree<ValueType, Compare, Stats>::isNodeValid(const shared_ptr<BinaryTreeNode> &node) const
 {
     return Super::isNodeValid(node) && node != nillNode;
 }
 
-template <class ValueType>
-shared_ptr<typename RedBlackTree<ValueType>::BinaryTreeNode> RedBlackTree<ValueType>::removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, bool &removed)
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename RedBlackTree<ValueType, Compare, Stats>::BinaryTreeNode> RedBlackTree<ValueType, Compare, Stats>::removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, shared_ptr<BinaryTreeNode> &removedNode)
 {
     const auto nodePtr = this->template getNodeAs<BinarySearchTreeNode>(this->getNodeForValue(value));
     if (this->isNodeValid(nodePtr))
     {
-        removed = true;
+        removedNode = nodePtr;
+        this->removeNode(nodePtr);
+        return this->root;
+    }
 
-        shared_ptr<BinarySearchTreeNode> y = nodePtr;
-        shared_ptr<BinarySearchTreeNode> x = nullptr;
+    removedNode = nullptr;
+    return this->root;
+}
 
-        QColor color = nodePtr->color;
-        if(nodePtr->left == nillNode)
-        {
-            x = nodePtr->right;
-            this->transplant(nodePtr, x);
-        }
-        else if(nodePtr->right == nillNode)
+template <class ValueType, class Compare, class Stats>
+void RedBlackTree<ValueType, Compare, Stats>::removeNode(const shared_ptr<BinarySearchTreeNode> &nodePtr)
+{
+    shared_ptr<BinarySearchTreeNode> y = nodePtr;
+    shared_ptr<BinarySearchTreeNode> x = nullptr;
+
+    QColor color = nodePtr->color;
+    if(nodePtr->left == nillNode)
+    {
+        x = nodePtr->right;
+        this->transplant(nodePtr, x);
+    }
+    else if(nodePtr->right == nillNode)
+    {
+        x = nodePtr->left;
+        this->transplant(nodePtr, x);
+    }
+    else
+    {
+        y = this->template getNodeAs<BinarySearchTreeNode>(this->getMinValuePtr(nodePtr->right));
+        x = y->right;
+        color = y->color;
+        if(y->getParent() == nodePtr)
         {
-            x = nodePtr->left;
-            this->transplant(nodePtr, x);
+            x->parent = y;
         }
         else
         {
-            y = this->template getNodeAs<BinarySearchTreeNode>(this->getMinValuePtr(nodePtr->right));
-            x = y->right;
-            color = y->color;
-            if(y->getParent() == nodePtr)
-            {
-                x->parent = y;
-            }
-            else
-            {
-                this->transplant(y, x);
-                y->right = nodePtr->right;
-                y->right->parent = y;
-            }
-
-            this->transplant(nodePtr, y);
-            y->left = nodePtr->left;
-            y->left->parent = y;
-            y->color = nodePtr->color;
+            this->transplant(y, x);
+            y->right = nodePtr->right;
+            y->right->parent = y;
+            this->recordDelta(TreeDeltaType::Link, y, y->right, false);
         }
 
-        if(color == QColorConstants::Black)
-        {
-            this->fixDelete(x);
-        }
+        this->transplant(nodePtr, y);
+        y->left = nodePtr->left;
+        y->left->parent = y;
+        y->color = nodePtr->color;
+        this->recordDelta(TreeDeltaType::Link, y, y->left, true);
+        this->recordDelta(TreeDeltaType::Recolor, y);
+    }
 
-        return this->root;
+    // Everything from the spliced position up to the root lost one node
+    this->updateSizesUpwards(this->template getNodeAs<BinarySearchTreeNode>(x->getParent()));
+
+    if(color == QColorConstants::Black)
+    {
+        this->fixDelete(x);
     }
+}
 
-    removed = false;
-    return this->root;
+template <class ValueType, class Compare, class Stats>
+void RedBlackTree<ValueType, Compare, Stats>::splitTree(const shared_ptr<BinarySearchTreeNode> &inRoot, const ValueType &key, shared_ptr<BinarySearchTreeNode> &outLeft, shared_ptr<BinarySearchTreeNode> &outRight)
+{
+    int leftHeight = 0;
+    int rightHeight = 0;
+    this->splitWithBlackHeight(inRoot, this->getBlackHeight(inRoot), key, outLeft, leftHeight, outRight, rightHeight);
 }
 
-template <class ValueType>
-inline shared_ptr<typename RedBlackTree<ValueType>::BinaryTreeNode> RedBlackTree<ValueType>::createNode(const ValueType &value) const
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename RedBlackTree<ValueType, Compare, Stats>::BinarySearchTreeNode> RedBlackTree<ValueType, Compare, Stats>::joinTrees(const shared_ptr<BinarySearchTreeNode> &left, const shared_ptr<BinarySearchTreeNode> &right)
 {
-    const auto newNode = std::make_shared<BinarySearchTreeNode>(value);
-    newNode->left = nillNode;
-    newNode->right = nillNode;
-    newNode->color = QColorConstants::Red;
-    return newNode;
+    if (!this->isNodeValid(left))
+    {
+        return right;
+    }
+    if (!this->isNodeValid(right))
+    {
+        return left;
+    }
+
+    // The largest node of the left tree is taken out and becomes the join key
+    const auto key = this->template getNodeAs<BinarySearchTreeNode>(this->getMaxValuePtr(left));
+    this->root = left;
+    this->removeNode(key);
+    const auto rest = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+
+    int height = 0;
+    return this->joinWithKey(rest, this->getBlackHeight(rest), key, right, this->getBlackHeight(right), height);
 }
 
-template <class ValueType>
-inline void RedBlackTree<ValueType>::postAddInternal(const shared_ptr<BinaryTreeNode> &newNode)
+template <class ValueType, class Compare, class Stats>
+std::string RedBlackTree<ValueType, Compare, Stats>::verifyInternal(unsigned threadsCount) const
 {
-    this->fixAdd(this->template getNodeAs<BinarySearchTreeNode>(newNode));
+    const auto rootNode = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+    if (nillNode->color != QColorConstants::Black)
+    {
+        return "nil node is not black";
+    }
+    if (this->isNodeValid(rootNode) && rootNode->color != QColorConstants::Black)
+    {
+        return "root is not black";
+    }
+    return Super::verifyInternal(threadsCount);
 }
 
-template<class ValueType>
-inline void RedBlackTree<ValueType>::fixAdd(shared_ptr<BinarySearchTreeNode> node)
+template <class ValueType, class Compare, class Stats>
+void RedBlackTree<ValueType, Compare, Stats>::verifyNode(const shared_ptr<BinarySearchTreeNode> &node, const typename Super::SubtreeCheck &left, const typename Super::SubtreeCheck &right
+                                                 , typename Super::SubtreeCheck &outCheck) const
 {
-    if (!this->isNodeValid(node))
+    Super::verifyNode(node, left, right, outCheck);
+    if (!outCheck.error.empty())
     {
         return;
     }
 
-    if (node == this->root)
+    const bool isRed = node->color == QColorConstants::Red;
+    if (!isRed && node->color != QColorConstants::Black)
+    {
+        outCheck.error = "node is neither red nor black";
+    }
+    else if (isRed && (node->left->color == QColorConstants::Red || node->right->color == QColorConstants::Red))
+    {
+        outCheck.error = "red node with a red child";
+    }
+    else if (left.blackHeight != right.blackHeight)
+    {
+        outCheck.error = "black heights " + std::to_string(left.blackHeight) + " and " + std::to_string(right.blackHeight);
+    }
+    outCheck.blackHeight = left.blackHeight + (isRed ? 0 : 1);
+}
+
+template <class ValueType, class Compare, class Stats>
+inline int RedBlackTree<ValueType, Compare, Stats>::getBlackHeight(const shared_ptr<BinarySearchTreeNode> &inRoot) const
+{
+    int blackHeight = 0;
+    for (auto node = inRoot; this->isNodeValid(node); node = node->left)
     {
-        node->color = QColorConstants::Black;
+        blackHeight += node->color == QColorConstants::Black ? 1 : 0;
+    }
+    return blackHeight;
+}
+
+// Every join costs the black height difference of its inputs, the differences telescope to O(log n) for the whole split
+template <class ValueType, class Compare, class Stats>
+void RedBlackTree<ValueType, Compare, Stats>::splitWithBlackHeight(const shared_ptr<BinarySearchTreeNode> &inRoot, int blackHeight, const ValueType &key
+                                                            , shared_ptr<BinarySearchTreeNode> &outLeft, int &outLeftHeight, shared_ptr<BinarySearchTreeNode> &outRight, int &outRightHeight)
+{
+    if (!this->isNodeValid(inRoot))
+    {
+        outLeft = nillNode;
+        outRight = nillNode;
+        outLeftHeight = 0;
+        outRightHeight = 0;
         return;
     }
 
+    const auto node = inRoot;
+    const int childHeight = blackHeight - (node->color == QColorConstants::Black ? 1 : 0);
+    const auto left = node->left;
+    const auto right = node->right;
+    const int leftHeight = this->detachSubtree(left, childHeight);
+    const int rightHeight = this->detachSubtree(right, childHeight);
+
+    shared_ptr<BinarySearchTreeNode> innerTree;
+    int innerHeight = 0;
+    if (this->isLess(node->value, key))
+    {
+        this->splitWithBlackHeight(right, rightHeight, key, innerTree, innerHeight, outRight, outRightHeight);
+        outLeft = this->joinWithKey(left, leftHeight, node, innerTree, innerHeight, outLeftHeight);
+    }
+    else
+    {
+        this->splitWithBlackHeight(left, leftHeight, key, outLeft, outLeftHeight, innerTree, innerHeight);
+        outRight = this->joinWithKey(innerTree, innerHeight, node, right, rightHeight, outRightHeight);
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename RedBlackTree<ValueType, Compare, Stats>::BinarySearchTreeNode> RedBlackTree<ValueType, Compare, Stats>::joinWithKey(const shared_ptr<BinarySearchTreeNode> &left, int leftHeight, const shared_ptr<BinarySearchTreeNode> &key
+                                                                                                                          , const shared_ptr<BinarySearchTreeNode> &right, int rightHeight, int &outHeight)
+{
+    key->parent.reset();
+    if (leftHeight == rightHeight)
+    {
+        key->left = left;
+        key->right = right;
+        if (this->isNodeValid(left))
+        {
+            left->parent = key;
+        }
+        if (this->isNodeValid(right))
+        {
+            right->parent = key;
+        }
+        this->setColor(key, QColorConstants::Black);
+        this->updateSize(key);
+        outHeight = leftHeight + 1;
+        return key;
+    }
+
+    // Hang the key as a red node over the spine node of the taller tree whose black height matches the shorter one
+    const bool isLeftTaller = leftHeight > rightHeight;
+    const int shorterHeight = isLeftTaller ? rightHeight : leftHeight;
+    auto node = isLeftTaller ? left : right;
+    shared_ptr<BinarySearchTreeNode> parent;
+    int height = isLeftTaller ? leftHeight : rightHeight;
+    while (height > shorterHeight || node->color == QColorConstants::Red)
+    {
+        height -= node->color == QColorConstants::Black ? 1 : 0;
+        parent = node;
+        node = isLeftTaller ? node->right : node->left;
+    }
+
+    this->setColor(key, QColorConstants::Red);
+    key->left = isLeftTaller ? node : left;
+    key->right = isLeftTaller ? right : node;
+    if (this->isNodeValid(key->left))
+    {
+        key->left->parent = key;
+    }
+    if (this->isNodeValid(key->right))
+    {
+        key->right->parent = key;
+    }
+    (isLeftTaller ? parent->right : parent->left) = key;
+    key->parent = parent;
+    this->updateSizesUpwards(key);
+
+    this->root = isLeftTaller ? left : right;
+    const bool hasGrown = this->fixAdd(key);
+    outHeight = (isLeftTaller ? leftHeight : rightHeight) + (hasGrown ? 1 : 0);
+    return this->template getNodeAs<BinarySearchTreeNode>(this->root);
+}
+
+// Cuts a child loose as a tree of its own, a red root is blackened and the tree grows one black level
+template <class ValueType, class Compare, class Stats>
+inline int RedBlackTree<ValueType, Compare, Stats>::detachSubtree(const shared_ptr<BinarySearchTreeNode> &inRoot, int blackHeight)
+{
+    if (!this->isNodeValid(inRoot))
+    {
+        return 0;
+    }
+
+    inRoot->parent.reset();
+    if (inRoot->color == QColorConstants::Red)
+    {
+        this->setColor(inRoot, QColorConstants::Black);
+        return blackHeight + 1;
+    }
+    return blackHeight;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void RedBlackTree<ValueType, Compare, Stats>::initNode(const shared_ptr<BinaryTreeNode> &node) const
+{
+    const auto redBlackNode = this->template getNodeAs<BinarySearchTreeNode>(node);
+    redBlackNode->parent.reset();
+    redBlackNode->left = nillNode;
+    redBlackNode->right = nillNode;
+    redBlackNode->count = 1;
+    redBlackNode->size = 1;
+    redBlackNode->height = 1;
+    redBlackNode->color = QColorConstants::Red;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void RedBlackTree<ValueType, Compare, Stats>::postAddInternal(const shared_ptr<BinaryTreeNode> &newNode)
+{
+    // Only a freshly linked node is red, an occurrence merged into an existing node needs no fixing
+    const auto redBlackNode = this->template getNodeAs<BinarySearchTreeNode>(newNode);
+    if (redBlackNode && redBlackNode->color == QColorConstants::Red)
+    {
+        this->fixAdd(redBlackNode);
+    }
+}
+
+// Every level above the last one is full, so a red last level keeps all black heights equal
+template <class ValueType, class Compare, class Stats>
+inline void RedBlackTree<ValueType, Compare, Stats>::colorBuiltNode(const shared_ptr<BinarySearchTreeNode> &node, int depth, int height)
+{
+    this->setColor(node, depth == height && depth > 0 ? QColorConstants::Red : QColorConstants::Black);
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool RedBlackTree<ValueType, Compare, Stats>::fixAdd(shared_ptr<BinarySearchTreeNode> node)
+{
+    if (!this->isNodeValid(node))
+    {
+        return false;
+    }
+
     auto parent = this->template getNodeAs<BinarySearchTreeNode>(node->getParent());
-    while(node != this->root && parent->color == QColorConstants::Red)
+    while (parent && parent->color == QColorConstants::Red)
     {
         const auto grandparent = this->template getNodeAs<BinarySearchTreeNode>(parent->getParent());
-        if(parent == grandparent->left)
+        if (parent == grandparent->left)
         {
             const auto uncle = grandparent->right;
-            if(uncle && uncle->color == QColorConstants::Red)
+            if (uncle->color == QColorConstants::Red)
             {
-                if(parent->right == node)
-                {
-                    this->leftRotate(parent);
-
-                    node->color = QColorConstants::Black;
-                }
-                else
-                {
-                    parent->color = QColorConstants::Black;
-                    node->color = QColorConstants::Red;
-                }
-
-                if(grandparent != this->root)
-                {
-                    grandparent->color = QColorConstants::Red;
-                }
-                uncle->color = QColorConstants::Black;
+                this->setColor(parent, QColorConstants::Black);
+                this->setColor(uncle, QColorConstants::Black);
+                this->setColor(grandparent, QColorConstants::Red);
+                node = grandparent;
             }
             else
             {
-                if(parent->right == node)
+                if (parent->right == node)
                 {
-                    this->leftRotate(parent);
-                    this->rightRotate(grandparent);
-
-                    node->color = QColorConstants::Black;
-                }
-                else if(parent->left == node)
-                {
-                    this->rightRotate(grandparent);
-
-                    parent->color = QColorConstants::Black;
+                    node = parent;
+                    this->leftRotate(node);
+                    parent = this->template getNodeAs<BinarySearchTreeNode>(node->getParent());
                 }
 
-                if(grandparent != this->root)
-                {
-                    grandparent->color = QColorConstants::Red;
-                }
+                this->setColor(parent, QColorConstants::Black);
+                this->setColor(grandparent, QColorConstants::Red);
+                this->rightRotate(grandparent);
             }
-
-            node = grandparent;
         }
-        else if(parent == grandparent->right)
+        else
         {
             const auto uncle = grandparent->left;
-            if(uncle && uncle->color == QColorConstants::Red)
+            if (uncle->color == QColorConstants::Red)
             {
-                if(parent->left == node)
-                {
-                    this->rightRotate(parent);
-
-                    node->color = QColorConstants::Black;
-                }
-                else
-                {
-                    parent->color = QColorConstants::Black;
-                    node->color = QColorConstants::Red;
-                }
-
-                if(grandparent != this->root)
-                {
-                    grandparent->color = QColorConstants::Red;
-                }
-
-                uncle->color = QColorConstants::Black;
+                this->setColor(parent, QColorConstants::Black);
+                this->setColor(uncle, QColorConstants::Black);
+                this->setColor(grandparent, QColorConstants::Red);
+                node = grandparent;
             }
             else
             {
-                if(parent->left == node)
+                if (parent->left == node)
                 {
-                    this->rightRotate(parent);
-                    this->leftRotate(grandparent);
-
-                    node->color = QColorConstants::Black;
-                }
-                else if(parent->right == node)
-                {
-                    this->leftRotate(grandparent);
-
-                    parent->color = QColorConstants::Black;
+                    node = parent;
+                    this->rightRotate(node);
+                    parent = this->template getNodeAs<BinarySearchTreeNode>(node->getParent());
                 }
 
-                if(grandparent != this->root)
-                {
-                    grandparent->color = QColorConstants::Red;
-                }
+                this->setColor(parent, QColorConstants::Black);
+                this->setColor(grandparent, QColorConstants::Red);
+                this->leftRotate(grandparent);
             }
         }
 
         parent = this->template getNodeAs<BinarySearchTreeNode>(node->getParent());
     }
+
+    const auto rootNode = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+    const bool isRootRed = rootNode->color == QColorConstants::Red;
+    this->setColor(rootNode, QColorConstants::Black);
+    return isRootRed;
 }
 
-template<class ValueType>
-inline void RedBlackTree<ValueType>::fixDelete(shared_ptr<BinarySearchTreeNode> node)
+template <class ValueType, class Compare, class Stats>
+inline void RedBlackTree<ValueType, Compare, Stats>::fixDelete(shared_ptr<BinarySearchTreeNode> node)
 {
     shared_ptr<BinarySearchTreeNode> sibling = nullptr;
     auto parent = this->template getNodeAs<BinarySearchTreeNode>(node->getParent());
@@ -242,30 +434,30 @@ inline void RedBlackTree<ValueType>::fixDelete(shared_ptr<BinarySearchTreeNode>
             sibling = parent->right;
             if (sibling->color == QColorConstants::Red)
             {
-                sibling->color = QColorConstants::Black;
-                parent->color = QColorConstants::Red;
+                this->setColor(sibling, QColorConstants::Black);
+                this->setColor(parent, QColorConstants::Red);
                 this->leftRotate(parent);
                 sibling = parent->right;
             }
 
             if (sibling->left->color == QColorConstants::Black && sibling->right->color == QColorConstants::Black)
             {
-                sibling->color = QColorConstants::Red;
+                this->setColor(sibling, QColorConstants::Red);
                 node = parent;
             }
             else
             {
                 if (sibling->right->color == QColorConstants::Black)
                 {
-                    sibling->color = QColorConstants::Red;
-                    sibling->left->color = QColorConstants::Black;
+                    this->setColor(sibling, QColorConstants::Red);
+                    this->setColor(sibling->left, QColorConstants::Black);
                     this->rightRotate(sibling);
                     sibling = parent->right;
                 }
 
-                sibling->color = parent->color;
-                parent->color = QColorConstants::Black;
-                sibling->right->color = QColorConstants::Black;
+                this->setColor(sibling, parent->color);
+                this->setColor(parent, QColorConstants::Black);
+                this->setColor(sibling->right, QColorConstants::Black);
                 this->leftRotate(parent);
                 node = this->template getNodeAs<BinarySearchTreeNode>(this->root);
             }
@@ -275,38 +467,49 @@ inline void RedBlackTree<ValueType>::fixDelete(shared_ptr<BinarySearchTreeNode>
             sibling = parent->left;
             if (sibling->color == QColorConstants::Red)
             {
-                sibling->color = QColorConstants::Black;
-                parent->color = QColorConstants::Red;
+                this->setColor(sibling, QColorConstants::Black);
+                this->setColor(parent, QColorConstants::Red);
                 this->rightRotate(parent);
                 sibling = parent->left;
             }
 
             if (sibling->left->color == QColorConstants::Black && sibling->right->color == QColorConstants::Black)
             {
-                sibling->color = QColorConstants::Red;
+                this->setColor(sibling, QColorConstants::Red);
                 node = parent;
             }
             else
             {
                 if (sibling->left->color == QColorConstants::Black)
                 {
-                    sibling->color = QColorConstants::Red;
-                    sibling->right->color = QColorConstants::Black;
+                    this->setColor(sibling, QColorConstants::Red);
+                    this->setColor(sibling->right, QColorConstants::Black);
                     this->leftRotate(sibling);
                     sibling = parent->left;
                 }
 
-                sibling->color = parent->color;
-                parent->color = QColorConstants::Black;
-                sibling->left->color = QColorConstants::Black;
+                this->setColor(sibling, parent->color);
+                this->setColor(parent, QColorConstants::Black);
+                this->setColor(sibling->left, QColorConstants::Black);
                 this->rightRotate(parent);
                 node = this->template getNodeAs<BinarySearchTreeNode>(this->root);
             }
         }
 
-        auto parent = this->template getNodeAs<BinarySearchTreeNode>(node->getParent());
+        parent = this->template getNodeAs<BinarySearchTreeNode>(node->getParent());
+    }
+    this->setColor(node, QColorConstants::Black);
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void RedBlackTree<ValueType, Compare, Stats>::setColor(const shared_ptr<BinarySearchTreeNode> &node, const QColor &color)
+{
+    if (node->color != color)
+    {
+        this->stats.addRecoloring();
+        node->color = color;
+        this->recordDelta(TreeDeltaType::Recolor, node);
     }
-    node->color = QColorConstants::Black;
 }
 
 #endif // REDBLACKTREE_H
@@ -0,0 +1,604 @@
+#ifndef SHARDEDTREE_H
+#define SHARDEDTREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "balancedbinarytree.h"
+#include "redblacktree.h"
+#include "workloadgenerator.h"
+
+// Ordered set split by key range over independent trees, each shard behind its own lock, so writers to different
+// ranges never touch the same lock, nodes or cache lines. Shard k holds the keys in [split k - 1, split k).
+// The split points follow the keys added: every shard samples its adds, and once one shard takes far more than its
+// share the splits move to the quantiles of the samples. A move is only made when it relocates no more keys than
+// were added since the last one, so a stream no split can spread, like ascending keys, never pays for migrations.
+// Single key operations do not wait on anything shared; iteration, ranges and batches take the shards one by one
+// and only exclude rebalancing, so they see every shard at a slightly different moment
+template <class ValueType, template <class, class, class> class TreeType = RedBlackTree, class Compare = std::less<>, class Stats = DefaultTreeStatsCounter>
+class ShardedTree
+{
+public:
+    using Tree = TreeType<ValueType, Compare, Stats>;
+
+    struct ShardStats
+    {
+        std::size_t size = 0;
+        std::uint64_t addsCount = 0;
+        std::uint64_t removesCount = 0;
+        std::uint64_t lookupsCount = 0;
+        // Operations that found the shard lock taken, the sign of a hot range
+        std::uint64_t contendedCount = 0;
+        TreeStats treeStats;
+    };
+
+    // Starts with one range, the first rebalance spreads it over the shards
+    explicit ShardedTree(std::size_t shardsCount = 2 * getDefaultThreadsCount(), std::size_t rebalanceInterval = 16384);
+
+    ShardedTree(const ShardedTree&) = delete;
+    ShardedTree& operator=(const ShardedTree&) = delete;
+
+    bool add(const ValueType &value);
+    bool remove(const ValueType &value);
+    bool contains(const ValueType &value) const;
+
+    // Splits the batch by shard, every shard takes its part as one addValues
+    void addValues(std::vector<ValueType> values);
+
+    // Every stored value in order, or the ones in [low, high) with a null bound open
+    template <class Function>
+    void forEach(Function visit) const { forEachInRange(nullptr, nullptr, visit); }
+    template <class Function>
+    void forEachInRange(const ValueType *low, const ValueType *high, Function visit) const;
+    std::vector<ValueType> getRange(const ValueType &low, const ValueType &high) const;
+    int eraseRange(const ValueType &low, const ValueType &high);
+
+    std::size_t getSize() const;
+    std::size_t getShardsCount() const { return shardsCount; }
+    std::vector<ValueType> getSplitPoints() const;
+    std::vector<ShardStats> getShardStats() const;
+
+    // Adds a shard takes between two checks for imbalance, 0 turns the automatic rebalancing off
+    void setRebalanceInterval(std::size_t interval) { rebalanceInterval = interval; }
+    // Moves the split points to the quantiles of the keys added since the last rebalance. False when nothing moved
+    bool rebalance();
+    std::uint64_t getRebalancesCount() const { return rebalancesCount.load(std::memory_order_relaxed); }
+
+    // Every shard's invariants, and every key in the shard its range names
+    bool verify(std::string *outError = nullptr) const;
+    MemoryUsage memoryUsage() const;
+
+private:
+    static constexpr std::size_t sampleCapacity = 256;
+    // A shard taking more than this many times the mean share of adds triggers a rebalance
+    static constexpr double imbalanceFactor = 1.5;
+
+    struct alignas(64) Shard
+    {
+        mutable std::mutex mutex;
+        Tree tree;
+
+        std::atomic<std::uint64_t> addsSinceRebalance{0};
+        // Reservoir of the keys added since the last rebalance
+        std::vector<ValueType> sample;
+        Xoshiro256 random;
+
+        std::uint64_t addsCount = 0;
+        std::uint64_t removesCount = 0;
+        mutable std::uint64_t lookupsCount = 0;
+        mutable std::uint64_t contendedCount = 0;
+    };
+
+    // Never changed once published. Old ones are kept until the tree goes, so an operation that read the pointer
+    // just before a rebalance can still route with it and then notice the change
+    struct Routing
+    {
+        std::vector<ValueType> splitPoints;
+    };
+
+    // Locks the shard the current routing names for value, retrying when a rebalance swapped the routing meanwhile
+    std::unique_lock<std::mutex> lockShardFor(const ValueType &value, Shard *&outShard) const;
+    std::size_t getShardIndex(const Routing &currentRouting, const ValueType &value) const;
+    // seenCount is the number of adds the shard sampled before this one
+    void sampleAdd(Shard &shard, const ValueType &value, std::uint64_t seenCount);
+    void restartSampling();
+    void maybeRebalance(std::uint64_t shardAddsCount);
+    bool rebalanceLocked();
+    std::vector<ValueType> chooseSplitPoints() const;
+
+    std::size_t shardsCount;
+    std::unique_ptr<Shard[]> shards;
+
+    std::atomic<const Routing*> routing{nullptr};
+    std::vector<std::unique_ptr<const Routing>> routings;
+    // Held exclusively by a rebalance, shared by everything that visits more than one shard
+    mutable std::shared_mutex rebalanceMutex;
+
+    std::atomic<std::size_t> rebalanceInterval;
+    std::atomic<std::uint64_t> rebalancesCount{0};
+    Compare compare;
+};
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+ShardedTree<ValueType, TreeType, Compare, Stats>::ShardedTree(std::size_t shardsCount, std::size_t rebalanceInterval)
+    : shardsCount(std::max<std::size_t>(shardsCount, 1))
+    , shards(new Shard[this->shardsCount])
+    , rebalanceInterval(rebalanceInterval)
+{
+    for(std::size_t i = 0; i < this->shardsCount; i++)
+    {
+        shards[i].random.setSeed(i);
+        shards[i].sample.reserve(sampleCapacity);
+    }
+
+    routings.push_back(std::make_unique<const Routing>());
+    routing.store(routings.back().get(), std::memory_order_release);
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+bool ShardedTree<ValueType, TreeType, Compare, Stats>::add(const ValueType &value)
+{
+    Shard *shard = nullptr;
+    std::unique_lock<std::mutex> lock = lockShardFor(value, shard);
+    if(!shard->tree.add(value))
+    {
+        return false;
+    }
+
+    shard->addsCount++;
+    const std::uint64_t shardAddsCount = shard->addsSinceRebalance.load(std::memory_order_relaxed) + 1;
+    sampleAdd(*shard, value, shardAddsCount - 1);
+    shard->addsSinceRebalance.store(shardAddsCount, std::memory_order_relaxed);
+    lock.unlock();
+
+    const std::size_t interval = rebalanceInterval.load(std::memory_order_relaxed);
+    if(interval > 0 && shardAddsCount % interval == 0)
+    {
+        maybeRebalance(shardAddsCount);
+    }
+    return true;
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+bool ShardedTree<ValueType, TreeType, Compare, Stats>::remove(const ValueType &value)
+{
+    Shard *shard = nullptr;
+    const std::unique_lock<std::mutex> lock = lockShardFor(value, shard);
+    if(!shard->tree.remove(value))
+    {
+        return false;
+    }
+    shard->removesCount++;
+    return true;
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+bool ShardedTree<ValueType, TreeType, Compare, Stats>::contains(const ValueType &value) const
+{
+    Shard *shard = nullptr;
+    const std::unique_lock<std::mutex> lock = lockShardFor(value, shard);
+    shard->lookupsCount++;
+    return shard->tree.contains(value);
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+void ShardedTree<ValueType, TreeType, Compare, Stats>::addValues(std::vector<ValueType> values)
+{
+    std::vector<std::vector<ValueType>> shardValues(shardsCount);
+    {
+        const std::shared_lock<std::shared_mutex> rebalanceLock(rebalanceMutex);
+        const Routing &currentRouting = *routing.load(std::memory_order_acquire);
+        for(ValueType &value : values)
+        {
+            shardValues[getShardIndex(currentRouting, value)].push_back(std::move(value));
+        }
+
+        for(std::size_t i = 0; i < shardsCount; i++)
+        {
+            if(shardValues[i].empty())
+            {
+                continue;
+            }
+
+            Shard &shard = shards[i];
+            const std::lock_guard<std::mutex> lock(shard.mutex);
+            std::uint64_t seenCount = shard.addsSinceRebalance.load(std::memory_order_relaxed);
+            for(const ValueType &value : shardValues[i])
+            {
+                sampleAdd(shard, value, seenCount++);
+            }
+            const int sizeBefore = shard.tree.getSize();
+            shard.tree.addValues(std::move(shardValues[i]));
+            const std::uint64_t addedCount = shard.tree.getSize() - sizeBefore;
+            shard.addsCount += addedCount;
+            shard.addsSinceRebalance.fetch_add(addedCount, std::memory_order_relaxed);
+        }
+    }
+
+    // A batch can shift the whole distribution, so it is checked once at the end instead of at interval multiples
+    if(rebalanceInterval.load(std::memory_order_relaxed) > 0)
+    {
+        std::uint64_t hottestAddsCount = 0;
+        for(std::size_t i = 0; i < shardsCount; i++)
+        {
+            hottestAddsCount = std::max<std::uint64_t>(hottestAddsCount, shards[i].addsSinceRebalance.load(std::memory_order_relaxed));
+        }
+        maybeRebalance(hottestAddsCount);
+    }
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats> template <class Function>
+void ShardedTree<ValueType, TreeType, Compare, Stats>::forEachInRange(const ValueType *low, const ValueType *high, Function visit) const
+{
+    const std::shared_lock<std::shared_mutex> rebalanceLock(rebalanceMutex);
+    const Routing &currentRouting = *routing.load(std::memory_order_acquire);
+    const std::size_t firstIndex = low ? getShardIndex(currentRouting, *low) : 0;
+    const std::size_t lastIndex = high ? getShardIndex(currentRouting, *high) : currentRouting.splitPoints.size();
+    for(std::size_t i = firstIndex; i <= lastIndex; i++)
+    {
+        const std::lock_guard<std::mutex> lock(shards[i].mutex);
+        shards[i].tree.forEachInRange(low, high, visit);
+    }
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+std::vector<ValueType> ShardedTree<ValueType, TreeType, Compare, Stats>::getRange(const ValueType &low, const ValueType &high) const
+{
+    std::vector<ValueType> values;
+    forEachInRange(&low, &high, [&values](const ValueType &value) { values.push_back(value); });
+    return values;
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+int ShardedTree<ValueType, TreeType, Compare, Stats>::eraseRange(const ValueType &low, const ValueType &high)
+{
+    if(!compare(low, high))
+    {
+        return 0;
+    }
+
+    const std::shared_lock<std::shared_mutex> rebalanceLock(rebalanceMutex);
+    const Routing &currentRouting = *routing.load(std::memory_order_acquire);
+    int erasedCount = 0;
+    for(std::size_t i = getShardIndex(currentRouting, low); i <= getShardIndex(currentRouting, high); i++)
+    {
+        Shard &shard = shards[i];
+        const std::lock_guard<std::mutex> lock(shard.mutex);
+        const int shardErasedCount = shard.tree.eraseRange(low, high);
+        shard.removesCount += shardErasedCount;
+        erasedCount += shardErasedCount;
+    }
+    return erasedCount;
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+std::size_t ShardedTree<ValueType, TreeType, Compare, Stats>::getSize() const
+{
+    const std::shared_lock<std::shared_mutex> rebalanceLock(rebalanceMutex);
+    std::size_t size = 0;
+    for(std::size_t i = 0; i < shardsCount; i++)
+    {
+        const std::lock_guard<std::mutex> lock(shards[i].mutex);
+        size += shards[i].tree.getSize();
+    }
+    return size;
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+std::vector<ValueType> ShardedTree<ValueType, TreeType, Compare, Stats>::getSplitPoints() const
+{
+    return routing.load(std::memory_order_acquire)->splitPoints;
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+std::vector<typename ShardedTree<ValueType, TreeType, Compare, Stats>::ShardStats> ShardedTree<ValueType, TreeType, Compare, Stats>::getShardStats() const
+{
+    std::vector<ShardStats> shardStats(shardsCount);
+    for(std::size_t i = 0; i < shardsCount; i++)
+    {
+        const Shard &shard = shards[i];
+        const std::lock_guard<std::mutex> lock(shard.mutex);
+        shardStats[i].size = shard.tree.getSize();
+        shardStats[i].addsCount = shard.addsCount;
+        shardStats[i].removesCount = shard.removesCount;
+        shardStats[i].lookupsCount = shard.lookupsCount;
+        shardStats[i].contendedCount = shard.contendedCount;
+        shardStats[i].treeStats = shard.tree.getStats();
+    }
+    return shardStats;
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+bool ShardedTree<ValueType, TreeType, Compare, Stats>::rebalance()
+{
+    const std::unique_lock<std::shared_mutex> rebalanceLock(rebalanceMutex);
+    return rebalanceLocked();
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+bool ShardedTree<ValueType, TreeType, Compare, Stats>::verify(std::string *outError) const
+{
+    const std::shared_lock<std::shared_mutex> rebalanceLock(rebalanceMutex);
+    const Routing &currentRouting = *routing.load(std::memory_order_acquire);
+    for(std::size_t i = 0; i < shardsCount; i++)
+    {
+        const std::lock_guard<std::mutex> lock(shards[i].mutex);
+        std::string error;
+        if(!shards[i].tree.verify(&error))
+        {
+            if(outError)
+            {
+                *outError = "shard " + std::to_string(i) + ": " + error;
+            }
+            return false;
+        }
+
+        bool isInRange = true;
+        shards[i].tree.forEachInRange(nullptr, nullptr, [&](const ValueType &value)
+        {
+            isInRange = isInRange && getShardIndex(currentRouting, value) == i;
+        });
+        if(!isInRange)
+        {
+            if(outError)
+            {
+                *outError = "shard " + std::to_string(i) + " holds a key outside its range";
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+MemoryUsage ShardedTree<ValueType, TreeType, Compare, Stats>::memoryUsage() const
+{
+    MemoryUsage usage;
+    usage.addArray(shardsCount * sizeof(Shard), shardsCount * sizeof(Shard));
+    for(std::size_t i = 0; i < shardsCount; i++)
+    {
+        const std::lock_guard<std::mutex> lock(shards[i].mutex);
+        usage += shards[i].tree.memoryUsage();
+        usage.addArray(shards[i].sample.size() * sizeof(ValueType), shards[i].sample.capacity() * sizeof(ValueType));
+    }
+    return usage;
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+std::unique_lock<std::mutex> ShardedTree<ValueType, TreeType, Compare, Stats>::lockShardFor(const ValueType &value, Shard *&outShard) const
+{
+    // A rebalance holds every shard lock while it swaps the routing, so an unchanged routing seen under the shard
+    // lock still names the right shard
+    while(true)
+    {
+        const Routing *currentRouting = routing.load(std::memory_order_acquire);
+        Shard &shard = shards[getShardIndex(*currentRouting, value)];
+        std::unique_lock<std::mutex> lock(shard.mutex, std::try_to_lock);
+        if(!lock.owns_lock())
+        {
+            lock.lock();
+            shard.contendedCount++;
+        }
+
+        if(routing.load(std::memory_order_acquire) == currentRouting)
+        {
+            outShard = &shard;
+            return lock;
+        }
+    }
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+inline std::size_t ShardedTree<ValueType, TreeType, Compare, Stats>::getShardIndex(const Routing &currentRouting, const ValueType &value) const
+{
+    const std::vector<ValueType> &splitPoints = currentRouting.splitPoints;
+    return std::upper_bound(splitPoints.begin(), splitPoints.end(), value, compare) - splitPoints.begin();
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+inline void ShardedTree<ValueType, TreeType, Compare, Stats>::sampleAdd(Shard &shard, const ValueType &value, std::uint64_t seenCount)
+{
+    // Algorithm R, every add since the last rebalance equally likely to be in the sample
+    if(shard.sample.size() < sampleCapacity)
+    {
+        shard.sample.push_back(value);
+    }
+    else
+    {
+        const std::uint64_t slot = shard.random.bounded(seenCount + 1);
+        if(slot < sampleCapacity)
+        {
+            shard.sample[slot] = value;
+        }
+    }
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+void ShardedTree<ValueType, TreeType, Compare, Stats>::maybeRebalance(std::uint64_t shardAddsCount)
+{
+    std::uint64_t addsCount = 0;
+    for(std::size_t i = 0; i < shardsCount; i++)
+    {
+        addsCount += shards[i].addsSinceRebalance.load(std::memory_order_relaxed);
+    }
+    if(shardsCount < 2 || static_cast<double>(shardAddsCount) * shardsCount <= imbalanceFactor * addsCount)
+    {
+        return;
+    }
+
+    // One rebalance at a time, the others carry on with their own operation
+    const std::unique_lock<std::shared_mutex> rebalanceLock(rebalanceMutex, std::try_to_lock);
+    if(rebalanceLock.owns_lock())
+    {
+        rebalanceLocked();
+    }
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+bool ShardedTree<ValueType, TreeType, Compare, Stats>::rebalanceLocked()
+{
+    std::vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(shardsCount);
+    for(std::size_t i = 0; i < shardsCount; i++)
+    {
+        locks.emplace_back(shards[i].mutex);
+    }
+
+    const Routing &oldRouting = *routing.load(std::memory_order_relaxed);
+    auto newRouting = std::make_unique<Routing>();
+    newRouting->splitPoints = chooseSplitPoints();
+    if(newRouting->splitPoints.empty())
+    {
+        return false;
+    }
+
+    // The splits already fit, or the keys they would move (below) cost more than the adds they were drawn from.
+    // The observation starts over either way
+    if(newRouting->splitPoints == oldRouting.splitPoints)
+    {
+        restartSampling();
+        return false;
+    }
+
+    // Every shard gives up the keys before and after its new range, two cuts that each cost their own length
+    std::vector<std::vector<ValueType>> movedBelow(shardsCount);
+    std::vector<std::vector<ValueType>> movedAbove(shardsCount);
+    std::uint64_t movedCount = 0;
+    std::uint64_t addsCount = 0;
+    const std::size_t newRangesCount = newRouting->splitPoints.size() + 1;
+    for(std::size_t i = 0; i < shardsCount; i++)
+    {
+        const ValueType *newLow = i > 0 && i < newRangesCount ? &newRouting->splitPoints[i - 1] : nullptr;
+        const ValueType *newHigh = i + 1 < newRangesCount ? &newRouting->splitPoints[i] : nullptr;
+        const auto collect = [](std::vector<ValueType> &outValues) { return [&outValues](const ValueType &value) { outValues.push_back(value); }; };
+        if(i >= newRangesCount)
+        {
+            shards[i].tree.forEachInRange(nullptr, nullptr, collect(movedAbove[i]));
+        }
+        else
+        {
+            if(newLow)
+            {
+                shards[i].tree.forEachInRange(nullptr, newLow, collect(movedBelow[i]));
+            }
+            if(newHigh)
+            {
+                shards[i].tree.forEachInRange(newHigh, nullptr, collect(movedAbove[i]));
+            }
+        }
+        movedCount += movedBelow[i].size() + movedAbove[i].size();
+        addsCount += shards[i].addsSinceRebalance.load(std::memory_order_relaxed);
+    }
+
+    // Keeps migrations amortized to one moved key per add
+    if(movedCount > addsCount)
+    {
+        restartSampling();
+        return false;
+    }
+
+    std::vector<std::vector<ValueType>> arriving(shardsCount);
+    for(std::size_t i = 0; i < shardsCount; i++)
+    {
+        for(std::vector<ValueType> *moved : { &movedBelow[i], &movedAbove[i] })
+        {
+            if(moved->empty())
+            {
+                continue;
+            }
+
+            // The moved keys are a sorted run, so one erase of [first, last) and one remove take them all out
+            shards[i].tree.eraseRange(moved->front(), moved->back());
+            shards[i].tree.remove(moved->back());
+            for(ValueType &value : *moved)
+            {
+                arriving[getShardIndex(*newRouting, value)].push_back(std::move(value));
+            }
+        }
+    }
+
+    for(std::size_t i = 0; i < shardsCount; i++)
+    {
+        if(!arriving[i].empty())
+        {
+            shards[i].tree.addValues(std::move(arriving[i]));
+        }
+    }
+    restartSampling();
+
+    routings.push_back(std::move(newRouting));
+    routing.store(routings.back().get(), std::memory_order_release);
+    rebalancesCount.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+inline void ShardedTree<ValueType, TreeType, Compare, Stats>::restartSampling()
+{
+    for(std::size_t i = 0; i < shardsCount; i++)
+    {
+        shards[i].addsSinceRebalance.store(0, std::memory_order_relaxed);
+        shards[i].sample.clear();
+    }
+}
+
+template <class ValueType, template <class, class, class> class TreeType, class Compare, class Stats>
+std::vector<ValueType> ShardedTree<ValueType, TreeType, Compare, Stats>::chooseSplitPoints() const
+{
+    // Each sampled key stands for its shard's adds over its shard's sample size
+    std::vector<std::pair<ValueType, double>> weightedKeys;
+    double totalWeight = 0.0;
+    for(std::size_t i = 0; i < shardsCount; i++)
+    {
+        const Shard &shard = shards[i];
+        if(shard.sample.empty())
+        {
+            continue;
+        }
+
+        const double weight = static_cast<double>(shard.addsSinceRebalance.load(std::memory_order_relaxed)) / shard.sample.size();
+        for(const ValueType &value : shard.sample)
+        {
+            weightedKeys.emplace_back(value, weight);
+        }
+        totalWeight += weight * shard.sample.size();
+    }
+
+    std::vector<ValueType> splitPoints;
+    if(weightedKeys.size() < shardsCount)
+    {
+        return splitPoints;
+    }
+
+    std::sort(weightedKeys.begin(), weightedKeys.end(), [this](const auto &left, const auto &right) { return compare(left.first, right.first); });
+
+    // Split k goes to the first key where the running weight reaches k / shards of the total, repeated keys collapse
+    double runningWeight = 0.0;
+    std::size_t nextSplit = 1;
+    for(const auto &[value, weight] : weightedKeys)
+    {
+        if(nextSplit >= shardsCount)
+        {
+            break;
+        }
+        if(runningWeight >= totalWeight * nextSplit / shardsCount)
+        {
+            if(splitPoints.empty() || compare(splitPoints.back(), value))
+            {
+                splitPoints.push_back(value);
+            }
+            nextSplit++;
+        }
+        runningWeight += weight;
+    }
+    return splitPoints;
+}
+
+#endif // SHARDEDTREE_H
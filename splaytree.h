@@ -0,0 +1,318 @@
+#ifndef SPLAYTREE_H
+#define SPLAYTREE_H
+
+#include "binarysearchtree.h"
+
+// Self-adjusting tree, every access moves the touched node to the root so hot keys stay shallow.
+// Splaying is top down, in one pass from the root. Lookups through a mutable tree restructure it too,
+// so they need the same exclusion as writes; lookups through a const tree leave it as it is.
+template <class ValueType, class Compare = std::less<>, class Stats = DefaultTreeStatsCounter>
+class SplayTree : public BinarySearchTree<ValueType, Compare, Stats>
+{
+public:
+    SplayTree() = default;
+
+    using BinaryTreeNode = typename BinaryTreeBase<ValueType, Compare, Stats>::BinaryTreeNode;
+    using BinarySearchTreeNode = typename BinarySearchTree<ValueType, Compare, Stats>::BinarySearchTreeNode;
+
+    // Lookups semi-splay, halving the accessed path instead of lifting the node to the root
+    void setSemiSplay(bool enabled) { semiSplay = enabled; }
+    bool isSemiSplay() const { return semiSplay; }
+
+protected:
+    virtual shared_ptr<BinaryTreeNode> addInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, const shared_ptr<BinaryTreeNode> &parent, shared_ptr<BinaryTreeNode> &newNode) override;
+    virtual shared_ptr<BinaryTreeNode> removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, shared_ptr<BinaryTreeNode> &removedNode) override;
+    // Only mutable lookups splay, a const one searches like any other search tree
+    virtual shared_ptr<BinaryTreeNode> accessNodeForValue(const ValueType &value) override;
+
+    // Top-down splay for value, lifts the node holding it or the last node on its search path to the root.
+    // Returns whether the new root holds value
+    bool splay(const ValueType &value);
+    // One pass down the search path lifting every second node of its straight runs, returns the node holding value
+    shared_ptr<BinarySearchTreeNode> semiSplayPath(const ValueType &value);
+
+protected:
+    bool semiSplay = false;
+};
+
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename SplayTree<ValueType, Compare, Stats>::BinaryTreeNode> SplayTree<ValueType, Compare, Stats>::addInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot
+                                                                                                           , const shared_ptr<BinaryTreeNode> &parent, shared_ptr<BinaryTreeNode> &newNode)
+{
+    if (!this->isNodeValid(inRoot))
+    {
+        return BinarySearchTree<ValueType, Compare, Stats>::addInternal(value, inRoot, parent, newNode);
+    }
+
+    // The value's neighbour is splayed to the root and the new node splits the tree there
+    const bool isFound = this->splay(value);
+    const auto rootNode = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+    if (isFound)
+    {
+        this->mergeOccurrence(rootNode, value, newNode);
+        this->updateSize(rootNode);
+        return this->root;
+    }
+
+    // Compared before the node is built, the value may be moved into it
+    const bool isRootLess = this->isLess(rootNode->value, value);
+    if (!newNode)
+    {
+        newNode = this->createNodeFor(value);
+    }
+
+    const auto node = this->template getNodeAs<BinarySearchTreeNode>(newNode);
+    const auto nilNode = this->getNilNode();
+    node->parent.reset();
+    node->left = isRootLess ? rootNode : rootNode->left;
+    node->right = isRootLess ? rootNode->right : rootNode;
+    (isRootLess ? rootNode->right : rootNode->left) = nilNode;
+    rootNode->parent = node;
+    const auto &movedChild = isRootLess ? node->right : node->left;
+    if (this->isNodeValid(movedChild))
+    {
+        movedChild->parent = node;
+    }
+    this->updateSize(rootNode);
+    this->updateSize(node);
+    this->addToBloomFilter(node->value);
+
+    if (this->deltaBuffer)
+    {
+        this->recordDelta(TreeDeltaType::Attach, node, shared_ptr<BinarySearchTreeNode>());
+        this->recordDelta(TreeDeltaType::Link, node, node->left, true);
+        this->recordDelta(TreeDeltaType::Link, node, node->right, false);
+        this->recordDelta(TreeDeltaType::Link, rootNode, nilNode, !isRootLess);
+    }
+    return node;
+}
+
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename SplayTree<ValueType, Compare, Stats>::BinaryTreeNode> SplayTree<ValueType, Compare, Stats>::removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, shared_ptr<BinaryTreeNode> &removedNode)
+{
+    if (!this->isNodeValid(inRoot) || !this->splay(value) || this->template getNodeAs<BinarySearchTreeNode>(this->root)->count == 0)
+    {
+        return this->root;
+    }
+
+    const auto nodePtr = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+    removedNode = nodePtr;
+
+    // Join the two halves under the largest value of the left one
+    const auto left = nodePtr->left;
+    const auto right = nodePtr->right;
+    // nodePtr is the root here, so replacing it is a transplant
+    if (!this->isNodeValid(left))
+    {
+        this->root = right;
+        if (this->isNodeValid(right))
+        {
+            right->parent.reset();
+        }
+        this->recordDelta(TreeDeltaType::Transplant, nodePtr, right);
+        return this->root;
+    }
+
+    left->parent.reset();
+    this->root = left;
+    this->recordDelta(TreeDeltaType::Transplant, nodePtr, left);
+    // Every key on the left is smaller, so splaying for the removed value lifts the left maximum
+    this->splay(nodePtr->value);
+    const auto leftMax = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+
+    leftMax->right = right;
+    if (this->isNodeValid(right))
+    {
+        right->parent = leftMax;
+    }
+    this->recordDelta(TreeDeltaType::Link, leftMax, right, false);
+    this->updateSize(leftMax);
+
+    return this->root;
+}
+
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename SplayTree<ValueType, Compare, Stats>::BinaryTreeNode> SplayTree<ValueType, Compare, Stats>::accessNodeForValue(const ValueType &value)
+{
+    if (this->isRuledOutByBloomFilter(value))
+    {
+        return nullptr;
+    }
+
+    // A miss splays the last node on the path, so repeated deep misses pay for themselves too
+    shared_ptr<BinarySearchTreeNode> foundNode;
+    if (semiSplay)
+    {
+        foundNode = this->semiSplayPath(value);
+    }
+    else if (this->splay(value))
+    {
+        foundNode = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+    }
+
+    if (foundNode && foundNode->count == 0)
+    {
+        foundNode = nullptr;
+    }
+    if (!foundNode && this->hasBloomFilter())
+    {
+        this->stats.addBloomFalsePositive();
+    }
+    return foundNode;
+}
+
+// The search path is cut into a left tree of the nodes below value and a right tree of those above it, then both
+// hang under the node the search ends at. Straight runs rotate on the way down, which halves their depth
+template <class ValueType, class Compare, class Stats>
+bool SplayTree<ValueType, Compare, Stats>::splay(const ValueType &value)
+{
+    auto node = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+    if (!this->isNodeValid(node))
+    {
+        return false;
+    }
+
+    // Every node joins the left tree as the right child of the one before it, mirrored for the right tree
+    const auto linkChild = [](const shared_ptr<BinarySearchTreeNode> &parent, const shared_ptr<BinarySearchTreeNode> &child, bool isLeft)
+    {
+        (isLeft ? parent->left : parent->right) = child;
+        if (child)
+        {
+            child->parent = parent;
+        }
+    };
+    shared_ptr<BinarySearchTreeNode> leftRoot, leftMax, rightRoot, rightMin;
+    bool isFound = false;
+    while (true)
+    {
+        if (this->isLess(value, node->value))
+        {
+            if (!this->isNodeValid(node->left))
+            {
+                break;
+            }
+            if (this->isLess(value, node->left->value))
+            {
+                const auto child = node->left;
+                this->rightRotate(node);
+                node = child;
+                if (!this->isNodeValid(node->left))
+                {
+                    break;
+                }
+            }
+            rightMin ? linkChild(rightMin, node, true) : (void)(rightRoot = node);
+            rightMin = node;
+            node = node->left;
+        }
+        else if (this->isLess(node->value, value))
+        {
+            if (!this->isNodeValid(node->right))
+            {
+                break;
+            }
+            if (this->isLess(node->right->value, value))
+            {
+                const auto child = node->right;
+                this->leftRotate(node);
+                node = child;
+                if (!this->isNodeValid(node->right))
+                {
+                    break;
+                }
+            }
+            leftMax ? linkChild(leftMax, node, false) : (void)(leftRoot = node);
+            leftMax = node;
+            node = node->right;
+        }
+        else
+        {
+            isFound = true;
+            break;
+        }
+    }
+
+    // The node's own subtrees close the two trees, which become its subtrees. Rotations kept the root up to date
+    const auto descentRoot = this->root;
+    if (leftMax)
+    {
+        linkChild(leftMax, node->left, false);
+        linkChild(node, leftRoot, true);
+    }
+    if (rightMin)
+    {
+        linkChild(rightMin, node->right, true);
+        linkChild(node, rightRoot, false);
+    }
+    node->parent.reset();
+    this->root = node;
+
+    // Only the two spines changed, their sizes are fixed bottom up and both walks end at the node
+    this->updateSizesUpwards(leftMax);
+    this->updateSizesUpwards(rightMin);
+
+    // Rotations were recorded as they happened, the relinks are recorded as their final links
+    if (this->deltaBuffer && node != descentRoot)
+    {
+        this->recordDelta(TreeDeltaType::Transplant, descentRoot, node);
+        for (auto spineNode = leftRoot; spineNode && spineNode != leftMax->right; spineNode = spineNode->right)
+        {
+            this->recordDelta(TreeDeltaType::Link, spineNode, spineNode->right, false);
+        }
+        for (auto spineNode = rightRoot; spineNode && spineNode != rightMin->left; spineNode = spineNode->left)
+        {
+            this->recordDelta(TreeDeltaType::Link, spineNode, spineNode->left, true);
+        }
+        this->recordDelta(TreeDeltaType::Link, node, node->left, true);
+        this->recordDelta(TreeDeltaType::Link, node, node->right, false);
+    }
+    return isFound;
+}
+
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename SplayTree<ValueType, Compare, Stats>::BinarySearchTreeNode> SplayTree<ValueType, Compare, Stats>::semiSplayPath(const ValueType &value)
+{
+    shared_ptr<BinarySearchTreeNode> foundNode;
+    shared_ptr<BinarySearchTreeNode> lastNode;
+    auto node = this->template getNodeAs<BinarySearchTreeNode>(this->root);
+    while (this->isNodeValid(node))
+    {
+        lastNode = node;
+        const bool isLeft = this->isLess(value, node->value);
+        if (!isLeft && !this->isLess(node->value, value))
+        {
+            foundNode = node;
+            break;
+        }
+
+        const auto child = isLeft ? node->left : node->right;
+        if (!this->isNodeValid(child))
+        {
+            break;
+        }
+        lastNode = child;
+        const bool isChildLeft = this->isLess(value, child->value);
+        if (!isChildLeft && !this->isLess(child->value, value))
+        {
+            foundNode = child;
+            break;
+        }
+
+        // A straight pair rotates, the child rises and the rest of the path moves up with it
+        const auto grandchild = isChildLeft ? child->left : child->right;
+        if (isLeft == isChildLeft)
+        {
+            isLeft ? this->rightRotate(node) : this->leftRotate(node);
+        }
+        node = grandchild;
+    }
+
+    // Rotations keep every subtree size but not the heights above them
+    if (lastNode)
+    {
+        this->updateSizesUpwards(lastNode);
+    }
+    return foundNode;
+}
+
+#endif // SPLAYTREE_H
@@ -0,0 +1,163 @@
+#ifndef STATICSEARCHTREE_H
+#define STATICSEARCHTREE_H
+
+#include <array>
+#include <cstddef>
+#include <functional>
+
+// Read-only search tree for key sets known up front, built from an array into an implicit balanced layout:
+// the root sits at index 1 and the children of node k at 2k and 2k + 1 (Eytzinger order). There are no nodes,
+// pointers or allocations, and with literal types the whole tree can be built at compile time into static storage.
+// Keys and Compare follow BinarySearchTree: equal keys collapse to one, and lookups take any key Compare accepts
+template <class ValueType, std::size_t Capacity, class Compare = std::less<>>
+class StaticSearchTree
+{
+public:
+    constexpr StaticSearchTree() = default;
+
+    // Values in any order, at most Capacity of them
+    template <std::size_t Count>
+    constexpr explicit StaticSearchTree(const std::array<ValueType, Count> &values, const Compare &compare = Compare());
+
+    constexpr std::size_t getSize() const { return size; }
+    static constexpr std::size_t getCapacity() { return Capacity; }
+    constexpr bool isEmpty() const { return size == 0; }
+
+    template <class KeyType>
+    constexpr bool contains(const KeyType &key) const;
+
+    // First stored value not ordered before key, null when there is none
+    template <class KeyType>
+    constexpr const ValueType* lowerBound(const KeyType &key) const;
+    // First stored value ordered after key, null when there is none
+    template <class KeyType>
+    constexpr const ValueType* upperBound(const KeyType &key) const;
+
+    constexpr const ValueType* getMin() const { return size > 0 ? &nodes[getLeftmost(1)] : nullptr; }
+    constexpr const ValueType* getMax() const { return size > 0 ? &nodes[getRightmost(1)] : nullptr; }
+
+private:
+    // Walks down to a leaf, then drops the trailing right turns to land on the last node where the search went left
+    template <class Predicate>
+    constexpr const ValueType* findFirst(Predicate goesRight) const;
+
+    constexpr std::size_t layout(const std::array<ValueType, Capacity> &sortedValues, std::size_t next, std::size_t node);
+
+    constexpr std::size_t getLeftmost(std::size_t node) const;
+    constexpr std::size_t getRightmost(std::size_t node) const;
+
+    // Index 0 is unused so that the children arithmetic stays 2k and 2k + 1
+    std::array<ValueType, Capacity + 1> nodes{};
+    std::size_t size = 0;
+    Compare compare{};
+};
+
+// Capacity taken from the array, e.g. constexpr auto tree = makeStaticSearchTree(std::array{ 3, 1, 2 })
+template <class Compare = std::less<>, class ValueType, std::size_t Count>
+constexpr StaticSearchTree<ValueType, Count, Compare> makeStaticSearchTree(const std::array<ValueType, Count> &values, const Compare &compare = Compare())
+{
+    return StaticSearchTree<ValueType, Count, Compare>(values, compare);
+}
+
+template <class ValueType, std::size_t Capacity, class Compare> template <std::size_t Count>
+constexpr StaticSearchTree<ValueType, Capacity, Compare>::StaticSearchTree(const std::array<ValueType, Count> &values, const Compare &compare)
+    : compare(compare)
+{
+    static_assert(Count <= Capacity, "more values than the tree can hold");
+
+    // Insertion sort, the std algorithms are not constexpr before C++20. Fine for tables, and linear for sorted input
+    std::array<ValueType, Capacity> sortedValues{};
+    for(std::size_t i = 0; i < Count; i++)
+    {
+        std::size_t position = size;
+        while(position > 0 && compare(values[i], sortedValues[position - 1]))
+        {
+            position--;
+        }
+        if(position > 0 && !compare(sortedValues[position - 1], values[i]))
+        {
+            continue;
+        }
+
+        for(std::size_t j = size; j > position; j--)
+        {
+            sortedValues[j] = sortedValues[j - 1];
+        }
+        sortedValues[position] = values[i];
+        size++;
+    }
+
+    layout(sortedValues, 0, 1);
+}
+
+template <class ValueType, std::size_t Capacity, class Compare> template <class KeyType>
+constexpr bool StaticSearchTree<ValueType, Capacity, Compare>::contains(const KeyType &key) const
+{
+    const ValueType *value = lowerBound(key);
+    return value && !compare(key, *value);
+}
+
+template <class ValueType, std::size_t Capacity, class Compare> template <class KeyType>
+constexpr const ValueType* StaticSearchTree<ValueType, Capacity, Compare>::lowerBound(const KeyType &key) const
+{
+    return findFirst([&key, this](const ValueType &value) { return compare(value, key); });
+}
+
+template <class ValueType, std::size_t Capacity, class Compare> template <class KeyType>
+constexpr const ValueType* StaticSearchTree<ValueType, Capacity, Compare>::upperBound(const KeyType &key) const
+{
+    return findFirst([&key, this](const ValueType &value) { return !compare(key, value); });
+}
+
+template <class ValueType, std::size_t Capacity, class Compare> template <class Predicate>
+constexpr const ValueType* StaticSearchTree<ValueType, Capacity, Compare>::findFirst(Predicate goesRight) const
+{
+    std::size_t node = 1;
+    while(node <= size)
+    {
+        node = 2 * node + (goesRight(nodes[node]) ? 1 : 0);
+    }
+
+    // Every right turn appended a one bit, the answer is where the last left turn was taken
+    while(node & 1)
+    {
+        node >>= 1;
+    }
+    node >>= 1;
+    return node > 0 ? &nodes[node] : nullptr;
+}
+
+template <class ValueType, std::size_t Capacity, class Compare>
+constexpr std::size_t StaticSearchTree<ValueType, Capacity, Compare>::layout(const std::array<ValueType, Capacity> &sortedValues, std::size_t next, std::size_t node)
+{
+    // In-order walk of the implicit tree hands out the sorted values
+    if(node <= size)
+    {
+        next = layout(sortedValues, next, 2 * node);
+        nodes[node] = sortedValues[next++];
+        next = layout(sortedValues, next, 2 * node + 1);
+    }
+    return next;
+}
+
+template <class ValueType, std::size_t Capacity, class Compare>
+constexpr std::size_t StaticSearchTree<ValueType, Capacity, Compare>::getLeftmost(std::size_t node) const
+{
+    while(2 * node <= size)
+    {
+        node *= 2;
+    }
+    return node;
+}
+
+template <class ValueType, std::size_t Capacity, class Compare>
+constexpr std::size_t StaticSearchTree<ValueType, Capacity, Compare>::getRightmost(std::size_t node) const
+{
+    while(2 * node + 1 <= size)
+    {
+        node = 2 * node + 1;
+    }
+    return node;
+}
+
+#endif // STATICSEARCHTREE_H
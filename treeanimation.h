@@ -0,0 +1,228 @@
+#ifndef TREEANIMATION_H
+#define TREEANIMATION_H
+
+#include <unordered_map>
+#include <vector>
+
+#include "binarytreebase.h"
+
+// Light copy of a tree's shape that replays recorded deltas one step at a time. The copy is taken once
+// per operation, after that every step only touches the nodes its delta names.
+template <class ValueType, class Compare = std::less<>, class Stats = DefaultTreeStatsCounter>
+class TreeAnimation
+{
+public:
+    using BinaryTreeNode = typename BinaryTreeBase<ValueType, Compare, Stats>::BinaryTreeNode;
+
+    struct AnimationNode : public BinaryTreeNode
+    {
+        using BinaryTreeNode::BinaryTreeNode;
+
+        virtual shared_ptr<BinaryTreeNode> getParent() const override { return parent.lock(); }
+        virtual shared_ptr<BinaryTreeNode> getLeft() const override { return left; }
+        virtual shared_ptr<BinaryTreeNode> getRight() const override { return right; }
+
+        // Address of the tree node this one stands for
+        const void *id = nullptr;
+
+        shared_ptr<AnimationNode> left;
+        shared_ptr<AnimationNode> right;
+        weak_ptr<AnimationNode> parent;
+    };
+
+    void capture(const BinaryTreeBase<ValueType, Compare, Stats> &tree);
+    // False when the buffer overflowed, the steps would no longer lead to the tree
+    bool setDeltas(const TreeDeltaBuffer<ValueType> &buffer);
+
+    bool hasNextStep() const { return nextDelta < deltas.size(); }
+    // False when the delta names a node the copy does not know, the remaining steps are then dropped
+    bool applyNextStep();
+
+    const shared_ptr<AnimationNode>& getRoot() const { return root; }
+
+private:
+    shared_ptr<AnimationNode> copySubtree(const BinaryTreeBase<ValueType, Compare, Stats> &tree, const shared_ptr<BinaryTreeNode> &node, const shared_ptr<AnimationNode> &parent);
+    shared_ptr<AnimationNode> findNode(const void *id) const;
+
+    void link(const shared_ptr<AnimationNode> &parent, const shared_ptr<AnimationNode> &child, bool isLeft);
+    void transplant(const shared_ptr<AnimationNode> &u, const shared_ptr<AnimationNode> &v);
+    void rotate(const shared_ptr<AnimationNode> &node, bool isLeft);
+
+    shared_ptr<AnimationNode> root;
+    std::unordered_map<const void*, shared_ptr<AnimationNode>> nodesById;
+
+    std::vector<TreeDelta<ValueType>> deltas;
+    size_t nextDelta = 0;
+};
+
+template <class ValueType, class Compare, class Stats>
+void TreeAnimation<ValueType, Compare, Stats>::capture(const BinaryTreeBase<ValueType, Compare, Stats> &tree)
+{
+    nodesById.clear();
+    deltas.clear();
+    nextDelta = 0;
+    root = copySubtree(tree, tree.getRoot(), nullptr);
+}
+
+template <class ValueType, class Compare, class Stats>
+bool TreeAnimation<ValueType, Compare, Stats>::setDeltas(const TreeDeltaBuffer<ValueType> &buffer)
+{
+    deltas.clear();
+    nextDelta = 0;
+    if(buffer.getDroppedCount() > 0)
+    {
+        return false;
+    }
+
+    deltas.reserve(buffer.getSize());
+    for(size_t i = 0; i < buffer.getSize(); i++)
+    {
+        deltas.push_back(buffer[i]);
+    }
+    return true;
+}
+
+template <class ValueType, class Compare, class Stats>
+bool TreeAnimation<ValueType, Compare, Stats>::applyNextStep()
+{
+    const TreeDelta<ValueType> &delta = deltas[nextDelta++];
+    const auto node = findNode(delta.node);
+    const auto other = findNode(delta.other);
+    if((delta.type != TreeDeltaType::Attach && delta.node && !node) || (delta.other && !other))
+    {
+        nextDelta = deltas.size();
+        return false;
+    }
+
+    switch(delta.type)
+    {
+    case TreeDeltaType::Attach:
+    {
+        const auto newNode = std::make_shared<AnimationNode>(delta.value);
+        newNode->id = delta.node;
+        newNode->color = delta.color;
+        nodesById[delta.node] = newNode;
+        if(other)
+        {
+            link(other, newNode, delta.isLeft);
+        }
+        else
+        {
+            root = newNode;
+        }
+        break;
+    }
+    case TreeDeltaType::Detach:
+        transplant(node, nullptr);
+        node->parent.reset();
+        break;
+    case TreeDeltaType::Link:
+        link(node, other, delta.isLeft);
+        break;
+    case TreeDeltaType::Transplant:
+        transplant(node, other);
+        break;
+    case TreeDeltaType::LeftRotate:
+    case TreeDeltaType::RightRotate:
+        rotate(node, delta.type == TreeDeltaType::LeftRotate);
+        break;
+    case TreeDeltaType::Recolor:
+        node->color = delta.color;
+        break;
+    case TreeDeltaType::SetValue:
+        node->value = delta.value;
+        break;
+    case TreeDeltaType::Swap:
+        // Heap nodes trade slots, the shape stays and the contents move
+        if(node != other)
+        {
+            std::swap(node->value, other->value);
+            std::swap(node->color, other->color);
+            std::swap(node->id, other->id);
+            nodesById[node->id] = node;
+            nodesById[other->id] = other;
+        }
+        break;
+    }
+    return true;
+}
+
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename TreeAnimation<ValueType, Compare, Stats>::AnimationNode> TreeAnimation<ValueType, Compare, Stats>::copySubtree(const BinaryTreeBase<ValueType, Compare, Stats> &tree
+                                                                                                                   , const shared_ptr<BinaryTreeNode> &node, const shared_ptr<AnimationNode> &parent)
+{
+    if(!tree.isNodeValid(node))
+    {
+        return nullptr;
+    }
+
+    const auto copy = std::make_shared<AnimationNode>(node->getValue());
+    copy->id = node.get();
+    copy->color = node->getColor();
+    copy->parent = parent;
+    nodesById[copy->id] = copy;
+
+    copy->left = copySubtree(tree, node->getLeft(), copy);
+    copy->right = copySubtree(tree, node->getRight(), copy);
+    return copy;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename TreeAnimation<ValueType, Compare, Stats>::AnimationNode> TreeAnimation<ValueType, Compare, Stats>::findNode(const void *id) const
+{
+    const auto nodeIt = id ? nodesById.find(id) : nodesById.end();
+    return nodeIt != nodesById.end() ? nodeIt->second : nullptr;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void TreeAnimation<ValueType, Compare, Stats>::link(const shared_ptr<AnimationNode> &parent, const shared_ptr<AnimationNode> &child, bool isLeft)
+{
+    (isLeft ? parent->left : parent->right) = child;
+    if(child)
+    {
+        child->parent = parent;
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void TreeAnimation<ValueType, Compare, Stats>::transplant(const shared_ptr<AnimationNode> &u, const shared_ptr<AnimationNode> &v)
+{
+    const auto parent = u->parent.lock();
+    if(!parent)
+    {
+        if(root == u)
+        {
+            root = v;
+        }
+    }
+    else if(parent->left == u)
+    {
+        parent->left = v;
+    }
+    else if(parent->right == u)
+    {
+        parent->right = v;
+    }
+
+    if(v)
+    {
+        v->parent = parent;
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+void TreeAnimation<ValueType, Compare, Stats>::rotate(const shared_ptr<AnimationNode> &node, bool isLeft)
+{
+    const auto newRoot = isLeft ? node->right : node->left;
+    if(!newRoot)
+    {
+        return;
+    }
+
+    const auto movedChild = isLeft ? newRoot->left : newRoot->right;
+    transplant(node, newRoot);
+    link(newRoot, node, isLeft);
+    link(node, movedChild, !isLeft);
+}
+
+#endif // TREEANIMATION_H
@@ -0,0 +1,900 @@
+// Micro benchmarks for the tree structures.
+// Usage: TreeBenchmark [suite] [key count]
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "balancedbinarytree.h"
+#include "binaryheap.h"
+#include "externalpriorityqueue.h"
+#include "multiqueue.h"
+#include "redblacktree.h"
+#include "shardedtree.h"
+#include "splaytree.h"
+#include "staticsearchtree.h"
+#include "treemap.h"
+#include "vanemdeboastree.h"
+#include "workloadgenerator.h"
+
+namespace
+{
+    template <std::size_t Size>
+    struct Payload
+    {
+        char bytes[Size] = {};
+    };
+
+    template <class Function>
+    double measureNanosecondsPerOp(std::size_t operationsCount, Function function)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        function();
+        const double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        return operationsCount > 0 ? elapsed / operationsCount : 0.0;
+    }
+
+    std::vector<int> makeShuffledKeys(std::size_t keysCount)
+    {
+        std::vector<int> keys(keysCount);
+        for(std::size_t i = 0; i < keysCount; i++)
+        {
+            keys[i] = static_cast<int>(i);
+        }
+        std::shuffle(keys.begin(), keys.end(), Xoshiro256(42));
+        return keys;
+    }
+
+    template <class MapType>
+    void benchmarkMap(const char *mapName, const std::vector<int> &keys)
+    {
+        MapType map;
+        long long checksum = 0;
+
+        const double insertNs = measureNanosecondsPerOp(keys.size(), [&]()
+        {
+            for(const int key : keys)
+            {
+                map[key].bytes[0] = static_cast<char>(key);
+            }
+        });
+
+        const double findNs = measureNanosecondsPerOp(keys.size(), [&]()
+        {
+            for(const int key : keys)
+            {
+                const auto found = map.find(key);
+                if constexpr (std::is_pointer_v<decltype(found)>)
+                {
+                    checksum += found ? found->bytes[0] : 0;
+                }
+                else
+                {
+                    checksum += found != map.end() ? found->second.bytes[0] : 0;
+                }
+            }
+        });
+
+        const double eraseNs = measureNanosecondsPerOp(keys.size(), [&]()
+        {
+            for(const int key : keys)
+            {
+                map.erase(key);
+            }
+        });
+
+        std::printf("  %-22s insert %8.1f ns, find %8.1f ns, erase %8.1f ns (checksum %lld)\n", mapName, insertNs, findNs, eraseNs, checksum);
+    }
+
+    template <std::size_t PayloadSize>
+    void benchmarkMaps(const std::vector<int> &keys)
+    {
+        std::printf("%zu-byte values, %zu keys\n", PayloadSize, keys.size());
+        benchmarkMap<std::map<int, Payload<PayloadSize>>>("std::map", keys);
+        benchmarkMap<RedBlackTreeMap<int, Payload<PayloadSize>>>("RedBlackTreeMap", keys);
+        benchmarkMap<AVLTreeMap<int, Payload<PayloadSize>>>("AVLTreeMap", keys);
+    }
+
+    void runMapSuite(std::size_t keysCount)
+    {
+        const std::vector<int> keys = makeShuffledKeys(keysCount);
+        benchmarkMaps<16>(keys);
+        benchmarkMaps<256>(keys);
+    }
+
+    // Keys drawn with probability proportional to 1 / rank^exponent
+    std::vector<int> makeZipfianKeys(std::size_t keysCount, std::size_t samplesCount, double exponent)
+    {
+        WorkloadGenerator generator(KeyDistribution::Zipfian, 0, static_cast<std::int64_t>(keysCount) - 1, 11);
+        generator.setZipfExponent(exponent);
+
+        // Hot ranks are scattered over the key space rather than being the smallest keys
+        const std::vector<int> keys = makeShuffledKeys(keysCount);
+        std::vector<int> samples(samplesCount);
+        for(int &sample : samples)
+        {
+            sample = keys[generator.next()];
+        }
+        return samples;
+    }
+
+    template <class TreeType>
+    void benchmarkLookups(const char *treeName, const std::vector<int> &keys, const std::vector<int> &lookups, TreeType &tree)
+    {
+        for(const int key : keys)
+        {
+            tree.add(key);
+        }
+
+        long long found = 0;
+        const double lookupNs = measureNanosecondsPerOp(lookups.size(), [&]()
+        {
+            for(const int key : lookups)
+            {
+                found += tree.contains(key) ? 1 : 0;
+            }
+        });
+
+        std::printf("  %-22s lookup %8.1f ns (found %lld)\n", treeName, lookupNs, found);
+    }
+
+    void runZipfSuite(std::size_t keysCount)
+    {
+        const std::vector<int> keys = makeShuffledKeys(keysCount);
+        for(const double exponent : { 0.8, 1.0, 1.2 })
+        {
+            std::printf("zipf %.1f lookups, %zu keys\n", exponent, keysCount);
+            const std::vector<int> lookups = makeZipfianKeys(keysCount, keysCount * 20, exponent);
+
+            RedBlackTree<int> redBlackTree;
+            benchmarkLookups("RedBlackTree", keys, lookups, redBlackTree);
+
+            SplayTree<int> splayTree;
+            benchmarkLookups("SplayTree", keys, lookups, splayTree);
+
+            SplayTree<int> semiSplayTree;
+            semiSplayTree.setSemiSplay(true);
+            benchmarkLookups("SplayTree (semi)", keys, lookups, semiSplayTree);
+        }
+    }
+
+    // A compaction fraction of 1 never compacts on its own, the tombstones are then dropped between bursts
+    template <class TreeType>
+    void benchmarkDeleteBursts(const char *treeName, const std::vector<int> &keys, bool lazyDelete, double compactionFraction = 0.5)
+    {
+        TreeType tree;
+        tree.setLazyDelete(lazyDelete);
+        tree.setCompactionFraction(compactionFraction);
+        for(const int key : keys)
+        {
+            tree.add(key);
+        }
+
+        // Sliding window: every round drops the oldest half and appends as many new keys
+        constexpr int roundsCount = 4;
+        const std::size_t burstSize = keys.size() / 2;
+        int nextKey = static_cast<int>(keys.size());
+        int oldestKey = 0;
+        double removeNs = 0.0;
+        double addNs = 0.0;
+        double compactNs = 0.0;
+        for(int round = 0; round < roundsCount; round++)
+        {
+            removeNs += measureNanosecondsPerOp(burstSize, [&]()
+            {
+                for(std::size_t i = 0; i < burstSize; i++)
+                {
+                    tree.remove(oldestKey++);
+                }
+            });
+            compactNs += measureNanosecondsPerOp(burstSize, [&]()
+            {
+                if(compactionFraction >= 1.0)
+                {
+                    tree.compact();
+                }
+            });
+            addNs += measureNanosecondsPerOp(burstSize, [&]()
+            {
+                for(std::size_t i = 0; i < burstSize; i++)
+                {
+                    tree.add(nextKey++);
+                }
+            });
+        }
+
+        long long found = 0;
+        const double lookupNs = measureNanosecondsPerOp(keys.size(), [&]()
+        {
+            for(const int key : keys)
+            {
+                found += tree.contains(key + oldestKey) ? 1 : 0;
+            }
+        });
+
+        std::printf("  %-30s remove %8.1f ns, compact %8.1f ns, add %8.1f ns, lookup %8.1f ns (found %lld)\n", treeName, removeNs / roundsCount, compactNs / roundsCount, addNs / roundsCount, lookupNs, found);
+    }
+
+    void runBurstSuite(std::size_t keysCount)
+    {
+        std::printf("delete bursts, %zu keys\n", keysCount);
+        const std::vector<int> keys = makeShuffledKeys(keysCount);
+        benchmarkDeleteBursts<RedBlackTree<int>>("RedBlackTree", keys, false);
+        benchmarkDeleteBursts<RedBlackTree<int>>("RedBlackTree (lazy)", keys, true);
+        benchmarkDeleteBursts<RedBlackTree<int>>("RedBlackTree (lazy, deferred)", keys, true, 1.0);
+    }
+
+    void runRangeSuite(std::size_t keysCount)
+    {
+        const std::vector<int> keys = makeShuffledKeys(keysCount);
+        const int rangeLength = static_cast<int>(keysCount / 10);
+        const int low = static_cast<int>(keysCount / 3);
+        std::printf("erase %d of %zu keys\n", rangeLength, keysCount);
+
+        RedBlackTree<int> perKeyTree;
+        RedBlackTree<int> rangeTree;
+        for(const int key : keys)
+        {
+            perKeyTree.add(key);
+            rangeTree.add(key);
+        }
+
+        const double perKeyNs = measureNanosecondsPerOp(rangeLength, [&]()
+        {
+            for(int key = low; key < low + rangeLength; key++)
+            {
+                perKeyTree.remove(key);
+            }
+        });
+
+        int erasedCount = 0;
+        const double rangeNs = measureNanosecondsPerOp(rangeLength, [&]()
+        {
+            erasedCount = rangeTree.eraseRange(low, low + rangeLength);
+        });
+
+        std::printf("  remove %.1f ns, eraseRange %.1f ns per key (erased %d)\n", perKeyNs, rangeNs, erasedCount);
+    }
+
+    template <class TreeType>
+    void benchmarkMissingLookups(const char *treeName, const std::vector<int> &keys, const std::vector<int> &lookups, TreeType &tree)
+    {
+        for(const int key : keys)
+        {
+            tree.add(key);
+        }
+
+        long long found = 0;
+        const double lookupNs = measureNanosecondsPerOp(lookups.size(), [&]()
+        {
+            for(const int key : lookups)
+            {
+                found += tree.contains(key) ? 1 : 0;
+            }
+        });
+
+        std::printf("  %-30s lookup %8.1f ns (found %lld)\n", treeName, lookupNs, found);
+    }
+
+    // Nine lookups out of ten miss, keys are even and the missing lookups odd
+    void runBloomSuite(std::size_t keysCount)
+    {
+        std::vector<int> keys = makeShuffledKeys(keysCount);
+        for(int &key : keys)
+        {
+            key *= 2;
+        }
+
+        std::vector<int> lookups(keysCount * 10);
+        std::mt19937 generator(11);
+        for(std::size_t i = 0; i < lookups.size(); i++)
+        {
+            const int key = keys[generator() % keysCount];
+            lookups[i] = i % 10 == 0 ? key : key + 1;
+        }
+
+        std::printf("lookups with 90%% misses, %zu keys\n", keysCount);
+        RedBlackTree<int> plainTree;
+        benchmarkMissingLookups("RedBlackTree", keys, lookups, plainTree);
+
+        RedBlackTree<int> filteredTree;
+        filteredTree.setBloomFilter(keysCount * 10);
+        benchmarkMissingLookups("RedBlackTree (bloom, 10 bits)", keys, lookups, filteredTree);
+    }
+
+    template <class TreeType>
+    void benchmarkNearlySortedAdds(const char *treeName, const std::vector<int> &keys, bool fingerInsertion)
+    {
+        TreeType tree;
+        tree.setFingerInsertion(fingerInsertion);
+        const double addNs = measureNanosecondsPerOp(keys.size(), [&]()
+        {
+            for(const int key : keys)
+            {
+                tree.add(key);
+            }
+        });
+
+        std::printf("  %-30s add %8.1f ns (size %d)\n", treeName, addNs, tree.getSize());
+    }
+
+    // Sorted keys where every key is swapped with one at most eight positions away
+    void runFingerSuite(std::size_t keysCount)
+    {
+        std::vector<int> keys(keysCount);
+        for(std::size_t i = 0; i < keysCount; i++)
+        {
+            keys[i] = static_cast<int>(i);
+        }
+        std::mt19937 generator(5);
+        for(std::size_t i = 0; i + 8 < keysCount; i++)
+        {
+            std::swap(keys[i], keys[i + generator() % 8]);
+        }
+
+        std::printf("nearly sorted adds, %zu keys\n", keysCount);
+        benchmarkNearlySortedAdds<RedBlackTree<int>>("RedBlackTree", keys, false);
+        benchmarkNearlySortedAdds<RedBlackTree<int>>("RedBlackTree (finger)", keys, true);
+        benchmarkNearlySortedAdds<BalancedBinaryTree<int>>("BalancedBinaryTree", keys, false);
+        benchmarkNearlySortedAdds<BalancedBinaryTree<int>>("BalancedBinaryTree (finger)", keys, true);
+    }
+
+    // Every thread alternates a push and a pop, the queue starts with keysCount values
+    template <class Push, class Pop>
+    double measureQueueThroughput(int threadsCount, std::size_t operationsPerThread, Push push, Pop pop)
+    {
+        std::vector<std::thread> threads;
+        const auto start = std::chrono::steady_clock::now();
+        for(int thread = 0; thread < threadsCount; thread++)
+        {
+            threads.emplace_back([&, thread]()
+            {
+                std::mt19937 generator(thread);
+                int value = 0;
+                for(std::size_t i = 0; i < operationsPerThread; i += 2)
+                {
+                    push(static_cast<int>(generator() % 1000000));
+                    pop(value);
+                }
+            });
+        }
+        for(std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return threadsCount * operationsPerThread / elapsed / 1e6;
+    }
+
+    void runMultiQueueSuite(std::size_t keysCount)
+    {
+        constexpr std::size_t operationsPerThread = 200000;
+        std::printf("concurrent push/pop pairs, %zu prefilled values, hardware threads %u\n", keysCount, std::thread::hardware_concurrency());
+
+        for(const int threadsCount : { 1, 2, 4, 8, 16, 32, 64 })
+        {
+            std::mutex mutex;
+            BinaryHeap<int> heap;
+            MultiQueue<int> multiQueue(2 * threadsCount);
+            for(std::size_t i = 0; i < keysCount; i++)
+            {
+                heap.add(static_cast<int>(i));
+                multiQueue.push(static_cast<int>(i));
+            }
+
+            const double lockedMops = measureQueueThroughput(threadsCount, operationsPerThread, [&](int value)
+            {
+                const std::lock_guard<std::mutex> lock(mutex);
+                heap.add(value);
+            }, [&](int &value)
+            {
+                const std::lock_guard<std::mutex> lock(mutex);
+                value = heap.extractMin();
+            });
+
+            const double multiQueueMops = measureQueueThroughput(threadsCount, operationsPerThread, [&](int value)
+            {
+                multiQueue.push(value);
+            }, [&](int &value)
+            {
+                multiQueue.tryPop(value);
+            });
+
+            std::printf("  %2d threads: locked BinaryHeap %7.2f Mops/s, MultiQueue (%zu shards) %7.2f Mops/s\n", threadsCount, lockedMops, multiQueue.getShardsCount(), multiQueueMops);
+        }
+    }
+
+    template <class Add>
+    double measureInsertThroughput(int threadsCount, std::size_t operationsPerThread, Add add)
+    {
+        std::vector<std::thread> threads;
+        const auto start = std::chrono::steady_clock::now();
+        for(int thread = 0; thread < threadsCount; thread++)
+        {
+            threads.emplace_back([&, thread]()
+            {
+                WorkloadGenerator generator(KeyDistribution::Uniform, 0, std::numeric_limits<int>::max(), thread);
+                for(std::size_t i = 0; i < operationsPerThread; i++)
+                {
+                    add(static_cast<int>(generator.next()));
+                }
+            });
+        }
+        for(std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return threadsCount * operationsPerThread / elapsed / 1e6;
+    }
+
+    void runShardedSuite(std::size_t keysCount)
+    {
+        std::printf("concurrent uniform inserts, %zu per thread, hardware threads %u\n", keysCount, std::thread::hardware_concurrency());
+
+        for(const int threadsCount : { 1, 2, 4, 8, 16, 32, 64 })
+        {
+            std::mutex mutex;
+            RedBlackTree<int> lockedTree;
+            const double lockedMops = measureInsertThroughput(threadsCount, keysCount, [&](int value)
+            {
+                const std::lock_guard<std::mutex> lock(mutex);
+                lockedTree.add(value);
+            });
+
+            ShardedTree<int> shardedTree(2 * threadsCount);
+            const double shardedMops = measureInsertThroughput(threadsCount, keysCount, [&](int value)
+            {
+                shardedTree.add(value);
+            });
+
+            std::uint64_t hottestAddsCount = 0;
+            for(const auto &shardStats : shardedTree.getShardStats())
+            {
+                hottestAddsCount = std::max(hottestAddsCount, shardStats.addsCount);
+            }
+            std::printf("  %2d threads: locked RedBlackTree %7.2f Mops/s, ShardedTree (%zu shards, %llu rebalances, hottest shard %.0f%% of adds) %7.2f Mops/s\n"
+                        , threadsCount, lockedMops, shardedTree.getShardsCount(), static_cast<unsigned long long>(shardedTree.getRebalancesCount())
+                        , 100.0 * hottestAddsCount / (threadsCount * keysCount), shardedMops);
+        }
+    }
+
+    void printMemoryUsage(const char *structureName, const MemoryUsage &usage)
+    {
+        std::printf("  %-26s %7.1f bytes/key: nodes %zu, control blocks %zu, auxiliary %zu, slack %zu\n", structureName, usage.getBytesPerKey()
+                    , usage.nodeBytes, usage.controlBlockBytes, usage.auxiliaryBytes, usage.slackBytes);
+    }
+
+    template <class TreeType>
+    void measureTreeMemory(const char *treeName, const std::vector<int> &keys)
+    {
+        TreeType tree;
+        for(const int key : keys)
+        {
+            tree.add(key);
+        }
+        printMemoryUsage(treeName, tree.memoryUsage());
+    }
+
+    void runMemorySuite(std::size_t keysCount)
+    {
+        const std::vector<int> keys = makeShuffledKeys(keysCount);
+        std::printf("estimated footprint, %zu int keys\n", keysCount);
+
+        measureTreeMemory<BinarySearchTree<int>>("BinarySearchTree", keys);
+        measureTreeMemory<BalancedBinaryTree<int>>("BalancedBinaryTree", keys);
+        measureTreeMemory<RedBlackTree<int>>("RedBlackTree", keys);
+        measureTreeMemory<SplayTree<int>>("SplayTree", keys);
+        measureTreeMemory<BinaryHeap<int>>("BinaryHeap", keys);
+
+        RedBlackTree<int> filteredTree;
+        filteredTree.setBloomFilter(keysCount * 10);
+        for(const int key : keys)
+        {
+            filteredTree.add(key);
+        }
+        printMemoryUsage("RedBlackTree (bloom)", filteredTree.memoryUsage());
+
+        RedBlackTreeMap<int, Payload<16>> map;
+        for(const int key : keys)
+        {
+            map[key].bytes[0] = static_cast<char>(key);
+        }
+        printMemoryUsage("RedBlackTreeMap (16 B)", map.memoryUsage());
+
+        // Reference point: a libstdc++ std::set node is three pointers and a color word before the key
+        MemoryUsage setUsage;
+        setUsage.keysCount = keysCount;
+        setUsage.addAllocations(keysCount, 4 * sizeof(void*) + sizeof(int));
+        printMemoryUsage("std::set (estimate)", setUsage);
+    }
+
+    void runBulkSuite(std::size_t keysCount)
+    {
+        std::vector<int> keys(keysCount);
+        std::mt19937 generator(13);
+        for(int &key : keys)
+        {
+            key = static_cast<int>(generator() % (keysCount * 2));
+        }
+
+        std::printf("build from %zu unsorted keys\n", keysCount);
+        const double addNs = measureNanosecondsPerOp(keys.size(), [&]()
+        {
+            RedBlackTree<int> tree;
+            for(const int key : keys)
+            {
+                tree.add(key);
+            }
+        });
+
+        for(const unsigned threadsCount : { 1u, getDefaultThreadsCount() })
+        {
+            const double bulkNs = measureNanosecondsPerOp(keys.size(), [&]()
+            {
+                RedBlackTree<int> tree;
+                tree.bulkAdd(keys, threadsCount);
+            });
+            std::printf("  RedBlackTree add %.1f ns, bulkAdd on %u threads %.1f ns per key\n", addNs, threadsCount, bulkNs);
+        }
+    }
+
+    void runTopKSuite(std::size_t keysCount)
+    {
+        constexpr std::size_t topCount = 100;
+        const std::size_t streamLength = keysCount * 1000;
+        std::vector<int> stream(streamLength);
+        std::mt19937 generator(7);
+        for(int &value : stream)
+        {
+            value = static_cast<int>(generator());
+        }
+
+        std::printf("top %zu of %zu values\n", topCount, streamLength);
+        long long checksum = 0;
+
+        const double addNs = measureNanosecondsPerOp(streamLength, [&]()
+        {
+            BinaryHeap<int> heap;
+            heap.setBoundedCapacity(topCount);
+            for(const int value : stream)
+            {
+                heap.add(value);
+            }
+            checksum += heap.drain().back();
+        });
+
+        const double pushManyNs = measureNanosecondsPerOp(streamLength, [&]()
+        {
+            BinaryHeap<int> heap;
+            heap.setBoundedCapacity(topCount);
+            heap.pushMany(stream.data(), stream.size());
+            checksum += heap.drain().back();
+        });
+
+        const double partialSortNs = measureNanosecondsPerOp(streamLength, [&]()
+        {
+            std::vector<int> copy = stream;
+            std::partial_sort(copy.begin(), copy.begin() + topCount, copy.end(), std::greater<>());
+            checksum += copy.front();
+        });
+
+        std::printf("  add %.2f ns, pushMany %.2f ns, std::partial_sort %.2f ns per value (checksum %lld)\n", addNs, pushManyNs, partialSortNs, checksum);
+    }
+
+    // Every value pushed, then every value extracted, with the external queue capped at a small share of them in memory
+    void runExternalSuite(std::size_t keysCount)
+    {
+        const std::size_t valuesCount = keysCount * 100;
+        std::vector<int> values;
+        WorkloadGenerator(KeyDistribution::Uniform, 0, std::numeric_limits<int>::max(), 11).generate(valuesCount, values);
+        std::printf("push then extract %zu values\n", valuesCount);
+
+        long long checksum = 0;
+        const double heapNs = measureNanosecondsPerOp(valuesCount, [&]()
+        {
+            BinaryHeap<int> heap;
+            for(const int value : values)
+            {
+                heap.add(value);
+            }
+            for(std::size_t i = 0; i < valuesCount; i++)
+            {
+                checksum += heap.extractMin();
+            }
+        });
+        std::printf("  BinaryHeap                 %8.2f ns per value\n", heapNs);
+
+        for(const std::size_t bufferCapacity : { valuesCount / 64, valuesCount / 16 })
+        {
+            ExternalPriorityQueue<int> queue(std::max<std::size_t>(bufferCapacity, 1), 4096);
+            std::size_t peakRunsCount = 0;
+            std::size_t peakMemoryBytes = 0;
+            const double externalNs = measureNanosecondsPerOp(valuesCount, [&]()
+            {
+                for(const int value : values)
+                {
+                    queue.push(value);
+                }
+                peakRunsCount = queue.getRunsCount();
+                peakMemoryBytes = queue.memoryUsage().getTotalBytes();
+                for(std::size_t i = 0; i < valuesCount; i++)
+                {
+                    checksum += queue.extractMin();
+                }
+            });
+            std::printf("  ExternalPriorityQueue 1/%-3zu %8.2f ns per value, %zu runs, %.1f MiB in memory, %llu values written%s\n"
+                        , valuesCount / std::max<std::size_t>(bufferCapacity, 1), externalNs, peakRunsCount, peakMemoryBytes / 1048576.0
+                        , static_cast<unsigned long long>(queue.getWrittenCount()), queue.hasFailed() ? ", I/O failed" : "");
+        }
+        std::printf("  (checksum %lld)\n", checksum);
+    }
+
+    // Generation cost of each distribution, then a red black tree filled one add at a time and in one bulk build
+    void runWorkloadSuite(std::size_t keysCount)
+    {
+        std::printf("workload generator, %zu keys\n", keysCount);
+        for(const KeyDistribution distribution : { KeyDistribution::Uniform, KeyDistribution::Zipfian, KeyDistribution::Sorted
+                                                 , KeyDistribution::ReverseSorted, KeyDistribution::NearlySorted, KeyDistribution::Sawtooth })
+        {
+            const std::int64_t high = static_cast<std::int64_t>(keysCount) - 1;
+            std::vector<int> keys;
+            const double generateNs = measureNanosecondsPerOp(keysCount, [&]()
+            {
+                WorkloadGenerator generator(distribution, 0, high, 3);
+                generator.generate(keysCount, keys);
+            });
+
+            const double addNs = measureNanosecondsPerOp(keysCount, [&]()
+            {
+                RedBlackTree<int> tree;
+                for(const int key : keys)
+                {
+                    tree.add(key);
+                }
+            });
+
+            const double fillNs = measureNanosecondsPerOp(keysCount, [&]()
+            {
+                RedBlackTree<int> tree;
+                WorkloadGenerator generator(distribution, 0, high, 3);
+                tree.fill(generator, keysCount);
+            });
+
+            std::printf("  %-14s generate %6.2f ns, RedBlackTree add %8.1f ns, fill %8.1f ns per key\n", getKeyDistributionName(distribution), generateNs, addNs, fillNs);
+        }
+    }
+
+    // Successor queries on 32 bit keys, the van Emde Boas tree against the comparison based sets
+    void runIntegerSuite(std::size_t keysCount)
+    {
+        std::vector<int> keys;
+        std::vector<int> queries;
+        WorkloadGenerator keyGenerator(KeyDistribution::Uniform, std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), 17);
+        keyGenerator.generate(keysCount, keys);
+        keyGenerator.generate(keysCount * 10, queries);
+
+        std::printf("successor queries on %zu random 32 bit keys\n", keysCount);
+        long long checksum = 0;
+
+        VanEmdeBoasTree<int> vanEmdeBoasTree;
+        const double vebAddNs = measureNanosecondsPerOp(keys.size(), [&]()
+        {
+            for(const int key : keys)
+            {
+                vanEmdeBoasTree.add(key);
+            }
+        });
+        const double vebSuccessorNs = measureNanosecondsPerOp(queries.size(), [&]()
+        {
+            for(const int query : queries)
+            {
+                int successor = 0;
+                checksum += vanEmdeBoasTree.getSuccessor(query, successor) ? successor : 0;
+            }
+        });
+        const double vebRemoveNs = measureNanosecondsPerOp(keys.size(), [&]()
+        {
+            for(const int key : keys)
+            {
+                vanEmdeBoasTree.remove(key);
+            }
+        });
+        std::printf("  %-22s add %8.1f ns, successor %8.1f ns, remove %8.1f ns\n", "VanEmdeBoasTree", vebAddNs, vebSuccessorNs, vebRemoveNs);
+
+        std::set<int> set;
+        const double setAddNs = measureNanosecondsPerOp(keys.size(), [&]()
+        {
+            for(const int key : keys)
+            {
+                set.insert(key);
+            }
+        });
+        const double setSuccessorNs = measureNanosecondsPerOp(queries.size(), [&]()
+        {
+            for(const int query : queries)
+            {
+                const auto successorIt = set.upper_bound(query);
+                checksum -= successorIt != set.end() ? *successorIt : 0;
+            }
+        });
+        const double setRemoveNs = measureNanosecondsPerOp(keys.size(), [&]()
+        {
+            for(const int key : keys)
+            {
+                set.erase(key);
+            }
+        });
+        std::printf("  %-22s add %8.1f ns, successor %8.1f ns, remove %8.1f ns (checksum %lld)\n", "std::set", setAddNs, setSuccessorNs, setRemoveNs, checksum);
+    }
+
+    constexpr std::size_t staticKeysCount = 4096;
+
+    constexpr std::array<int, staticKeysCount> makeStaticKeys()
+    {
+        std::array<int, staticKeysCount> keys{};
+        for(std::size_t i = 0; i < staticKeysCount; i++)
+        {
+            keys[i] = static_cast<int>(3 * i);
+        }
+        return keys;
+    }
+
+    // Built by the compiler, the suite only reads it
+    constexpr auto staticTree = makeStaticSearchTree(makeStaticKeys());
+
+    // Lookups in a fixed table: the compile time tree against a runtime tree and binary search over a sorted array
+    void runStaticSuite(std::size_t lookupsCount)
+    {
+        const std::array<int, staticKeysCount> keys = makeStaticKeys();
+        std::vector<int> lookups;
+        WorkloadGenerator generator(KeyDistribution::Uniform, 0, 3 * static_cast<std::int64_t>(staticKeysCount), 9);
+        generator.generate(lookupsCount * 100, lookups);
+
+        std::printf("static table of %zu keys, %zu lookups\n", staticKeysCount, lookups.size());
+        long long found = 0;
+        const double staticNs = measureNanosecondsPerOp(lookups.size(), [&]()
+        {
+            for(const int key : lookups)
+            {
+                found += staticTree.contains(key) ? 1 : 0;
+            }
+        });
+
+        const double sortedArrayNs = measureNanosecondsPerOp(lookups.size(), [&]()
+        {
+            for(const int key : lookups)
+            {
+                found += std::binary_search(keys.begin(), keys.end(), key) ? 1 : 0;
+            }
+        });
+
+        RedBlackTree<int> redBlackTree;
+        redBlackTree.bulkAdd(std::vector<int>(keys.begin(), keys.end()));
+        const double redBlackTreeNs = measureNanosecondsPerOp(lookups.size(), [&]()
+        {
+            for(const int key : lookups)
+            {
+                found += redBlackTree.contains(key) ? 1 : 0;
+            }
+        });
+
+        std::printf("  StaticSearchTree %.1f ns, std::binary_search %.1f ns, RedBlackTree %.1f ns per lookup (found %lld)\n", staticNs, sortedArrayNs, redBlackTreeNs, found);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const std::string suite = argc > 1 ? argv[1] : "all";
+    const std::size_t keysCount = argc > 2 ? std::stoul(argv[2]) : 5000;
+
+    bool ranSuite = false;
+    if(suite == "all" || suite == "map")
+    {
+        runMapSuite(keysCount);
+        ranSuite = true;
+    }
+
+    if(suite == "all" || suite == "zipf")
+    {
+        runZipfSuite(keysCount);
+        ranSuite = true;
+    }
+
+    if(suite == "all" || suite == "burst")
+    {
+        runBurstSuite(keysCount);
+        ranSuite = true;
+    }
+
+    if(suite == "all" || suite == "range")
+    {
+        runRangeSuite(keysCount);
+        ranSuite = true;
+    }
+
+    if(suite == "all" || suite == "bloom")
+    {
+        runBloomSuite(keysCount);
+        ranSuite = true;
+    }
+
+    if(suite == "all" || suite == "finger")
+    {
+        runFingerSuite(keysCount);
+        ranSuite = true;
+    }
+
+    if(suite == "all" || suite == "multiqueue")
+    {
+        runMultiQueueSuite(keysCount);
+        ranSuite = true;
+    }
+
+    if(suite == "all" || suite == "sharded")
+    {
+        runShardedSuite(keysCount);
+        ranSuite = true;
+    }
+
+    if(suite == "all" || suite == "bulk")
+    {
+        runBulkSuite(keysCount);
+        ranSuite = true;
+    }
+
+    if(suite == "all" || suite == "memory")
+    {
+        runMemorySuite(keysCount);
+        ranSuite = true;
+    }
+
+    if(suite == "all" || suite == "topk")
+    {
+        runTopKSuite(keysCount);
+        ranSuite = true;
+    }
+
+    if(suite == "all" || suite == "external")
+    {
+        runExternalSuite(keysCount);
+        ranSuite = true;
+    }
+
+    if(suite == "all" || suite == "workload")
+    {
+        runWorkloadSuite(keysCount);
+        ranSuite = true;
+    }
+
+    if(suite == "all" || suite == "static")
+    {
+        runStaticSuite(keysCount);
+        ranSuite = true;
+    }
+
+    if(suite == "all" || suite == "integer")
+    {
+        runIntegerSuite(keysCount);
+        ranSuite = true;
+    }
+
+    if(!ranSuite)
+    {
+        std::fprintf(stderr, "unknown suite %s\n", suite.c_str());
+        return 2;
+    }
+
+    return 0;
+}
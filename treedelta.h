@@ -0,0 +1,92 @@
+#ifndef TREEDELTA_H
+#define TREEDELTA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <QColor>
+
+// One structural step of a tree operation. Nodes are named by address, which stays stable for the whole operation;
+// a sentinel or missing node is null. Replaying the steps in order on a copy of the tree taken before the operation
+// reproduces the tree after it, so an animation only pays for what changed.
+enum class TreeDeltaType : std::uint8_t
+{
+    Attach,       // node with value and color hangs below other on the isLeft side, at the root without other
+    Detach,       // node is cut from its parent
+    Link,         // other becomes the isLeft child of node
+    Transplant,   // other takes the place of node below node's parent
+    LeftRotate,   // node's right child rotates above it
+    RightRotate,  // node's left child rotates above it
+    Recolor,      // node gets color
+    SetValue,     // node gets value
+    Swap          // node and other trade places, heaps only
+};
+
+template <class ValueType>
+struct TreeDelta
+{
+    TreeDeltaType type = TreeDeltaType::Link;
+    bool isLeft = false;
+    const void *node = nullptr;
+    const void *other = nullptr;
+    QColor color;
+    ValueType value{};
+};
+
+// Fixed size ring of the latest deltas, older ones are overwritten once it is full
+template <class ValueType>
+class TreeDeltaBuffer
+{
+public:
+    explicit TreeDeltaBuffer(std::size_t capacity = 4096)
+        : deltas(capacity)
+    {}
+
+    void push(TreeDelta<ValueType> &&delta);
+    void clear();
+
+    std::size_t getSize() const { return size; }
+    // Deltas lost to overwriting since the last clear
+    std::size_t getDroppedCount() const { return droppedCount; }
+
+    // Oldest first
+    const TreeDelta<ValueType>& operator[](std::size_t index) const { return deltas[(first + index) % deltas.size()]; }
+
+private:
+    std::vector<TreeDelta<ValueType>> deltas;
+    std::size_t first = 0;
+    std::size_t size = 0;
+    std::size_t droppedCount = 0;
+};
+
+template <class ValueType>
+inline void TreeDeltaBuffer<ValueType>::push(TreeDelta<ValueType> &&delta)
+{
+    if(deltas.empty())
+    {
+        droppedCount++;
+        return;
+    }
+
+    if(size == deltas.size())
+    {
+        deltas[first] = std::move(delta);
+        first = (first + 1) % deltas.size();
+        droppedCount++;
+        return;
+    }
+
+    deltas[(first + size) % deltas.size()] = std::move(delta);
+    size++;
+}
+
+template <class ValueType>
+inline void TreeDeltaBuffer<ValueType>::clear()
+{
+    first = 0;
+    size = 0;
+    droppedCount = 0;
+}
+
+#endif // TREEDELTA_H
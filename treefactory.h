@@ -0,0 +1,60 @@
+#ifndef TREEFACTORY_H
+#define TREEFACTORY_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "balancedbinarytree.h"
+#include "binaryheap.h"
+#include "redblacktree.h"
+#include "splaytree.h"
+#include "vanemdeboastree.h"
+
+inline const std::vector<std::string>& getBinaryTreeNames()
+{
+    static const std::vector<std::string> treeNames = { "Binary Search Tree", "AVL Tree", "Red Black Tree", "Splay Tree", "Heap", "Van Emde Boas Tree" };
+    return treeNames;
+}
+
+// Null for an unknown name, or for the van Emde Boas tree with keys other than integers of up to 32 bits
+template <class ValueType, class Compare = std::less<>, class Stats = DefaultTreeStatsCounter>
+std::unique_ptr<BinaryTreeBase<ValueType, Compare, Stats>> createBinaryTree(const std::string &treeName)
+{
+    if(treeName == "Binary Search Tree")
+    {
+        return std::make_unique<BinarySearchTree<ValueType, Compare, Stats>>();
+    }
+
+    if(treeName == "AVL Tree")
+    {
+        return std::make_unique<BalancedBinaryTree<ValueType, Compare, Stats>>();
+    }
+
+    if(treeName == "Red Black Tree")
+    {
+        return std::make_unique<RedBlackTree<ValueType, Compare, Stats>>();
+    }
+
+    if(treeName == "Splay Tree")
+    {
+        return std::make_unique<SplayTree<ValueType, Compare, Stats>>();
+    }
+
+    if(treeName == "Heap")
+    {
+        return std::make_unique<BinaryHeap<ValueType, Compare, Stats>>();
+    }
+
+    if(treeName == "Van Emde Boas Tree")
+    {
+        if constexpr (isVanEmdeBoasKey<ValueType, Compare>)
+        {
+            return std::make_unique<VanEmdeBoasTree<ValueType, Compare, Stats>>();
+        }
+    }
+
+    return nullptr;
+}
+
+#endif // TREEFACTORY_H
@@ -0,0 +1,156 @@
+#ifndef TREEMAP_H
+#define TREEMAP_H
+
+#include <cstddef>
+#include <memory>
+
+#include "balancedbinarytree.h"
+#include "redblacktree.h"
+
+// Map entry stored as the tree value. Only the key sits in the node; the mapped value
+// lives in its own allocation so searches never pull it into cache.
+template <class Key, class Value>
+struct TreeMapEntry
+{
+    TreeMapEntry() = default;
+
+    TreeMapEntry(Key key, std::unique_ptr<Value> value)
+        : key(std::move(key))
+        , value(std::move(value))
+    {}
+
+    TreeMapEntry(const TreeMapEntry &other)
+        : key(other.key)
+        , value(other.value ? std::make_unique<Value>(*other.value) : nullptr)
+    {}
+
+    TreeMapEntry(TreeMapEntry&&) = default;
+
+    TreeMapEntry& operator=(const TreeMapEntry &other)
+    {
+        if(this != &other)
+        {
+            key = other.key;
+            value = other.value ? std::make_unique<Value>(*other.value) : nullptr;
+        }
+        return *this;
+    }
+
+    TreeMapEntry& operator=(TreeMapEntry&&) = default;
+
+    Key key;
+    std::unique_ptr<Value> value;
+};
+
+// Orders entries by key and lets the trees search by a bare key
+template <class KeyCompare>
+struct TreeMapEntryCompare
+{
+    using is_transparent = void;
+
+    template <class Key, class Value>
+    bool operator()(const TreeMapEntry<Key, Value> &left, const TreeMapEntry<Key, Value> &right) const { return keyCompare(left.key, right.key); }
+
+    template <class Key, class Value, class OtherKey>
+    bool operator()(const TreeMapEntry<Key, Value> &left, const OtherKey &right) const { return keyCompare(left.key, right); }
+
+    template <class OtherKey, class Key, class Value>
+    bool operator()(const OtherKey &left, const TreeMapEntry<Key, Value> &right) const { return keyCompare(left, right.key); }
+
+    KeyCompare keyCompare;
+};
+
+template <class Key, class Value, template <class, class, class> class TreeType = RedBlackTree, class KeyCompare = std::less<>, class Stats = DefaultTreeStatsCounter>
+class TreeMap
+{
+public:
+    using Entry = TreeMapEntry<Key, Value>;
+    using EntryCompare = TreeMapEntryCompare<KeyCompare>;
+
+    Value& operator[](const Key &key);
+    bool insertOrAssign(const Key &key, Value value);
+    bool erase(const Key &key);
+
+    Value* find(const Key &key) { return tree.findValue(key); }
+    const Value* find(const Key &key) const { return tree.findValue(key); }
+
+    std::size_t size() const { return entriesCount; }
+    bool empty() const { return entriesCount == 0; }
+
+    const BinaryTreeBase<Entry, EntryCompare, Stats>& getTree() const { return tree; }
+
+    // The tree's usage plus the mapped values, each in its own allocation
+    MemoryUsage memoryUsage() const;
+
+private:
+    class Tree : public TreeType<Entry, EntryCompare, Stats>
+    {
+    public:
+        Value* findValue(const Key &key) const
+        {
+            const auto node = this->getNodeForKey(key);
+            return this->isNodeValid(node) ? node->value.value.get() : nullptr;
+        }
+    };
+
+    Tree tree;
+    std::size_t entriesCount = 0;
+};
+
+template <class Key, class Value, template <class, class, class> class TreeType, class KeyCompare, class Stats>
+Value& TreeMap<Key, Value, TreeType, KeyCompare, Stats>::operator[](const Key &key)
+{
+    if(Value* value = find(key))
+    {
+        return *value;
+    }
+
+    auto value = std::make_unique<Value>();
+    Value &valueRef = *value;
+    tree.add(Entry(key, std::move(value)));
+    entriesCount++;
+    return valueRef;
+}
+
+template <class Key, class Value, template <class, class, class> class TreeType, class KeyCompare, class Stats>
+bool TreeMap<Key, Value, TreeType, KeyCompare, Stats>::insertOrAssign(const Key &key, Value value)
+{
+    if(Value* existingValue = find(key))
+    {
+        *existingValue = std::move(value);
+        return false;
+    }
+
+    tree.add(Entry(key, std::make_unique<Value>(std::move(value))));
+    entriesCount++;
+    return true;
+}
+
+template <class Key, class Value, template <class, class, class> class TreeType, class KeyCompare, class Stats>
+bool TreeMap<Key, Value, TreeType, KeyCompare, Stats>::erase(const Key &key)
+{
+    // Trees remove by value, an entry with an empty payload compares equal on the key
+    if(!tree.remove(Entry(key, nullptr)))
+    {
+        return false;
+    }
+
+    entriesCount--;
+    return true;
+}
+
+template <class Key, class Value, template <class, class, class> class TreeType, class KeyCompare, class Stats>
+MemoryUsage TreeMap<Key, Value, TreeType, KeyCompare, Stats>::memoryUsage() const
+{
+    MemoryUsage usage = tree.memoryUsage();
+    usage.addAllocations(entriesCount, sizeof(Value));
+    return usage;
+}
+
+template <class Key, class Value, class KeyCompare = std::less<>, class Stats = DefaultTreeStatsCounter>
+using RedBlackTreeMap = TreeMap<Key, Value, RedBlackTree, KeyCompare, Stats>;
+
+template <class Key, class Value, class KeyCompare = std::less<>, class Stats = DefaultTreeStatsCounter>
+using AVLTreeMap = TreeMap<Key, Value, BalancedBinaryTree, KeyCompare, Stats>;
+
+#endif // TREEMAP_H
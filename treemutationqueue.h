@@ -0,0 +1,315 @@
+#ifndef TREEMUTATIONQUEUE_H
+#define TREEMUTATIONQUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "binarytreebase.h"
+#include "treeanimation.h"
+
+// Applies adds, removes and tasks to a tree on a worker thread, so the thread queuing them never waits on the tree.
+// The worker takes whatever is pending as one batch. Between tasks, on a tree without duplicates the adds and removes
+// of a key coalesce to the last one: an add followed by a remove of a key the tree does not hold costs one lookup.
+// A tree that allows duplicates, like the heap, counts every add, so its mutations are applied in order instead.
+// The adds left, or every run of adds in order, go in through addValues, a bulk build on the search trees.
+// Properties, and on request the animation of a batch that was a single add or remove, are published once per batch
+template <class ValueType, class Compare = std::less<>, class Stats = DefaultTreeStatsCounter>
+class TreeMutationQueue
+{
+public:
+    using Tree = BinaryTreeBase<ValueType, Compare, Stats>;
+
+    struct BatchResult
+    {
+        // Queued operations the batch covered, and the adds and removes applied after coalescing
+        std::size_t operationsCount = 0;
+        std::size_t appliedCount = 0;
+        std::unordered_map<std::string, int> properties;
+        // Set when the batch was one add or remove that changed the tree
+        std::shared_ptr<TreeAnimation<ValueType, Compare, Stats>> animation;
+    };
+
+    // Called on the worker thread after every batch, with the tree already unlocked
+    using BatchCallback = std::function<void(const BatchResult&)>;
+
+    explicit TreeMutationQueue(Tree &tree, BatchCallback onBatch = nullptr, std::size_t maxBatchSize = 65536);
+    // Finishes everything queued before returning
+    ~TreeMutationQueue();
+
+    TreeMutationQueue(const TreeMutationQueue&) = delete;
+    TreeMutationQueue& operator=(const TreeMutationQueue&) = delete;
+
+    void add(const ValueType &value);
+    void remove(const ValueType &value);
+    // Runs after everything queued before it, and nothing queued after it is coalesced across it
+    void run(std::function<void(Tree&)> task);
+
+    void waitUntilIdle();
+
+    // Off by default, the animation copies the whole tree before the change
+    void setAnimateSingleMutations(bool enabled) { animateSingleMutations = enabled; }
+
+    // Keeps the worker off the tree while held, for reading the tree from another thread.
+    // The try version does not wait for a running batch
+    std::unique_lock<std::mutex> lockTree() { return std::unique_lock<std::mutex>(treeMutex); }
+    std::unique_lock<std::mutex> tryLockTree() { return std::unique_lock<std::mutex>(treeMutex, std::try_to_lock); }
+
+private:
+    enum class MutationType
+    {
+        Add,
+        Remove,
+        Task
+    };
+
+    struct Mutation
+    {
+        MutationType type = MutationType::Add;
+        ValueType value{};
+        std::function<void(Tree&)> task;
+    };
+
+    void push(Mutation &&mutation);
+    void runWorker();
+    void applyBatch(std::vector<Mutation> &batch, BatchResult &outResult);
+    std::size_t applyCoalesced(typename std::vector<Mutation>::iterator begin, typename std::vector<Mutation>::iterator end);
+    std::size_t applyInOrder(typename std::vector<Mutation>::iterator begin, typename std::vector<Mutation>::iterator end);
+    void addAll(std::vector<ValueType> &&values);
+    bool applySingleAnimated(const Mutation &mutation, BatchResult &outResult);
+
+    Tree &tree;
+    BatchCallback onBatch;
+    std::size_t maxBatchSize;
+
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::deque<Mutation> pending;
+    bool isApplying = false;
+    bool isStopping = false;
+
+    std::mutex treeMutex;
+    TreeDeltaBuffer<ValueType> deltaBuffer;
+    std::atomic<bool> animateSingleMutations{false};
+
+    // Started last, everything it reads is constructed by then
+    std::thread worker;
+};
+
+template <class ValueType, class Compare, class Stats>
+TreeMutationQueue<ValueType, Compare, Stats>::TreeMutationQueue(Tree &tree, BatchCallback onBatch, std::size_t maxBatchSize)
+    : tree(tree)
+    , onBatch(std::move(onBatch))
+    , maxBatchSize(std::max<std::size_t>(maxBatchSize, 1))
+    , worker([this]() { runWorker(); })
+{
+}
+
+template <class ValueType, class Compare, class Stats>
+TreeMutationQueue<ValueType, Compare, Stats>::~TreeMutationQueue()
+{
+    {
+        const std::lock_guard<std::mutex> lock(queueMutex);
+        isStopping = true;
+    }
+    queueChanged.notify_all();
+    worker.join();
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void TreeMutationQueue<ValueType, Compare, Stats>::add(const ValueType &value)
+{
+    push({ MutationType::Add, value, nullptr });
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void TreeMutationQueue<ValueType, Compare, Stats>::remove(const ValueType &value)
+{
+    push({ MutationType::Remove, value, nullptr });
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void TreeMutationQueue<ValueType, Compare, Stats>::run(std::function<void(Tree&)> task)
+{
+    push({ MutationType::Task, ValueType{}, std::move(task) });
+}
+
+template <class ValueType, class Compare, class Stats>
+void TreeMutationQueue<ValueType, Compare, Stats>::waitUntilIdle()
+{
+    std::unique_lock<std::mutex> lock(queueMutex);
+    queueChanged.wait(lock, [this]() { return pending.empty() && !isApplying; });
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void TreeMutationQueue<ValueType, Compare, Stats>::push(Mutation &&mutation)
+{
+    {
+        const std::lock_guard<std::mutex> lock(queueMutex);
+        pending.push_back(std::move(mutation));
+    }
+    queueChanged.notify_all();
+}
+
+template <class ValueType, class Compare, class Stats>
+void TreeMutationQueue<ValueType, Compare, Stats>::runWorker()
+{
+    std::vector<Mutation> batch;
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            isApplying = false;
+            queueChanged.notify_all();
+            queueChanged.wait(lock, [this]() { return !pending.empty() || isStopping; });
+            if(pending.empty())
+            {
+                return;
+            }
+
+            batch.clear();
+            while(!pending.empty() && batch.size() < maxBatchSize)
+            {
+                batch.push_back(std::move(pending.front()));
+                pending.pop_front();
+            }
+            isApplying = true;
+        }
+
+        BatchResult result;
+        applyBatch(batch, result);
+        if(onBatch)
+        {
+            onBatch(result);
+        }
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+void TreeMutationQueue<ValueType, Compare, Stats>::applyBatch(std::vector<Mutation> &batch, BatchResult &outResult)
+{
+    const std::lock_guard<std::mutex> lock(treeMutex);
+    outResult.operationsCount = batch.size();
+
+    if(animateSingleMutations && batch.size() == 1 && batch[0].type != MutationType::Task)
+    {
+        outResult.appliedCount = applySingleAnimated(batch[0], outResult) ? 1 : 0;
+    }
+    else
+    {
+        // Tasks split the batch, the mutations between two of them coalesce
+        auto segmentBegin = batch.begin();
+        for(auto mutationIt = batch.begin(); mutationIt != batch.end(); ++mutationIt)
+        {
+            if(mutationIt->type == MutationType::Task)
+            {
+                outResult.appliedCount += applyCoalesced(segmentBegin, mutationIt);
+                mutationIt->task(tree);
+                segmentBegin = mutationIt + 1;
+            }
+        }
+        outResult.appliedCount += applyCoalesced(segmentBegin, batch.end());
+    }
+
+    tree.buildProperties(outResult.properties);
+}
+
+template <class ValueType, class Compare, class Stats>
+std::size_t TreeMutationQueue<ValueType, Compare, Stats>::applyCoalesced(typename std::vector<Mutation>::iterator begin, typename std::vector<Mutation>::iterator end)
+{
+    if(tree.allowsDuplicates())
+    {
+        return applyInOrder(begin, end);
+    }
+
+    // The last mutation of every key wins, keyed by the tree's own order
+    std::map<ValueType, MutationType, Compare> lastMutations;
+    for(auto mutationIt = begin; mutationIt != end; ++mutationIt)
+    {
+        lastMutations[mutationIt->value] = mutationIt->type;
+    }
+
+    std::vector<ValueType> addedValues;
+    for(auto &[value, type] : lastMutations)
+    {
+        if(type == MutationType::Remove)
+        {
+            tree.remove(value);
+        }
+        else
+        {
+            addedValues.push_back(value);
+        }
+    }
+
+    addAll(std::move(addedValues));
+    return lastMutations.size();
+}
+
+template <class ValueType, class Compare, class Stats>
+std::size_t TreeMutationQueue<ValueType, Compare, Stats>::applyInOrder(typename std::vector<Mutation>::iterator begin, typename std::vector<Mutation>::iterator end)
+{
+    // Adds between two removes commute, each run of them still goes in as one batch
+    std::vector<ValueType> addedValues;
+    for(auto mutationIt = begin; mutationIt != end; ++mutationIt)
+    {
+        if(mutationIt->type == MutationType::Remove)
+        {
+            addAll(std::move(addedValues));
+            addedValues.clear();
+            tree.remove(mutationIt->value);
+        }
+        else
+        {
+            addedValues.push_back(std::move(mutationIt->value));
+        }
+    }
+
+    addAll(std::move(addedValues));
+    return static_cast<std::size_t>(end - begin);
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void TreeMutationQueue<ValueType, Compare, Stats>::addAll(std::vector<ValueType> &&values)
+{
+    if(values.size() == 1)
+    {
+        tree.add(std::move(values[0]));
+    }
+    else if(!values.empty())
+    {
+        tree.addValues(std::move(values));
+    }
+}
+
+template <class ValueType, class Compare, class Stats>
+bool TreeMutationQueue<ValueType, Compare, Stats>::applySingleAnimated(const Mutation &mutation, BatchResult &outResult)
+{
+    // The copy is the only cost that grows with the tree, every step after it only pays for its own change
+    auto animation = std::make_shared<TreeAnimation<ValueType, Compare, Stats>>();
+    animation->capture(tree);
+    deltaBuffer.clear();
+
+    tree.setDeltaBuffer(&deltaBuffer);
+    const bool hasChanged = mutation.type == MutationType::Add ? tree.add(mutation.value) : tree.remove(mutation.value);
+    tree.setDeltaBuffer(nullptr);
+
+    // An overflowed buffer lost steps, the change is then shown right away
+    if(hasChanged && animation->setDeltas(deltaBuffer) && animation->hasNextStep())
+    {
+        outResult.animation = std::move(animation);
+    }
+    return hasChanged;
+}
+
+#endif // TREEMUTATIONQUEUE_H
@@ -0,0 +1,90 @@
+// Headless replay of a recorded operation log against one or more tree types.
+// Usage: TreeReplay <log file> [tree name ...]
+// Exits with 3 when a replayed tree fails its invariant check.
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "operationlog.h"
+#include "treefactory.h"
+
+namespace
+{
+    // Returns whether the tree still holds its invariants after the replay
+    bool replay(const std::string &treeName, const OperationLog<int> &log)
+    {
+        auto tree = createBinaryTree<int>(treeName);
+
+        LatencyRecorder latencyRecorder;
+        tree->setLatencyRecorder(&latencyRecorder);
+
+        const auto replayStart = std::chrono::steady_clock::now();
+        for(const auto &operation : log.getOperations())
+        {
+            OperationLog<int>::apply(*tree, operation);
+        }
+        const double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStart).count();
+
+        std::printf("%s\n", treeName.c_str());
+        std::printf("  total: %.6f s, %.0f ops/s\n", totalSeconds, totalSeconds > 0 ? log.getOperations().size() / totalSeconds : 0.0);
+
+        std::ostringstream latencyReport;
+        latencyRecorder.dump(latencyReport);
+        std::istringstream latencyLines(latencyReport.str());
+        for(std::string line; std::getline(latencyLines, line);)
+        {
+            std::printf("  %s\n", line.c_str());
+        }
+
+        std::unordered_map<std::string, int> properties;
+        tree->buildProperties(properties);
+        for(const auto &[propertyName, propertyValue] : std::map<std::string, int>(properties.begin(), properties.end()))
+        {
+            std::printf("  %s: %d\n", propertyName.c_str(), propertyValue);
+        }
+
+        std::string error;
+        const bool isValid = tree->verify(&error);
+        std::printf("  verify: %s\n", isValid ? "ok" : error.c_str());
+        return isValid;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <log file> [tree name ...]\n", argv[0]);
+        return 2;
+    }
+
+    OperationLog<int> log;
+    if(!log.loadFromFile(argv[1]))
+    {
+        std::fprintf(stderr, "cannot read operation log %s\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<std::string> treeNames(argv + 2, argv + argc);
+    if(treeNames.empty())
+    {
+        treeNames = getBinaryTreeNames();
+    }
+
+    bool allValid = true;
+    for(const std::string &treeName : treeNames)
+    {
+        if(!createBinaryTree<int>(treeName))
+        {
+            std::fprintf(stderr, "unknown tree type %s\n", treeName.c_str());
+            return 1;
+        }
+        allValid = replay(treeName, log) && allValid;
+    }
+
+    return allValid ? 0 : 3;
+}
@@ -0,0 +1,74 @@
+#ifndef TREESTATS_H
+#define TREESTATS_H
+
+#include <cstdint>
+
+// Set to 1 (e.g. from CMake) to compile the per-operation counters into the trees' default stats policy
+#ifndef BINARYTREE_COLLECT_STATS
+#define BINARYTREE_COLLECT_STATS 0
+#endif
+
+struct TreeStats
+{
+    std::uint64_t comparisons = 0;
+    std::uint64_t rotations = 0;
+    std::uint64_t recolorings = 0;
+    std::uint64_t swaps = 0;
+    std::uint64_t allocations = 0;
+
+    // Lookups the Bloom filter ruled out, and lookups it let through that still missed
+    std::uint64_t bloomNegatives = 0;
+    std::uint64_t bloomFalsePositives = 0;
+
+    double getBloomFalsePositiveRate() const
+    {
+        const std::uint64_t missesCount = bloomNegatives + bloomFalsePositives;
+        return missesCount > 0 ? static_cast<double>(bloomFalsePositives) / missesCount : 0.0;
+    }
+};
+
+template <bool Enabled>
+class TreeStatsCounter
+{
+public:
+    static constexpr bool enabled = true;
+
+    void addComparison() { ++stats.comparisons; }
+    void addRotation() { ++stats.rotations; }
+    void addRecoloring() { ++stats.recolorings; }
+    void addSwap() { ++stats.swaps; }
+    void addAllocation(std::uint64_t count = 1) { stats.allocations += count; }
+    void addBloomNegative() { ++stats.bloomNegatives; }
+    void addBloomFalsePositive() { ++stats.bloomFalsePositives; }
+
+    TreeStats get() const { return stats; }
+    void reset() { stats = TreeStats(); }
+
+private:
+    TreeStats stats;
+};
+
+// Disabled counters are empty and every call inlines to nothing
+template <>
+class TreeStatsCounter<false>
+{
+public:
+    static constexpr bool enabled = false;
+
+    void addComparison() {}
+    void addRotation() {}
+    void addRecoloring() {}
+    void addSwap() {}
+    void addAllocation(std::uint64_t count = 1) {}
+    void addBloomNegative() {}
+    void addBloomFalsePositive() {}
+
+    TreeStats get() const { return TreeStats(); }
+    void reset() {}
+};
+
+// Stats policy the trees take when none is given. The policy is a template parameter, so sources built with
+// different settings instantiate different tree types instead of two meanings of the same one
+using DefaultTreeStatsCounter = TreeStatsCounter<BINARYTREE_COLLECT_STATS != 0>;
+
+#endif // TREESTATS_H
@@ -0,0 +1,143 @@
+// Regression tests for the trees, run by ctest.
+// Usage: TreeTests
+// Exits with 1 when any check fails.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "balancedbinarytree.h"
+#include "binaryheap.h"
+#include "redblacktree.h"
+#include "splaytree.h"
+#include "treemutationqueue.h"
+
+namespace
+{
+    // Counters are switched on through the stats policy, whatever the build default is
+    using CountingStats = TreeStatsCounter<true>;
+
+    int failedChecksCount = 0;
+
+    void check(bool condition, const char *testName, const char *description)
+    {
+        if(!condition)
+        {
+            std::printf("%s: %s\n", testName, description);
+            failedChecksCount++;
+        }
+    }
+
+    // Every heap comparison goes through isLess and is counted once
+    void testHeapComparisonCount()
+    {
+        BinaryHeap<int, std::less<>, CountingStats> heap;
+        for(const int value : { 5, 3, 8, 1 })
+        {
+            heap.add(value);
+        }
+        // Sifting up 3 takes 1 comparison, 8 takes 1 and 1 takes 2
+        check(heap.getStats().comparisons == 4, "testHeapComparisonCount", "adds should take 4 comparisons");
+
+        // Sifting 5 down from the root takes 2 comparisons, then sifting 8 down takes 1
+        check(heap.extractMin() == 1, "testHeapComparisonCount", "first extractMin should return 1");
+        check(heap.extractMin() == 3, "testHeapComparisonCount", "second extractMin should return 3");
+        check(heap.getStats().comparisons == 7, "testHeapComparisonCount", "adds and extracts should take 7 comparisons");
+    }
+
+    // Range removal splits and joins the AVL tree by height, every result must stay balanced
+    void testAvlRangeRemoval()
+    {
+        BalancedBinaryTree<int> tree;
+        std::vector<int> values;
+        for(int value = 0; value < 1000; value++)
+        {
+            values.push_back(value);
+        }
+        tree.addValues(values);
+
+        int expectedSize = 1000;
+        for(int low = 7; low + 31 <= 1000; low += 97)
+        {
+            expectedSize -= tree.eraseRange(low, low + 31);
+            check(tree.verify(), "testAvlRangeRemoval", "tree should stay valid after eraseRange");
+        }
+        check(tree.getSize() == expectedSize && expectedSize == 1000 - 10 * 31, "testAvlRangeRemoval", "eraseRange should remove 31 values per call");
+
+        const std::vector<int> extracted = tree.extractRange(0, 100);
+        check(tree.verify(), "testAvlRangeRemoval", "tree should stay valid after extractRange");
+        check(!extracted.empty() && extracted.front() == 0 && extracted.size() == 100 - 31 && extracted.back() == 99, "testAvlRangeRemoval", "extractRange should return the range in order");
+        check(tree.getSize() + static_cast<int>(extracted.size()) == expectedSize, "testAvlRangeRemoval", "extractRange should move values out");
+    }
+
+    // Adding a key the tree holds must not build a node, a new key is moved into the one node built for it
+    void testAddAllocatesOnlyNewKeys()
+    {
+        RedBlackTree<std::string, std::less<>, CountingStats> tree;
+        const std::string key(64, 'k');
+
+        std::string value = key;
+        check(tree.add(std::move(value)), "testAddAllocatesOnlyNewKeys", "first add should insert");
+        check(value.empty(), "testAddAllocatesOnlyNewKeys", "an inserted rvalue should be moved from");
+        check(!tree.add(std::string(key)), "testAddAllocatesOnlyNewKeys", "add of a held key should be rejected");
+        check(!tree.emplace(64, 'k'), "testAddAllocatesOnlyNewKeys", "emplace of a held key should be rejected");
+        check(tree.getStats().allocations == 1, "testAddAllocatesOnlyNewKeys", "rejected adds should not allocate");
+
+        check(tree.emplace(3, 'z'), "testAddAllocatesOnlyNewKeys", "emplace of a new key should insert");
+        check(tree.getStats().allocations == 2, "testAddAllocatesOnlyNewKeys", "emplace should build one node");
+        check(tree.contains(key) && tree.contains("zzz") && tree.verify(), "testAddAllocatesOnlyNewKeys", "tree should hold both keys");
+    }
+
+    // A mutable lookup splays the key to the root, a const one leaves the tree as it is
+    void testSplayLookups()
+    {
+        SplayTree<int> tree;
+        for(int value = 0; value < 100; value++)
+        {
+            tree.add(value);
+        }
+        check(tree.getRoot()->getValue() == 99 && tree.verify(), "testSplayLookups", "adds should splay the new key to the root");
+
+        const SplayTree<int> &constTree = tree;
+        check(constTree.contains(10) && tree.getRoot()->getValue() == 99, "testSplayLookups", "a const lookup should not restructure");
+        check(tree.contains(10) && tree.getRoot()->getValue() == 10 && tree.verify(), "testSplayLookups", "a lookup should splay the key to the root");
+        check(!tree.contains(1000) && tree.getRoot()->getValue() == 99 && tree.verify(), "testSplayLookups", "a miss should splay the last key on its path");
+
+        check(tree.remove(50) && !tree.contains(50) && tree.getSize() == 99 && tree.verify(), "testSplayLookups", "remove should join the halves");
+
+        tree.setSemiSplay(true);
+        check(tree.contains(0) && tree.verify(), "testSplayLookups", "a semi-splaying lookup should keep the tree valid");
+    }
+
+    // The heap keeps every add, so a batch of repeated keys must not coalesce to one per key
+    void testQueueHeapDuplicates()
+    {
+        BinaryHeap<int> heap;
+        {
+            TreeMutationQueue<int> queue(heap);
+            for(const int value : { 5, 3, 5, 8, 5, 3 })
+            {
+                queue.add(value);
+            }
+            queue.remove(5);
+            queue.remove(8);
+            queue.add(8);
+            queue.waitUntilIdle();
+        }
+
+        check(heap.verify(), "testQueueHeapDuplicates", "heap should stay valid");
+        check(heap.drain() == std::vector<int>({ 3, 3, 5, 5, 8 }), "testQueueHeapDuplicates", "heap should hold every add not removed");
+    }
+}
+
+int main()
+{
+    testHeapComparisonCount();
+    testAvlRangeRemoval();
+    testQueueHeapDuplicates();
+    testAddAllocatesOnlyNewKeys();
+    testSplayLookups();
+
+    std::printf("%s\n", failedChecksCount == 0 ? "all tests passed" : "some tests failed");
+    return failedChecksCount == 0 ? 0 : 1;
+}
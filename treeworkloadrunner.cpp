@@ -0,0 +1,327 @@
+// Headless workload runner for the tree types, meant for CI performance gating.
+// Usage: TreeWorkloadRunner [options]
+//   --tree <name>          tree type from the factory, repeatable, every type by default
+//   --keys <count>         key space, half of it is added before timing starts (default 100000)
+//   --ops <count>          operations per thread (default 1000000)
+//   --mix <a:r:l:e>        weights of add, remove, lookup and extractMin (default 25:25:50:0)
+//   --pattern <name>       key distribution: uniform, zipfian, sorted, reverse, nearly-sorted or sawtooth (default uniform)
+//   --zipf <exponent>      skew of the zipfian keys (default 1.0)
+//   --threads <count>      threads, each one drives its own tree (default 1)
+//   --seed <value>         random seed (default 42)
+//   --log <file>           replays a recorded operation log on every thread instead of generating operations
+//   --max-p99 <ns>         fails when any operation's p99 latency is above the limit
+//   --min-throughput <ops> fails when the total throughput in ops/s is below the limit
+// Exits with 3 when a limit is exceeded or a tree fails its invariant check.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "operationlog.h"
+#include "treefactory.h"
+#include "workloadgenerator.h"
+
+namespace
+{
+    struct WorkloadOptions
+    {
+        std::vector<std::string> treeNames;
+        std::size_t keysCount = 100000;
+        std::size_t operationsCount = 1000000;
+        unsigned mix[4] = { 25, 25, 50, 0 };
+        KeyDistribution keyDistribution = KeyDistribution::Uniform;
+        double zipfExponent = 1.0;
+        unsigned threadsCount = 1;
+        unsigned seed = 42;
+        std::string logPath;
+        std::uint64_t maxP99 = 0;
+        double minThroughput = 0.0;
+    };
+
+    bool parseMix(const std::string &text, unsigned (&outMix)[4])
+    {
+        unsigned mix[4] = {};
+        std::istringstream stream(text);
+        for(int i = 0; i < 4; i++)
+        {
+            char separator = ':';
+            if((i > 0 && !(stream >> separator)) || separator != ':' || !(stream >> mix[i]))
+            {
+                return false;
+            }
+        }
+        if(!stream.eof() || mix[0] + mix[1] + mix[2] + mix[3] == 0)
+        {
+            return false;
+        }
+        std::copy(mix, mix + 4, outMix);
+        return true;
+    }
+
+    bool parseOptions(int argc, char *argv[], WorkloadOptions &outOptions)
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            const std::string option = argv[i];
+            if(i + 1 >= argc)
+            {
+                return false;
+            }
+
+            const std::string argument = argv[++i];
+            try
+            {
+                if(option == "--tree")
+                {
+                    outOptions.treeNames.push_back(argument);
+                }
+                else if(option == "--keys")
+                {
+                    outOptions.keysCount = std::max<std::size_t>(1, std::stoul(argument));
+                }
+                else if(option == "--ops")
+                {
+                    outOptions.operationsCount = std::stoul(argument);
+                }
+                else if(option == "--mix")
+                {
+                    if(!parseMix(argument, outOptions.mix))
+                    {
+                        return false;
+                    }
+                }
+                else if(option == "--pattern")
+                {
+                    // sequential is kept from before the distributions were added
+                    if(argument == "sequential")
+                    {
+                        outOptions.keyDistribution = KeyDistribution::Sorted;
+                    }
+                    else if(!parseKeyDistribution(argument, outOptions.keyDistribution))
+                    {
+                        return false;
+                    }
+                }
+                else if(option == "--zipf")
+                {
+                    outOptions.zipfExponent = std::stod(argument);
+                }
+                else if(option == "--threads")
+                {
+                    outOptions.threadsCount = std::max(1u, static_cast<unsigned>(std::stoul(argument)));
+                }
+                else if(option == "--seed")
+                {
+                    outOptions.seed = static_cast<unsigned>(std::stoul(argument));
+                }
+                else if(option == "--log")
+                {
+                    outOptions.logPath = argument;
+                }
+                else if(option == "--max-p99")
+                {
+                    outOptions.maxP99 = std::stoull(argument);
+                }
+                else if(option == "--min-throughput")
+                {
+                    outOptions.minThroughput = std::stod(argument);
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            catch(const std::exception&)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Generated mix on one thread's own tree, after an untimed prefill with half of the key space.
+    // Returns the seconds spent on the mix
+    double runGenerated(BinaryTreeBase<int> &tree, const WorkloadOptions &options, unsigned threadIndex, LatencyRecorder &latencyRecorder)
+    {
+        Xoshiro256 generator(options.seed + threadIndex);
+        WorkloadGenerator keyGenerator(options.keyDistribution, 0, static_cast<std::int64_t>(options.keysCount) - 1, generator());
+        keyGenerator.setZipfExponent(options.zipfExponent);
+        const auto drawKey = [&]()
+        {
+            return static_cast<int>(keyGenerator.next());
+        };
+
+        tree.fill(keyGenerator, options.keysCount / 2);
+
+        const unsigned totalWeight = options.mix[0] + options.mix[1] + options.mix[2] + options.mix[3];
+        tree.setLatencyRecorder(&latencyRecorder);
+        const auto mixStart = std::chrono::steady_clock::now();
+        for(std::size_t i = 0; i < options.operationsCount; i++)
+        {
+            unsigned draw = static_cast<unsigned>(generator.bounded(totalWeight));
+            if(draw < options.mix[0])
+            {
+                tree.add(drawKey());
+            }
+            else if((draw -= options.mix[0]) < options.mix[1])
+            {
+                tree.remove(drawKey());
+            }
+            else if((draw -= options.mix[1]) < options.mix[2])
+            {
+                tree.contains(drawKey());
+            }
+            else if(tree.isNodeValid(tree.getRoot()))
+            {
+                tree.extractMin();
+            }
+        }
+        const double mixSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - mixStart).count();
+        tree.setLatencyRecorder(nullptr);
+        return mixSeconds;
+    }
+
+    double runScripted(BinaryTreeBase<int> &tree, const OperationLog<int> &log, LatencyRecorder &latencyRecorder)
+    {
+        tree.setLatencyRecorder(&latencyRecorder);
+        const auto replayStart = std::chrono::steady_clock::now();
+        for(const auto &operation : log.getOperations())
+        {
+            OperationLog<int>::apply(tree, operation);
+        }
+        const double replaySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStart).count();
+        tree.setLatencyRecorder(nullptr);
+        return replaySeconds;
+    }
+
+    // Returns whether the run stayed within the limits and the trees kept their invariants
+    bool runWorkload(const std::string &treeName, const WorkloadOptions &options, const OperationLog<int> *log)
+    {
+        std::vector<std::unique_ptr<BinaryTreeBase<int>>> trees;
+        for(unsigned i = 0; i < options.threadsCount; i++)
+        {
+            trees.push_back(createBinaryTree<int>(treeName));
+        }
+
+        LatencyRecorder latencyRecorder;
+        std::vector<double> threadSeconds(options.threadsCount);
+        const auto runThread = [&](unsigned threadIndex)
+        {
+            threadSeconds[threadIndex] = log ? runScripted(*trees[threadIndex], *log, latencyRecorder)
+                                             : runGenerated(*trees[threadIndex], options, threadIndex, latencyRecorder);
+        };
+
+        std::vector<std::thread> threads;
+        for(unsigned i = 1; i < options.threadsCount; i++)
+        {
+            threads.emplace_back(runThread, i);
+        }
+        runThread(0);
+        for(auto &thread : threads)
+        {
+            thread.join();
+        }
+        // The slowest thread bounds the run, prefills are left out
+        const double totalSeconds = *std::max_element(threadSeconds.begin(), threadSeconds.end());
+
+        const std::size_t operationsPerThread = log ? log->getOperations().size() : options.operationsCount;
+        const double throughput = totalSeconds > 0 ? operationsPerThread * options.threadsCount / totalSeconds : 0.0;
+
+        std::printf("%s\n", treeName.c_str());
+        std::printf("  threads: %u, total: %.6f s, %.0f ops/s\n", options.threadsCount, totalSeconds, throughput);
+
+        bool withinLimits = true;
+        if(options.minThroughput > 0 && throughput < options.minThroughput)
+        {
+            std::printf("  FAILED: throughput below %.0f ops/s\n", options.minThroughput);
+            withinLimits = false;
+        }
+
+        for(int i = 0; i < static_cast<int>(LatencyOperation::Count); i++)
+        {
+            const auto operation = static_cast<LatencyOperation>(i);
+            const LatencySummary summary = latencyRecorder.getSummary(operation);
+            if(summary.count == 0)
+            {
+                continue;
+            }
+
+            std::printf("  %s: count %llu, p50 %llu ns, p99 %llu ns, p99.9 %llu ns, max %llu ns\n", getLatencyOperationName(operation)
+                        , static_cast<unsigned long long>(summary.count), static_cast<unsigned long long>(summary.p50), static_cast<unsigned long long>(summary.p99)
+                        , static_cast<unsigned long long>(summary.p999), static_cast<unsigned long long>(summary.max));
+            if(options.maxP99 > 0 && summary.p99 > options.maxP99)
+            {
+                std::printf("  FAILED: %s p99 above %llu ns\n", getLatencyOperationName(operation), static_cast<unsigned long long>(options.maxP99));
+                withinLimits = false;
+            }
+        }
+
+        // The trees only differ by seed, the first one stands for all
+        std::unordered_map<std::string, int> properties;
+        trees[0]->buildProperties(properties);
+        for(const auto &[propertyName, propertyValue] : std::map<std::string, int>(properties.begin(), properties.end()))
+        {
+            std::printf("  %s: %d\n", propertyName.c_str(), propertyValue);
+        }
+
+        for(const auto &tree : trees)
+        {
+            std::string error;
+            if(!tree->verify(&error))
+            {
+                std::printf("  verify: %s\n", error.c_str());
+                return false;
+            }
+        }
+        std::printf("  verify: ok\n");
+        return withinLimits;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    WorkloadOptions options;
+    if(!parseOptions(argc, argv, options))
+    {
+        std::fprintf(stderr, "usage: %s [--tree <name>]... [--keys <count>] [--ops <count>] [--mix <a:r:l:e>]\n"
+                             "       [--pattern uniform|zipfian|sorted|reverse|nearly-sorted|sawtooth] [--zipf <exponent>] [--threads <count>]\n"
+                             "       [--seed <value>] [--log <file>] [--max-p99 <ns>] [--min-throughput <ops>]\n", argv[0]);
+        return 2;
+    }
+
+    OperationLog<int> log;
+    if(!options.logPath.empty() && !log.loadFromFile(options.logPath))
+    {
+        std::fprintf(stderr, "cannot read operation log %s\n", options.logPath.c_str());
+        return 1;
+    }
+
+    if(options.treeNames.empty())
+    {
+        options.treeNames = getBinaryTreeNames();
+    }
+
+    for(const std::string &treeName : options.treeNames)
+    {
+        if(!createBinaryTree<int>(treeName))
+        {
+            std::fprintf(stderr, "unknown tree type %s\n", treeName.c_str());
+            return 1;
+        }
+    }
+
+    bool allPassed = true;
+    for(const std::string &treeName : options.treeNames)
+    {
+        allPassed = runWorkload(treeName, options, options.logPath.empty() ? nullptr : &log) && allPassed;
+    }
+
+    return allPassed ? 0 : 3;
+}
@@ -0,0 +1,823 @@
+#ifndef VANEMDEBOASTREE_H
+#define VANEMDEBOASTREE_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "binarytreebase.h"
+
+// Hardware bit scans (tzcnt / lzcnt, bsf / bsr), word must not be 0
+inline int countTrailingZeros(std::uint64_t word)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+inline int countLeadingZeros(std::uint64_t word)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanReverse64(&index, word);
+    return 63 - static_cast<int>(index);
+#else
+    return __builtin_clzll(word);
+#endif
+}
+
+// One level of a van Emde Boas tree over the keys [0, 2^bits). Up to 8 bits the keys are a 256 bit bitmap,
+// above that the minimum is kept here and the other keys go into clusters by their high half, with a summary
+// level holding the high halves in use. Clusters only exist while they hold keys, so sparse key sets stay small
+class VanEmdeBoasLevel
+{
+public:
+    explicit VanEmdeBoasLevel(int bits);
+
+    bool isEmpty() const { return empty; }
+    std::uint32_t getMin() const { return min; }
+    std::uint32_t getMax() const { return max; }
+
+    bool contains(std::uint32_t key) const;
+    // Both return false when the key is already there, or not there
+    bool insert(std::uint32_t key);
+    bool erase(std::uint32_t key);
+
+    // Smallest key above key and largest key below it, false when there is none
+    bool getSuccessor(std::uint32_t key, std::uint32_t &outKey) const;
+    bool getPredecessor(std::uint32_t key, std::uint32_t &outKey) const;
+
+    // Heap bytes below this level, the level itself is left to its owner
+    void addMemoryUsage(MemoryUsage &outUsage) const;
+    // Empty when min, max, the summary and the clusters agree
+    std::string verify() const;
+
+private:
+    static constexpr int leafBits = 8;
+
+    bool isLeaf() const { return bits <= leafBits; }
+    std::uint32_t getHigh(std::uint32_t key) const { return key >> lowBits; }
+    std::uint32_t getLow(std::uint32_t key) const { return key & ((std::uint32_t(1) << lowBits) - 1); }
+    std::uint32_t getKey(std::uint32_t high, std::uint32_t low) const { return (high << lowBits) | low; }
+
+    bool getLeafSuccessor(std::uint32_t key, std::uint32_t &outKey) const;
+    bool getLeafPredecessor(std::uint32_t key, std::uint32_t &outKey) const;
+    void updateLeafBounds();
+
+    int bits = 0;
+    int lowBits = 0;
+    bool empty = true;
+    std::uint32_t min = 0;
+    std::uint32_t max = 0;
+
+    std::array<std::uint64_t, 4> words{};
+    std::unique_ptr<VanEmdeBoasLevel> summary;
+    std::unordered_map<std::uint32_t, std::unique_ptr<VanEmdeBoasLevel>> clusters;
+};
+
+inline VanEmdeBoasLevel::VanEmdeBoasLevel(int bits)
+    : bits(bits)
+    , lowBits(bits / 2)
+{
+    if(!isLeaf())
+    {
+        summary = std::make_unique<VanEmdeBoasLevel>(bits - lowBits);
+    }
+}
+
+inline bool VanEmdeBoasLevel::contains(std::uint32_t key) const
+{
+    if(isLeaf())
+    {
+        return (words[key >> 6] >> (key & 63)) & 1;
+    }
+    if(empty)
+    {
+        return false;
+    }
+    if(key == min || key == max)
+    {
+        return true;
+    }
+
+    const auto clusterIt = clusters.find(getHigh(key));
+    return clusterIt != clusters.end() && clusterIt->second->contains(getLow(key));
+}
+
+inline bool VanEmdeBoasLevel::insert(std::uint32_t key)
+{
+    if(isLeaf())
+    {
+        std::uint64_t &word = words[key >> 6];
+        const std::uint64_t bit = std::uint64_t(1) << (key & 63);
+        if(word & bit)
+        {
+            return false;
+        }
+
+        word |= bit;
+        min = empty || key < min ? key : min;
+        max = empty || key > max ? key : max;
+        empty = false;
+        return true;
+    }
+
+    if(empty)
+    {
+        min = max = key;
+        empty = false;
+        return true;
+    }
+    if(key == min)
+    {
+        return false;
+    }
+    if(key < min)
+    {
+        // The old minimum is not in any cluster yet, it goes down in place of the new one
+        std::swap(key, min);
+    }
+
+    const std::uint32_t high = getHigh(key);
+    std::unique_ptr<VanEmdeBoasLevel> &cluster = clusters[high];
+    if(!cluster)
+    {
+        cluster = std::make_unique<VanEmdeBoasLevel>(lowBits);
+        summary->insert(high);
+    }
+
+    const bool inserted = cluster->insert(getLow(key));
+    max = key > max ? key : max;
+    return inserted;
+}
+
+inline bool VanEmdeBoasLevel::erase(std::uint32_t key)
+{
+    if(isLeaf())
+    {
+        std::uint64_t &word = words[key >> 6];
+        const std::uint64_t bit = std::uint64_t(1) << (key & 63);
+        if(!(word & bit))
+        {
+            return false;
+        }
+
+        word &= ~bit;
+        updateLeafBounds();
+        return true;
+    }
+
+    if(empty)
+    {
+        return false;
+    }
+    if(min == max)
+    {
+        if(key != min)
+        {
+            return false;
+        }
+        empty = true;
+        return true;
+    }
+    if(key == min)
+    {
+        // The smallest clustered key becomes the minimum and leaves its cluster
+        const std::uint32_t firstHigh = summary->getMin();
+        key = getKey(firstHigh, clusters.find(firstHigh)->second->getMin());
+        min = key;
+    }
+
+    const std::uint32_t high = getHigh(key);
+    const auto clusterIt = clusters.find(high);
+    if(clusterIt == clusters.end() || !clusterIt->second->erase(getLow(key)))
+    {
+        return false;
+    }
+    if(clusterIt->second->isEmpty())
+    {
+        clusters.erase(clusterIt);
+        summary->erase(high);
+    }
+
+    if(key == max)
+    {
+        if(summary->isEmpty())
+        {
+            max = min;
+        }
+        else
+        {
+            const std::uint32_t lastHigh = summary->getMax();
+            max = getKey(lastHigh, clusters.find(lastHigh)->second->getMax());
+        }
+    }
+    return true;
+}
+
+inline bool VanEmdeBoasLevel::getSuccessor(std::uint32_t key, std::uint32_t &outKey) const
+{
+    if(isLeaf())
+    {
+        return getLeafSuccessor(key, outKey);
+    }
+    if(empty || key >= max)
+    {
+        return false;
+    }
+    if(key < min)
+    {
+        outKey = min;
+        return true;
+    }
+
+    const std::uint32_t high = getHigh(key);
+    const std::uint32_t low = getLow(key);
+    const auto clusterIt = clusters.find(high);
+    std::uint32_t found = 0;
+    if(clusterIt != clusters.end() && low < clusterIt->second->getMax())
+    {
+        clusterIt->second->getSuccessor(low, found);
+        outKey = getKey(high, found);
+        return true;
+    }
+
+    if(!summary->getSuccessor(high, found))
+    {
+        return false;
+    }
+    outKey = getKey(found, clusters.find(found)->second->getMin());
+    return true;
+}
+
+inline bool VanEmdeBoasLevel::getPredecessor(std::uint32_t key, std::uint32_t &outKey) const
+{
+    if(isLeaf())
+    {
+        return getLeafPredecessor(key, outKey);
+    }
+    if(empty || key <= min)
+    {
+        return false;
+    }
+    if(key > max)
+    {
+        outKey = max;
+        return true;
+    }
+
+    const std::uint32_t high = getHigh(key);
+    const std::uint32_t low = getLow(key);
+    const auto clusterIt = clusters.find(high);
+    std::uint32_t found = 0;
+    if(clusterIt != clusters.end() && low > clusterIt->second->getMin())
+    {
+        clusterIt->second->getPredecessor(low, found);
+        outKey = getKey(high, found);
+        return true;
+    }
+
+    // The minimum is in no cluster, it is the answer when no earlier cluster has one
+    if(summary->getPredecessor(high, found))
+    {
+        outKey = getKey(found, clusters.find(found)->second->getMax());
+        return true;
+    }
+    outKey = min;
+    return true;
+}
+
+inline bool VanEmdeBoasLevel::getLeafSuccessor(std::uint32_t key, std::uint32_t &outKey) const
+{
+    const std::uint32_t start = key + 1;
+    if(empty || key >= max)
+    {
+        return false;
+    }
+
+    std::size_t wordIndex = start >> 6;
+    std::uint64_t word = words[wordIndex] & (~std::uint64_t(0) << (start & 63));
+    while(word == 0)
+    {
+        word = words[++wordIndex];
+    }
+    outKey = static_cast<std::uint32_t>(wordIndex * 64 + countTrailingZeros(word));
+    return true;
+}
+
+inline bool VanEmdeBoasLevel::getLeafPredecessor(std::uint32_t key, std::uint32_t &outKey) const
+{
+    if(empty || key <= min)
+    {
+        return false;
+    }
+
+    const std::uint32_t end = key - 1;
+    std::size_t wordIndex = end >> 6;
+    std::uint64_t word = words[wordIndex] & (~std::uint64_t(0) >> (63 - (end & 63)));
+    while(word == 0)
+    {
+        word = words[--wordIndex];
+    }
+    outKey = static_cast<std::uint32_t>(wordIndex * 64 + 63 - countLeadingZeros(word));
+    return true;
+}
+
+inline void VanEmdeBoasLevel::updateLeafBounds()
+{
+    empty = true;
+    for(std::size_t i = 0; i < words.size(); i++)
+    {
+        if(words[i] != 0)
+        {
+            max = static_cast<std::uint32_t>(i * 64 + 63 - countLeadingZeros(words[i]));
+            min = empty ? static_cast<std::uint32_t>(i * 64 + countTrailingZeros(words[i])) : min;
+            empty = false;
+        }
+    }
+}
+
+inline void VanEmdeBoasLevel::addMemoryUsage(MemoryUsage &outUsage) const
+{
+    if(isLeaf())
+    {
+        return;
+    }
+
+    // libstdc++ hash nodes hold a next pointer and the pair, the bucket array is one allocation
+    outUsage.addAllocations(1, sizeof(VanEmdeBoasLevel));
+    summary->addMemoryUsage(outUsage);
+    outUsage.addArray(clusters.bucket_count() * sizeof(void*), clusters.bucket_count() * sizeof(void*));
+    outUsage.addAllocations(clusters.size(), sizeof(void*) + sizeof(*clusters.begin()));
+    outUsage.addAllocations(clusters.size(), sizeof(VanEmdeBoasLevel));
+    for(const auto &[high, cluster] : clusters)
+    {
+        cluster->addMemoryUsage(outUsage);
+    }
+}
+
+inline std::string VanEmdeBoasLevel::verify() const
+{
+    if(isLeaf())
+    {
+        VanEmdeBoasLevel rescanned(bits);
+        rescanned.words = words;
+        rescanned.updateLeafBounds();
+        if(rescanned.empty != empty || (!empty && (rescanned.min != min || rescanned.max != max)))
+        {
+            return "leaf bounds broken";
+        }
+        return "";
+    }
+
+    if(empty)
+    {
+        return clusters.empty() && summary->isEmpty() ? "" : "empty level holds clusters";
+    }
+    if(min > max || (min == max) != clusters.empty())
+    {
+        return "min " + std::to_string(min) + " and max " + std::to_string(max) + " disagree with the clusters";
+    }
+
+    std::uint32_t highestKey = min;
+    std::size_t summaryCount = 0;
+    for(std::uint32_t high = summary->getMin(); !summary->isEmpty(); )
+    {
+        summaryCount++;
+        if(!summary->getSuccessor(high, high))
+        {
+            break;
+        }
+    }
+    if(summaryCount != clusters.size())
+    {
+        return "summary holds " + std::to_string(summaryCount) + " clusters, there are " + std::to_string(clusters.size());
+    }
+
+    for(const auto &[high, cluster] : clusters)
+    {
+        if(cluster->isEmpty() || !summary->contains(high))
+        {
+            return "cluster " + std::to_string(high) + " is empty or missing from the summary";
+        }
+        if(getKey(high, cluster->getMin()) <= min)
+        {
+            return "cluster " + std::to_string(high) + " holds a key below the minimum";
+        }
+        highestKey = std::max(highestKey, getKey(high, cluster->getMax()));
+
+        const std::string error = cluster->verify();
+        if(!error.empty())
+        {
+            return error;
+        }
+    }
+    if(highestKey != max)
+    {
+        return "max is " + std::to_string(max) + ", the highest key is " + std::to_string(highestKey);
+    }
+    return summary->verify();
+}
+
+template <class ValueType, class Compare>
+inline constexpr bool isVanEmdeBoasKey = std::is_integral_v<ValueType> && !std::is_same_v<ValueType, bool> && sizeof(ValueType) <= sizeof(std::uint32_t)
+                                         && (std::is_same_v<Compare, std::less<>> || std::is_same_v<Compare, std::less<ValueType>>
+                                             || std::is_same_v<Compare, std::greater<>> || std::is_same_v<Compare, std::greater<ValueType>>);
+
+// Integer keys of up to 32 bits in a van Emde Boas tree: add, remove, contains, successor and predecessor
+// take O(log log U) steps and no key comparisons. Nodes are only kept for the tree API and the drawing,
+// they are found through a hash map. A node's children are computed from the keys, see getDisplayKey.
+// No deltas are recorded, a change can move many nodes of the drawn shape at once
+template <class ValueType, class Compare = std::less<>, class Stats = DefaultTreeStatsCounter>
+class VanEmdeBoasTree : public BinaryTreeBase<ValueType, Compare, Stats>
+{
+    static_assert(isVanEmdeBoasKey<ValueType, Compare>, "needs integer keys of at most 32 bits ordered by std::less or std::greater");
+
+public:
+    using BinaryTreeNode = typename BinaryTreeBase<ValueType, Compare, Stats>::BinaryTreeNode;
+
+    struct VanEmdeBoasNode : public BinaryTreeNode
+    {
+        using BinaryTreeNode::BinaryTreeNode;
+
+        virtual shared_ptr<BinaryTreeNode> getParent() const override { return tree ? tree->getDisplayParent(this->value) : nullptr; }
+        virtual shared_ptr<BinaryTreeNode> getLeft() const override { return tree ? tree->getDisplayChild(this->value, true) : nullptr; }
+        virtual shared_ptr<BinaryTreeNode> getRight() const override { return tree ? tree->getDisplayChild(this->value, false) : nullptr; }
+
+        const VanEmdeBoasTree *tree = nullptr;
+    };
+
+    // Next value after value and the one before it in Compare order, false when there is none
+    bool getSuccessor(const ValueType &value, ValueType &outValue) const;
+    bool getPredecessor(const ValueType &value, ValueType &outValue) const;
+
+    int getSize() const { return static_cast<int>(nodes.size()); }
+
+protected:
+    virtual shared_ptr<BinaryTreeNode> addInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, const shared_ptr<BinaryTreeNode> &parent, shared_ptr<BinaryTreeNode> &newNode) override;
+    virtual shared_ptr<BinaryTreeNode> removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, shared_ptr<BinaryTreeNode> &removedNode) override;
+    virtual shared_ptr<BinaryTreeNode> createNode(ValueType &&value) const override;
+    virtual void initNode(const shared_ptr<BinaryTreeNode> &node) const override;
+    virtual bool canAdoptNode(const shared_ptr<BinaryTreeNode> &node) const override;
+    virtual shared_ptr<BinaryTreeNode> getMaxValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const override;
+    virtual shared_ptr<BinaryTreeNode> getMinValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const override;
+    virtual int removeRangeInternal(const ValueType &low, const ValueType &high, std::vector<ValueType> *outValues) override;
+    virtual std::string verifyInternal(unsigned threadsCount) const override;
+    virtual void memoryUsageInternal(MemoryUsage &outUsage) const override;
+
+    virtual shared_ptr<BinaryTreeNode> getNodeForValue(const ValueType &value) const override;
+
+private:
+    // Keys in [0, 2^32) ordered like the values under Compare
+    static std::uint32_t toKey(const ValueType &value);
+    static ValueType toValue(std::uint32_t key);
+
+    shared_ptr<VanEmdeBoasNode> getNode(std::uint32_t key) const;
+
+    // The drawn shape is the binary trie of the key space: a subtree covers a key interval, split at the coarsest
+    // power of two boundary inside it. Its node is the last key before the boundary, or the first one after it when
+    // there is none before. The in-order walk stays sorted and the depth stays below twice the key bits for any keys
+    bool getDisplayKey(std::uint32_t low, std::uint32_t high, std::uint32_t &outKey) const;
+    // Walks down from the display root to key, giving the interval its subtree covers and its parent
+    bool locateDisplayKey(std::uint32_t key, std::uint32_t &outLow, std::uint32_t &outHigh, std::uint32_t *outParent) const;
+    shared_ptr<BinaryTreeNode> getDisplayChild(const ValueType &value, bool isLeft) const;
+    shared_ptr<BinaryTreeNode> getDisplayParent(const ValueType &value) const;
+    shared_ptr<BinaryTreeNode> getDisplayRoot() const;
+
+    VanEmdeBoasLevel keys{ 32 };
+    std::unordered_map<std::uint32_t, shared_ptr<VanEmdeBoasNode>> nodes;
+};
+
+template <class ValueType, class Compare, class Stats>
+bool VanEmdeBoasTree<ValueType, Compare, Stats>::getSuccessor(const ValueType &value, ValueType &outValue) const
+{
+    std::uint32_t key = 0;
+    if(!keys.getSuccessor(toKey(value), key))
+    {
+        return false;
+    }
+    outValue = toValue(key);
+    return true;
+}
+
+template <class ValueType, class Compare, class Stats>
+bool VanEmdeBoasTree<ValueType, Compare, Stats>::getPredecessor(const ValueType &value, ValueType &outValue) const
+{
+    std::uint32_t key = 0;
+    if(!keys.getPredecessor(toKey(value), key))
+    {
+        return false;
+    }
+    outValue = toValue(key);
+    return true;
+}
+
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename VanEmdeBoasTree<ValueType, Compare, Stats>::BinaryTreeNode> VanEmdeBoasTree<ValueType, Compare, Stats>::addInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot
+                                                                                                                         , const shared_ptr<BinaryTreeNode> &parent, shared_ptr<BinaryTreeNode> &newNode)
+{
+    const std::uint32_t key = toKey(value);
+    if(!keys.insert(key))
+    {
+        newNode = nullptr;
+        return inRoot;
+    }
+
+    if(!newNode)
+    {
+        newNode = this->createNodeFor(value);
+    }
+    const auto node = this->template getNodeAs<VanEmdeBoasNode>(newNode);
+    node->tree = this;
+    nodes.emplace(key, node);
+    return getDisplayRoot();
+}
+
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename VanEmdeBoasTree<ValueType, Compare, Stats>::BinaryTreeNode> VanEmdeBoasTree<ValueType, Compare, Stats>::removeInternal(const ValueType &value, const shared_ptr<BinaryTreeNode> &inRoot, shared_ptr<BinaryTreeNode> &removedNode)
+{
+    const std::uint32_t key = toKey(value);
+    const auto nodeIt = nodes.find(key);
+    if(nodeIt == nodes.end())
+    {
+        removedNode = nullptr;
+        return inRoot;
+    }
+
+    removedNode = nodeIt->second;
+    nodes.erase(nodeIt);
+    keys.erase(key);
+    return getDisplayRoot();
+}
+
+template <class ValueType, class Compare, class Stats>
+int VanEmdeBoasTree<ValueType, Compare, Stats>::removeRangeInternal(const ValueType &low, const ValueType &high, std::vector<ValueType> *outValues)
+{
+    if(!this->isLess(low, high))
+    {
+        return 0;
+    }
+
+    // Successor steps from low, the keys come out in order
+    const std::uint32_t endKey = toKey(high);
+    std::uint32_t key = toKey(low);
+    bool hasKey = keys.contains(key) || keys.getSuccessor(key, key);
+    int removedCount = 0;
+    while(hasKey && key < endKey)
+    {
+        std::uint32_t nextKey = 0;
+        const bool hasNextKey = keys.getSuccessor(key, nextKey);
+
+        const auto nodeIt = nodes.find(key);
+        if(outValues)
+        {
+            outValues->push_back(std::move(nodeIt->second->value));
+        }
+        nodeIt->second->tree = nullptr;
+        nodes.erase(nodeIt);
+        keys.erase(key);
+        removedCount++;
+
+        key = nextKey;
+        hasKey = hasNextKey;
+    }
+
+    this->root = getDisplayRoot();
+    return removedCount;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename VanEmdeBoasTree<ValueType, Compare, Stats>::BinaryTreeNode> VanEmdeBoasTree<ValueType, Compare, Stats>::createNode(ValueType &&value) const
+{
+    this->stats.addAllocation();
+    return std::make_shared<VanEmdeBoasNode>(std::move(value));
+}
+
+template <class ValueType, class Compare, class Stats>
+inline void VanEmdeBoasTree<ValueType, Compare, Stats>::initNode(const shared_ptr<BinaryTreeNode> &node) const
+{
+    this->template getNodeAs<VanEmdeBoasNode>(node)->tree = nullptr;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline bool VanEmdeBoasTree<ValueType, Compare, Stats>::canAdoptNode(const shared_ptr<BinaryTreeNode> &node) const
+{
+    return this->template getNodeAs<VanEmdeBoasNode>(node) != nullptr;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename VanEmdeBoasTree<ValueType, Compare, Stats>::BinaryTreeNode> VanEmdeBoasTree<ValueType, Compare, Stats>::getMaxValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const
+{
+    return keys.isEmpty() ? nullptr : getNode(keys.getMax());
+}
+
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename VanEmdeBoasTree<ValueType, Compare, Stats>::BinaryTreeNode> VanEmdeBoasTree<ValueType, Compare, Stats>::getMinValuePtr(const shared_ptr<BinaryTreeNode> &inRoot) const
+{
+    return keys.isEmpty() ? nullptr : getNode(keys.getMin());
+}
+
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename VanEmdeBoasTree<ValueType, Compare, Stats>::BinaryTreeNode> VanEmdeBoasTree<ValueType, Compare, Stats>::getNodeForValue(const ValueType &value) const
+{
+    return getNode(toKey(value));
+}
+
+template <class ValueType, class Compare, class Stats>
+void VanEmdeBoasTree<ValueType, Compare, Stats>::memoryUsageInternal(MemoryUsage &outUsage) const
+{
+    outUsage.keysCount += nodes.size();
+    keys.addMemoryUsage(outUsage);
+
+    outUsage.addSharedNodes<VanEmdeBoasNode>(nodes.size());
+    outUsage.addArray(nodes.bucket_count() * sizeof(void*), nodes.bucket_count() * sizeof(void*));
+    outUsage.addAllocations(nodes.size(), sizeof(void*) + sizeof(*nodes.begin()));
+}
+
+template <class ValueType, class Compare, class Stats>
+std::string VanEmdeBoasTree<ValueType, Compare, Stats>::verifyInternal(unsigned threadsCount) const
+{
+    const std::string error = keys.verify();
+    if(!error.empty())
+    {
+        return error;
+    }
+
+    std::size_t keysCount = 0;
+    for(std::uint32_t key = keys.getMin(); !keys.isEmpty(); )
+    {
+        const auto node = getNode(key);
+        if(!node || node->tree != this || toKey(node->value) != key)
+        {
+            return "no node for key " + std::to_string(key);
+        }
+        keysCount++;
+        if(!keys.getSuccessor(key, key))
+        {
+            break;
+        }
+    }
+
+    if(keysCount != nodes.size())
+    {
+        return "the tree holds " + std::to_string(keysCount) + " keys and " + std::to_string(nodes.size()) + " nodes";
+    }
+    if(this->root != getDisplayRoot())
+    {
+        return "root is not the display root";
+    }
+    return "";
+}
+
+template <class ValueType, class Compare, class Stats>
+inline std::uint32_t VanEmdeBoasTree<ValueType, Compare, Stats>::toKey(const ValueType &value)
+{
+    using UnsignedType = std::make_unsigned_t<ValueType>;
+    std::uint32_t key = static_cast<UnsignedType>(value);
+    if constexpr (std::is_signed_v<ValueType>)
+    {
+        // Flipping the sign bit puts the negative values first
+        key ^= std::uint32_t(1) << (sizeof(ValueType) * 8 - 1);
+    }
+    if constexpr (std::is_same_v<Compare, std::greater<>> || std::is_same_v<Compare, std::greater<ValueType>>)
+    {
+        key = ~key;
+    }
+    return key;
+}
+
+template <class ValueType, class Compare, class Stats>
+inline ValueType VanEmdeBoasTree<ValueType, Compare, Stats>::toValue(std::uint32_t key)
+{
+    using UnsignedType = std::make_unsigned_t<ValueType>;
+    if constexpr (std::is_same_v<Compare, std::greater<>> || std::is_same_v<Compare, std::greater<ValueType>>)
+    {
+        key = ~key;
+    }
+    if constexpr (std::is_signed_v<ValueType>)
+    {
+        key ^= std::uint32_t(1) << (sizeof(ValueType) * 8 - 1);
+    }
+    return static_cast<ValueType>(static_cast<UnsignedType>(key));
+}
+
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename VanEmdeBoasTree<ValueType, Compare, Stats>::VanEmdeBoasNode> VanEmdeBoasTree<ValueType, Compare, Stats>::getNode(std::uint32_t key) const
+{
+    const auto nodeIt = nodes.find(key);
+    return nodeIt != nodes.end() ? nodeIt->second : nullptr;
+}
+
+template <class ValueType, class Compare, class Stats>
+bool VanEmdeBoasTree<ValueType, Compare, Stats>::getDisplayKey(std::uint32_t low, std::uint32_t high, std::uint32_t &outKey) const
+{
+    if(low > high)
+    {
+        return false;
+    }
+    if(low == high)
+    {
+        outKey = low;
+        return keys.contains(low);
+    }
+
+    // The highest bit where low and high differ is 0 in low and 1 in high, clearing the bits below it in high gives the boundary
+    const int boundaryBit = 63 - countLeadingZeros(low ^ high);
+    const std::uint32_t boundary = high & ~((std::uint32_t(1) << boundaryBit) - 1);
+
+    std::uint32_t key = 0;
+    if(keys.getPredecessor(boundary, key) && key >= low)
+    {
+        outKey = key;
+        return true;
+    }
+    if((keys.contains(boundary) && (key = boundary, true)) || keys.getSuccessor(boundary, key))
+    {
+        outKey = key;
+        return key <= high;
+    }
+    return false;
+}
+
+template <class ValueType, class Compare, class Stats>
+bool VanEmdeBoasTree<ValueType, Compare, Stats>::locateDisplayKey(std::uint32_t key, std::uint32_t &outLow, std::uint32_t &outHigh, std::uint32_t *outParent) const
+{
+    outLow = 0;
+    outHigh = std::numeric_limits<std::uint32_t>::max();
+    std::uint32_t nodeKey = 0;
+    while(getDisplayKey(outLow, outHigh, nodeKey))
+    {
+        if(nodeKey == key)
+        {
+            return true;
+        }
+
+        if(outParent)
+        {
+            *outParent = nodeKey;
+        }
+        if(key < nodeKey)
+        {
+            outHigh = nodeKey - 1;
+        }
+        else
+        {
+            outLow = nodeKey + 1;
+        }
+    }
+    return false;
+}
+
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename VanEmdeBoasTree<ValueType, Compare, Stats>::BinaryTreeNode> VanEmdeBoasTree<ValueType, Compare, Stats>::getDisplayChild(const ValueType &value, bool isLeft) const
+{
+    const std::uint32_t key = toKey(value);
+    std::uint32_t low = 0;
+    std::uint32_t high = 0;
+    std::uint32_t childKey = 0;
+    if(!locateDisplayKey(key, low, high, nullptr))
+    {
+        return nullptr;
+    }
+
+    const bool hasChild = isLeft ? key > low && getDisplayKey(low, key - 1, childKey)
+                                 : key < high && getDisplayKey(key + 1, high, childKey);
+    return hasChild ? getNode(childKey) : nullptr;
+}
+
+template <class ValueType, class Compare, class Stats>
+shared_ptr<typename VanEmdeBoasTree<ValueType, Compare, Stats>::BinaryTreeNode> VanEmdeBoasTree<ValueType, Compare, Stats>::getDisplayParent(const ValueType &value) const
+{
+    const std::uint32_t key = toKey(value);
+    std::uint32_t low = 0;
+    std::uint32_t high = 0;
+    std::uint32_t parentKey = key;
+    if(!locateDisplayKey(key, low, high, &parentKey) || parentKey == key)
+    {
+        return nullptr;
+    }
+    return getNode(parentKey);
+}
+
+template <class ValueType, class Compare, class Stats>
+inline shared_ptr<typename VanEmdeBoasTree<ValueType, Compare, Stats>::BinaryTreeNode> VanEmdeBoasTree<ValueType, Compare, Stats>::getDisplayRoot() const
+{
+    std::uint32_t rootKey = 0;
+    return getDisplayKey(0, std::numeric_limits<std::uint32_t>::max(), rootKey) ? getNode(rootKey) : nullptr;
+}
+
+#endif // VANEMDEBOASTREE_H
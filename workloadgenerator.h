@@ -0,0 +1,306 @@
+#ifndef WORKLOADGENERATOR_H
+#define WORKLOADGENERATOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// xoshiro256** by Blackman and Vigna, seeded through splitmix64. Four words of state and no locking,
+// every thread keeps its own. Satisfies UniformRandomBitGenerator, so it also works with <random> and std::shuffle
+class Xoshiro256
+{
+public:
+    using result_type = std::uint64_t;
+
+    explicit Xoshiro256(std::uint64_t seed = 0) { setSeed(seed); }
+
+    void setSeed(std::uint64_t seed);
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()();
+
+    // In [0, bound). The modulo bias is below bound / 2^64, far under anything a workload can notice
+    std::uint64_t bounded(std::uint64_t bound) { return bound > 0 ? (*this)() % bound : 0; }
+    // In [0, 1), from the top 53 bits
+    double nextDouble() { return ((*this)() >> 11) * 0x1.0p-53; }
+
+private:
+    static std::uint64_t rotateLeft(std::uint64_t value, int shift) { return (value << shift) | (value >> (64 - shift)); }
+
+    std::uint64_t state[4] = {};
+};
+
+inline void Xoshiro256::setSeed(std::uint64_t seed)
+{
+    for(std::uint64_t &word : state)
+    {
+        std::uint64_t mixed = (seed += 0x9e3779b97f4a7c15ull);
+        mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ull;
+        mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebull;
+        word = mixed ^ (mixed >> 31);
+    }
+}
+
+inline Xoshiro256::result_type Xoshiro256::operator()()
+{
+    const std::uint64_t result = rotateLeft(state[1] * 5, 7) * 9;
+    const std::uint64_t shifted = state[1] << 17;
+
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= shifted;
+    state[3] = rotateLeft(state[3], 45);
+    return result;
+}
+
+enum class KeyDistribution
+{
+    Uniform,        // every key of the range equally likely
+    Zipfian,        // key low + r - 1 drawn with probability proportional to 1 / r^exponent
+    Sorted,         // low, low + 1, ... wrapping around after high
+    ReverseSorted,  // high, high - 1, ... wrapping around after low
+    NearlySorted,   // sorted, with a fraction of the keys moved up to a window away
+    Sawtooth        // teeth that each climb over the whole range, every tooth one step further right
+};
+
+inline const char* getKeyDistributionName(KeyDistribution distribution)
+{
+    switch(distribution)
+    {
+    case KeyDistribution::Uniform: return "uniform";
+    case KeyDistribution::Zipfian: return "zipfian";
+    case KeyDistribution::Sorted: return "sorted";
+    case KeyDistribution::ReverseSorted: return "reverse";
+    case KeyDistribution::NearlySorted: return "nearly-sorted";
+    case KeyDistribution::Sawtooth: return "sawtooth";
+    }
+    return "";
+}
+
+inline bool parseKeyDistribution(const std::string &name, KeyDistribution &outDistribution)
+{
+    for(const KeyDistribution distribution : { KeyDistribution::Uniform, KeyDistribution::Zipfian, KeyDistribution::Sorted
+                                             , KeyDistribution::ReverseSorted, KeyDistribution::NearlySorted, KeyDistribution::Sawtooth })
+    {
+        if(name == getKeyDistributionName(distribution))
+        {
+            outDistribution = distribution;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Stream of keys from [low, high] in one of the distributions. Every key costs a handful of instructions and no
+// allocation, so millions of keys are cheap, and the same seed and settings always give the same stream
+class WorkloadGenerator
+{
+public:
+    WorkloadGenerator(KeyDistribution distribution, std::int64_t low, std::int64_t high, std::uint64_t seed = 42);
+
+    // Skew of the Zipfian distribution, any positive value
+    void setZipfExponent(double exponent);
+    // Share of nearly sorted keys moved, and how far they may move
+    void setDisorder(double fraction, std::uint64_t window = 16);
+    // Number of sawtooth teeth in one pass over the range
+    void setSawtoothTeeth(std::uint64_t teethCount);
+
+    // Starts the stream over from the seed
+    void reset();
+
+    std::int64_t next();
+
+    // Appends count keys, one reserve and no other allocation
+    template <class ValueType>
+    void generate(std::size_t count, std::vector<ValueType> &outValues);
+
+    // Hands the keys out in chunks of up to chunkSize, each chunk a vector the callback may move from
+    template <class ValueType, class Function>
+    void generateChunks(std::size_t count, std::size_t chunkSize, Function onChunk);
+
+private:
+    std::uint64_t nextZipfRank();
+
+    double zipfH(double x) const { return std::exp(-zipfExponent * std::log(x)); }
+    double zipfHIntegral(double x) const;
+    double zipfHIntegralInverse(double x) const;
+
+    KeyDistribution distribution;
+    std::int64_t low;
+    std::uint64_t span;
+    std::uint64_t seed;
+    Xoshiro256 random;
+
+    std::uint64_t position = 0;
+
+    double zipfExponent = 1.0;
+    double zipfHIntegralX1 = 0.0;
+    double zipfHIntegralN = 0.0;
+    double zipfThreshold = 0.0;
+
+    double disorderFraction = 0.05;
+    std::uint64_t disorderWindow = 16;
+
+    std::uint64_t teethCount = 8;
+    std::uint64_t tooth = 0;
+    std::uint64_t toothOffset = 0;
+};
+
+inline WorkloadGenerator::WorkloadGenerator(KeyDistribution distribution, std::int64_t low, std::int64_t high, std::uint64_t seed)
+    : distribution(distribution)
+    , low(std::min(low, high))
+    , span(static_cast<std::uint64_t>(std::max(low, high)) - static_cast<std::uint64_t>(std::min(low, high)) + 1)
+    , seed(seed)
+    , random(seed)
+{
+    // A span of 0 stands for the whole 64 bit range
+    if(span == 0)
+    {
+        span = std::numeric_limits<std::uint64_t>::max();
+    }
+    setZipfExponent(zipfExponent);
+}
+
+inline void WorkloadGenerator::setZipfExponent(double exponent)
+{
+    // Rejection inversion by Hörmann and Derflinger, constant time per key without a table of the whole range
+    zipfExponent = exponent > 0 ? exponent : 1.0;
+    zipfHIntegralX1 = zipfHIntegral(1.5) - 1.0;
+    zipfHIntegralN = zipfHIntegral(static_cast<double>(span) + 0.5);
+    zipfThreshold = 2.0 - zipfHIntegralInverse(zipfHIntegral(2.5) - zipfH(2.0));
+}
+
+inline void WorkloadGenerator::setDisorder(double fraction, std::uint64_t window)
+{
+    disorderFraction = std::clamp(fraction, 0.0, 1.0);
+    disorderWindow = std::max<std::uint64_t>(window, 1);
+}
+
+inline void WorkloadGenerator::setSawtoothTeeth(std::uint64_t count)
+{
+    teethCount = std::clamp<std::uint64_t>(count, 1, span);
+    tooth = 0;
+    toothOffset = 0;
+}
+
+inline void WorkloadGenerator::reset()
+{
+    random.setSeed(seed);
+    position = 0;
+    tooth = 0;
+    toothOffset = 0;
+}
+
+inline std::int64_t WorkloadGenerator::next()
+{
+    std::uint64_t offset = 0;
+    switch(distribution)
+    {
+    case KeyDistribution::Uniform:
+        offset = random.bounded(span);
+        break;
+    case KeyDistribution::Zipfian:
+        offset = nextZipfRank() - 1;
+        break;
+    case KeyDistribution::Sorted:
+        offset = position++ % span;
+        break;
+    case KeyDistribution::ReverseSorted:
+        offset = span - 1 - position++ % span;
+        break;
+    case KeyDistribution::NearlySorted:
+        offset = position++ % span;
+        if(random.nextDouble() < disorderFraction)
+        {
+            // Moved within the window, clamped to the range
+            const std::uint64_t shift = random.bounded(2 * disorderWindow + 1);
+            offset = shift < disorderWindow ? offset - std::min(offset, disorderWindow - shift)
+                                            : offset + std::min(span - 1 - offset, shift - disorderWindow);
+        }
+        break;
+    case KeyDistribution::Sawtooth:
+        // Tooth t visits t, t + teeth, t + 2 * teeth, ... so one pass of all the teeth visits every key once
+        offset = tooth + toothOffset;
+        toothOffset += teethCount;
+        if(toothOffset >= span - tooth)
+        {
+            tooth = (tooth + 1) % teethCount;
+            toothOffset = 0;
+        }
+        break;
+    }
+    return static_cast<std::int64_t>(static_cast<std::uint64_t>(low) + offset);
+}
+
+template <class ValueType>
+void WorkloadGenerator::generate(std::size_t count, std::vector<ValueType> &outValues)
+{
+    outValues.reserve(outValues.size() + count);
+    for(std::size_t i = 0; i < count; i++)
+    {
+        if constexpr (std::is_arithmetic_v<ValueType>)
+        {
+            outValues.push_back(static_cast<ValueType>(next()));
+        }
+        else
+        {
+            outValues.emplace_back(next());
+        }
+    }
+}
+
+template <class ValueType, class Function>
+void WorkloadGenerator::generateChunks(std::size_t count, std::size_t chunkSize, Function onChunk)
+{
+    chunkSize = std::max<std::size_t>(chunkSize, 1);
+    std::vector<ValueType> chunk;
+    while(count > 0)
+    {
+        const std::size_t chunkCount = std::min(count, chunkSize);
+        chunk.clear();
+        generate(chunkCount, chunk);
+        onChunk(chunk);
+        count -= chunkCount;
+    }
+}
+
+inline std::uint64_t WorkloadGenerator::nextZipfRank()
+{
+    while(true)
+    {
+        const double u = zipfHIntegralN + random.nextDouble() * (zipfHIntegralX1 - zipfHIntegralN);
+        const double x = zipfHIntegralInverse(u);
+        const std::uint64_t rank = static_cast<std::uint64_t>(std::clamp(x + 0.5, 1.0, static_cast<double>(span)));
+        if(rank - x <= zipfThreshold || u >= zipfHIntegral(rank + 0.5) - zipfH(static_cast<double>(rank)))
+        {
+            return std::min(rank, span);
+        }
+    }
+}
+
+inline double WorkloadGenerator::zipfHIntegral(double x) const
+{
+    // (x^(1 - s) - 1) / (1 - s), with the s = 1 limit log(x) taken care of by the series
+    const double logX = std::log(x);
+    const double t = (1.0 - zipfExponent) * logX;
+    const double expm1Ratio = std::abs(t) > 1e-8 ? std::expm1(t) / t : 1.0 + t / 2.0 * (1.0 + t / 3.0 * (1.0 + t / 4.0));
+    return expm1Ratio * logX;
+}
+
+inline double WorkloadGenerator::zipfHIntegralInverse(double x) const
+{
+    const double t = std::max(x * (1.0 - zipfExponent), -1.0);
+    const double log1pRatio = std::abs(t) > 1e-8 ? std::log1p(t) / t : 1.0 - t * (0.5 - t * (1.0 / 3.0 - 0.25 * t));
+    return std::exp(log1pRatio * x);
+}
+
+#endif // WORKLOADGENERATOR_H